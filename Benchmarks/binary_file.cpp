@@ -0,0 +1,164 @@
+//
+//  binary_file.cpp
+//  benchmarks
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <kss/io/binary_file.hpp>
+#include <kss/io/fileutil.hpp>
+
+using namespace std;
+using namespace kss::io::file;
+
+namespace {
+    // A simple record for the benchmarks.
+    struct srec {
+        int i;
+        long l;
+    };
+
+    // Returns the number of milliseconds taken to run fn.
+    template <class Fn>
+    long long millisecondsFor(Fn fn) {
+        const auto start = chrono::steady_clock::now();
+        fn();
+        const auto elapsed = chrono::steady_clock::now() - start;
+        return chrono::duration_cast<chrono::milliseconds>(elapsed).count();
+    }
+
+    // Compare a sequential scan through FileOf with one through MappedFile.
+    void mappedScan() {
+        static constexpr size_t numRecords = 10000000;
+        const string filename = temporaryFilename("/tmp/bench");
+        {
+            MappedFile mf(filename, BinaryFile::writing);
+            mf.resize(numRecords * sizeof(srec));
+            srec* recs = reinterpret_cast<srec*>(mf.writableData());
+            for (size_t i = 0; i < numRecords; ++i) {
+                recs[i] = srec { (int)i, (long)i };
+            }
+        }
+
+        long fileOfTotal = 0;
+        const auto fileOfTime = millisecondsFor([&] {
+            for (const srec& r : FileOf<srec>(filename)) {
+                fileOfTotal += r.l;
+            }
+        });
+
+        long mappedTotal = 0;
+        const auto mappedTime = millisecondsFor([&] {
+            MappedFile mf(filename);
+            mf.advise(MappedFile::Advice::sequential);
+            const srec* recs = reinterpret_cast<const srec*>(mf.data());
+            for (size_t i = 0, n = mf.size() / sizeof(srec); i < n; ++i) {
+                mappedTotal += recs[i].l;
+            }
+        });
+
+        cout << "Scan of " << numRecords << " records" << endl;
+        cout << "  FileOf:     " << fileOfTime << " ms" << endl;
+        cout << "  MappedFile: " << mappedTime << " ms"
+            << (mappedTotal == fileOfTotal ? "" : " (totals differ)") << endl;
+        remove(filename.c_str());
+    }
+
+    // Compare FileOf's single record reads and writes with readN and writeN.
+    void bulkTransfers() {
+        static constexpr size_t numRecords = 1000000;
+        const string filename = temporaryFilename("/tmp/bench");
+        vector<srec> recs;
+        for (size_t i = 0; i < numRecords; ++i) {
+            recs.push_back(srec { (int)i, (long)i });
+        }
+
+        const auto singleWriteTime = millisecondsFor([&] {
+            FileOf<srec> fo(filename, BinaryFile::writing);
+            for (const auto& r : recs) {
+                fo.write(r);
+            }
+        });
+        const auto bulkWriteTime = millisecondsFor([&] {
+            FileOf<srec> fo(filename, BinaryFile::writing);
+            fo.writeN(recs.data(), recs.size());
+        });
+        const auto singleReadTime = millisecondsFor([&] {
+            FileOf<srec> fo(filename);
+            for (size_t i = 0; i < numRecords; ++i) {
+                recs[i] = fo.read();
+            }
+        });
+        const auto bulkReadTime = millisecondsFor([&] {
+            FileOf<srec> fo(filename);
+            fo.readN(recs.data(), recs.size());
+        });
+
+        cout << "Transfer of " << numRecords << " records" << endl;
+        cout << "  write:  " << singleWriteTime << " ms" << endl;
+        cout << "  writeN: " << bulkWriteTime << " ms" << endl;
+        cout << "  read:   " << singleReadTime << " ms" << endl;
+        cout << "  readN:  " << bulkReadTime << " ms" << endl;
+        remove(filename.c_str());
+    }
+
+    // Compare sequential transfers through BinaryFile using various buffer sizes. Each
+    // call transfers a 4 KB block, which is large enough that the cost of the call
+    // itself is small compared with the copying, but small enough that the buffer
+    // still determines how often stdio needs to make a system call. Writes are easily
+    // disturbed by the writeback of earlier runs, so each run starts with a new file
+    // and no dirty pages, and the best of several runs is reported.
+    void bufferSizes() {
+        static constexpr size_t fileSize = 256 * 1024 * 1024;
+        static constexpr size_t blockSize = 4096;
+        static constexpr int numRuns = 5;
+        const string filename = temporaryFilename("/tmp/bench");
+        vector<char> block(blockSize, 'x');
+
+        cout << "Transfer of " << (fileSize / (1024 * 1024)) << " MB in "
+            << (blockSize / 1024) << " KB blocks (best of " << numRuns << ")" << endl;
+        for (const size_t bufferSize : { size_t(BUFSIZ), size_t(64*1024), size_t(1024*1024) }) {
+            auto writeTime = numeric_limits<long long>::max();
+            auto readTime = numeric_limits<long long>::max();
+            for (int run = 0; run < numRuns; ++run) {
+                remove(filename.c_str());
+                sync();
+                writeTime = min(writeTime, millisecondsFor([&] {
+                    BinaryFile bf(filename, BinaryFile::writing, bufferSize);
+                    for (size_t i = 0; i < fileSize; i += blockSize) {
+                        bf.writeFully(block.data(), blockSize);
+                    }
+                }));
+                readTime = min(readTime, millisecondsFor([&] {
+                    BinaryFile bf(filename, BinaryFile::reading, bufferSize);
+                    while (bf.read(block.data(), blockSize) > 0) {
+                    }
+                }));
+            }
+
+            cout << "  " << (bufferSize / 1024) << " KB buffer: write " << writeTime
+                << " ms, read " << readTime << " ms" << endl;
+        }
+        remove(filename.c_str());
+    }
+}
+
+
+int main() {
+    mappedScan();
+    bulkTransfers();
+    bufferSizes();
+    return 0;
+}
@@ -0,0 +1,174 @@
+//
+//  poller.cpp
+//  benchmarks
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <kss/io/fileutil.hpp>
+#include <kss/io/poller.hpp>
+
+using namespace std;
+using namespace kss::io;
+
+namespace {
+    // Delegate that replaces its one shot resource with a new one each time it is
+    // reported, simulating a connection arriving and another leaving on each pass
+    // through the poller.
+    class ChurningDelegate : public PollerDelegate {
+    public:
+        PolledResource  resource;
+        size_t          numChurns { 0 };
+        size_t          maxChurns { 0 };
+
+        bool pollerShouldStop() const override { return numChurns >= maxChurns; }
+
+        void pollerResourceWriteIsReady(Poller& p, const PolledResource& r) override {
+            p.remove(r.handle);
+            p.add(resource);
+            ++numChurns;
+        }
+    };
+
+    // Delegate that counts events until it has seen a given number, timing those
+    // that follow the warmup.
+    class DispatchDelegate : public PollerDelegate {
+    public:
+        static constexpr size_t warmup = 1000;
+
+        size_t  numEvents { 0 };
+        size_t  maxEvents { 0 };
+        chrono::steady_clock::time_point    startOfTiming;
+        chrono::steady_clock::time_point    endOfTiming;
+
+        bool pollerShouldStop() const override { return numEvents >= maxEvents; }
+
+        void pollerResourceWriteIsReady(Poller&, const PolledResource&) override {
+            if (++numEvents == warmup) {
+                startOfTiming = chrono::steady_clock::now();
+            }
+            else if (numEvents == maxEvents) {
+                endOfTiming = chrono::steady_clock::now();
+            }
+        }
+    };
+
+    // Create a connected pair of sockets.
+    pair<int, int> makeSocketPair() {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+            throw system_error(errno, system_category(), "socketpair");
+        }
+        return make_pair(sv[0], sv[1]);
+    }
+
+    // The engines that should work on this platform.
+    vector<Poller::Engine> availableEngines() {
+#if defined(__linux)
+        return { Poller::Engine::poll, Poller::Engine::epoll };
+#else
+        return { Poller::Engine::poll };
+#endif
+    }
+
+    const char* engineName(Poller::Engine engine) {
+        return (engine == Poller::Engine::poll ? "poll" : "epoll");
+    }
+
+    // Time a resource being replaced while a number of idle resources are also
+    // being monitored. Applying the changes incrementally means the cost should
+    // grow little with the number of idle resources (except for the poll engine,
+    // where poll() itself must examine them all).
+    void churn() {
+        static constexpr size_t numChurns = 10000;
+        static constexpr size_t numIdle[] = { 10, 250 };
+
+        cout << "Churn of " << numChurns << " resources" << endl;
+        for (const auto engine : availableEngines()) {
+            for (const auto n : numIdle) {
+                vector<unique_ptr<file::FiledesGuard>> guards;
+                Poller p(engine);
+                PolledResource r;
+                r.event = PolledResource::Event::read;
+                for (size_t i = 0; i < n; ++i) {
+                    const auto sv = makeSocketPair();
+                    guards.emplace_back(new file::FiledesGuard(sv.first));
+                    guards.emplace_back(new file::FiledesGuard(sv.second));
+                    r.name = "idle" + to_string(i);
+                    r.filedes = sv.first;
+                    p.add(r);
+                }
+
+                const auto sv = makeSocketPair();
+                guards.emplace_back(new file::FiledesGuard(sv.first));
+                guards.emplace_back(new file::FiledesGuard(sv.second));
+                ChurningDelegate d;
+                d.maxChurns = numChurns;
+                d.resource.name = "churn";
+                d.resource.filedes = sv.first;
+                d.resource.event = PolledResource::Event::write;
+                d.resource.mode = PolledResource::Mode::oneShot;
+                p.add(d.resource);
+                p.setDelegate(&d);
+
+                const auto start = chrono::steady_clock::now();
+                p.run();
+                const auto elapsed = chrono::steady_clock::now() - start;
+                const auto us = chrono::duration_cast<chrono::microseconds>(elapsed).count();
+                cout << "  " << engineName(engine) << " with " << n << " idle resources: "
+                    << (double(us) / numChurns) << " us per churn" << endl;
+            }
+        }
+    }
+
+    // Time the dispatch of events. A level triggered write resource on a socket is
+    // always ready, so each pass through run() dispatches exactly one event.
+    void dispatch() {
+        static constexpr size_t numEvents = 100000;
+
+        cout << "Dispatch of " << numEvents << " events" << endl;
+        for (const auto engine : availableEngines()) {
+            const auto sv = makeSocketPair();
+            file::FiledesGuard g0(sv.first);
+            file::FiledesGuard g1(sv.second);
+
+            Poller p(engine);
+            DispatchDelegate d;
+            d.maxEvents = numEvents;
+            p.setDelegate(&d);
+
+            PolledResource r;
+            r.name = "writer";
+            r.filedes = sv.first;
+            r.event = PolledResource::Event::write;
+            p.add(r);
+            p.run();
+
+            const auto numTimed = numEvents - DispatchDelegate::warmup;
+            const auto ns = chrono::duration_cast<chrono::nanoseconds>(d.endOfTiming - d.startOfTiming).count();
+            cout << "  " << engineName(engine) << ": " << (double(ns) / numTimed)
+                << " ns per event" << endl;
+        }
+    }
+}
+
+int main() {
+    churn();
+    dispatch();
+    return 0;
+}
@@ -6,12 +6,21 @@
 //  Copyright (c) 2015 Klassen Software Solutions. All rights reserved.
 //
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
 
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <kss/contract/all.h>
 
 #include "binary_file.hpp"
@@ -48,19 +57,321 @@ namespace {
         if (flags & O_RDWR) return "wb+";
         return "rb";
     }
+
+    // The open(2) flags that fopen uses for the given mode string.
+    int toFopenFlags(const string& modeString) noexcept {
+        const bool update = (modeString.find('+') != string::npos);
+        switch (modeString[0]) {
+            case 'w':   return (update ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+            case 'a':   return (update ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND;
+            default:    return (update ? O_RDWR : O_RDONLY);
+        }
+    }
+}
+
+#if defined(__linux)
+
+// State of a file opened in direct mode. O_DIRECT requires the memory, file offset and
+// length of each transfer to be aligned to the block size, hence all I/O goes through an
+// aligned buffer, and the FILE* is created by fopencookie on top of this. The position
+// and the actual size of the file are kept here, as the file itself may be padded to a
+// block boundary until it is flushed or closed.
+struct BinaryFile::Direct {
+    static constexpr size_t defaultBufferSize = 1024 * 1024;
+
+    int     filedes = -1;
+    int     flags = 0;          // The flags the file would have had if not direct.
+    size_t  blockSize = 0;
+    size_t  bufferSize = 0;
+    char*   buffer = nullptr;
+    off_t   pos = 0;
+    off_t   size = 0;
+
+    ~Direct() noexcept {
+        free(buffer);
+        if (filedes >= 0) {
+            ::close(filedes);
+        }
+    }
+
+    size_t roundUp(size_t n) const noexcept {
+        return (n + blockSize - 1) / blockSize * blockSize;
+    }
+
+    char* allocate(size_t len) const {
+        void* p = nullptr;
+        const int err = posix_memalign(&p, blockSize, len);
+        if (err) {
+            throw system_error(err, system_category(), "posix_memalign");
+        }
+        return static_cast<char*>(p);
+    }
+
+    int truncate() noexcept {
+        if ((flags & O_ACCMODE) == O_RDONLY) {
+            return 0;
+        }
+        return ftruncate(filedes, size);
+    }
+
+    // Read a single block, leaving the buffer untouched past the end of the file.
+    int readBlock(char* buf, off_t offset) noexcept {
+        ssize_t r;
+        do {
+            r = pread(filedes, buf, blockSize, offset);
+        } while (r == -1 && errno == EINTR);
+        return (r == -1 ? -1 : 0);
+    }
+
+    int writeBlocks(const char* buf, size_t len, off_t offset) noexcept {
+        while (len > 0) {
+            const auto w = pwrite(filedes, buf, len, offset);
+            if (w == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            buf += w;
+            len -= size_t(w);
+            offset += w;
+        }
+        return 0;
+    }
+
+    // Read/write n bytes at offset, using buf (which must be aligned and a multiple of
+    // the block size) for the actual I/O. Returns the number of bytes transferred or
+    // -1 on an error.
+    ssize_t readAt(off_t offset, char* out, size_t n, char* buf, size_t bufLen) noexcept;
+    ssize_t writeAt(off_t offset, const char* in, size_t n, char* buf, size_t bufLen) noexcept;
+
+    static FILE* open(const string& filename, const string& modeString, size_t bufferSize,
+                      Direct*& direct);
+
+    static ssize_t cookieRead(void* cookie, char* buf, size_t n);
+    static ssize_t cookieWrite(void* cookie, const char* buf, size_t n);
+    static int cookieSeek(void* cookie, off64_t* offset, int whence);
+    static int cookieClose(void* cookie);
+};
+
+constexpr size_t BinaryFile::Direct::defaultBufferSize;
+
+ssize_t BinaryFile::Direct::readAt(off_t offset, char* out, size_t n, char* buf, size_t bufLen) noexcept {
+    if (offset >= size) {
+        return 0;
+    }
+    n = min(n, size_t(size - offset));
+
+    size_t total = 0;
+    while (total < n) {
+        const off_t p = offset + off_t(total);
+        const off_t start = p - (p % off_t(blockSize));
+        const size_t skip = size_t(p - start);
+        const size_t len = min(n - total, bufLen - skip);
+        const auto r = pread(filedes, buf, roundUp(skip + len), start);
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (size_t(r) <= skip) {
+            break;
+        }
+        const size_t got = min(len, size_t(r) - skip);
+        memcpy(out + total, buf + skip, got);
+        total += got;
+    }
+    return ssize_t(total);
+}
+
+ssize_t BinaryFile::Direct::writeAt(off_t offset, const char* in, size_t n, char* buf, size_t bufLen) noexcept {
+    size_t total = 0;
+    while (total < n) {
+        const off_t p = offset + off_t(total);
+        const off_t start = p - (p % off_t(blockSize));
+        const size_t skip = size_t(p - start);
+        const size_t len = min(n - total, bufLen - skip);
+        const size_t alignedLen = roundUp(skip + len);
+
+        // Partial blocks at either end must keep the data already in the file, and
+        // are padded with zeros past its end.
+        if (skip > 0 || alignedLen != skip + len) {
+            memset(buf, 0, alignedLen);
+            if (skip > 0 && start < size) {
+                if (readBlock(buf, start) == -1) {
+                    return -1;
+                }
+            }
+            const off_t last = start + off_t(alignedLen - blockSize);
+            if (alignedLen != skip + len && last < size && !(last == start && skip > 0)) {
+                if (readBlock(buf + alignedLen - blockSize, last) == -1) {
+                    return -1;
+                }
+            }
+        }
+
+        memcpy(buf + skip, in + total, len);
+        if (writeBlocks(buf, alignedLen, start) == -1) {
+            return -1;
+        }
+        total += len;
+        size = max(size, p + off_t(len));
+    }
+    return ssize_t(total);
+}
+
+FILE* BinaryFile::Direct::open(const string& filename, const string& modeString,
+                               size_t bufferSize, Direct*& direct)
+{
+    unique_ptr<Direct> d(new Direct());
+    d->flags = toFopenFlags(modeString);
+
+    // Partial blocks are read back before being rewritten, hence a writable file must
+    // also be readable. Appending is handled in cookieWrite, as O_APPEND would cause
+    // pwrite to ignore our offsets.
+    const int accessMode = ((d->flags & O_ACCMODE) == O_RDONLY ? O_RDONLY : O_RDWR);
+    d->filedes = ::open(filename.c_str(),
+                        (d->flags & ~(O_ACCMODE | O_APPEND)) | accessMode | O_DIRECT,
+                        0666);
+    if (d->filedes == -1) {
+        throw system_error(errno, system_category(), "open");
+    }
+
+    struct stat st;
+    if (fstat(d->filedes, &st) == -1) {
+        throw system_error(errno, system_category(), "fstat");
+    }
+    d->size = st.st_size;
+    d->blockSize = max<size_t>(4096, size_t(st.st_blksize));
+    d->bufferSize = d->roundUp(bufferSize > 0 ? bufferSize : defaultBufferSize);
+    d->buffer = d->allocate(d->bufferSize);
+
+    cookie_io_functions_t funcs { cookieRead, cookieWrite, cookieSeek, cookieClose };
+    FILE* fp = fopencookie(d.get(), modeString.c_str(), funcs);
+    if (!fp) {
+        throw system_error(errno, system_category(), "fopencookie");
+    }
+    direct = d.release();
+    return fp;
+}
+
+ssize_t BinaryFile::Direct::cookieRead(void* cookie, char* buf, size_t n) {
+    auto* d = static_cast<Direct*>(cookie);
+    const auto r = d->readAt(d->pos, buf, n, d->buffer, d->bufferSize);
+    if (r > 0) {
+        d->pos += r;
+    }
+    return r;
+}
+
+ssize_t BinaryFile::Direct::cookieWrite(void* cookie, const char* buf, size_t n) {
+    auto* d = static_cast<Direct*>(cookie);
+    if (d->flags & O_APPEND) {
+        d->pos = d->size;
+    }
+    const auto w = d->writeAt(d->pos, buf, n, d->buffer, d->bufferSize);
+    if (w <= 0) {
+        return 0;       // fopencookie requires 0, not -1, on an error.
+    }
+    d->pos += w;
+    return w;
+}
+
+int BinaryFile::Direct::cookieSeek(void* cookie, off64_t* offset, int whence) {
+    auto* d = static_cast<Direct*>(cookie);
+    off64_t newPos;
+    switch (whence) {
+        case SEEK_SET:  newPos = *offset; break;
+        case SEEK_CUR:  newPos = d->pos + *offset; break;
+        case SEEK_END:  newPos = d->size + *offset; break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+    if (newPos < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    d->pos = newPos;
+    *offset = newPos;
+    return 0;
+}
+
+int BinaryFile::Direct::cookieClose(void* cookie) {
+    auto* d = static_cast<Direct*>(cookie);
+    const int ret = d->truncate();
+    const int err = errno;
+    delete d;
+    errno = err;
+    return ret;
 }
 
+#endif
+
 BinaryFile::BinaryFile(const string& filename, mode_t openMode) {
     contract::parameters({
         KSS_EXPR(!filename.empty())
     });
 
-    _fp = fopen(filename.c_str(), toOpenModeString(openMode).c_str());
-    if (!_fp) {
-        throw system_error(errno, system_category(), "fopen");
+    open(filename, openMode, 0, nullptr);
+}
+
+BinaryFile::BinaryFile(const string& filename, mode_t openMode, size_t bufferSize, void* buffer) {
+    contract::parameters({
+        KSS_EXPR(!filename.empty()),
+        KSS_EXPR(bufferSize > 0)
+    });
+
+    open(filename, openMode, bufferSize, buffer);
+}
+
+// Open the file, using the given buffer size if it is not 0.
+void BinaryFile::open(const string& filename, mode_t openMode, size_t bufferSize, void* buffer) {
+    const auto modeString = toOpenModeString(mode_t(openMode & ~direct));
+    if (openMode & direct) {
+#if defined(__linux)
+        _fp = Direct::open(filename, modeString, bufferSize, _direct);
+        if (bufferSize == 0) {
+            bufferSize = _direct->bufferSize;
+        }
+#else
+        _fp = fopen(filename.c_str(), modeString.c_str());
+        if (!_fp) {
+            throw system_error(errno, system_category(), "fopen");
+        }
+# if defined(__APPLE__)
+        if (fcntl(fileno(_fp), F_NOCACHE, 1) == -1) {
+            const auto err = errno;
+            fclose(_fp);
+            _fp = nullptr;
+            throw system_error(err, system_category(), "fcntl");
+        }
+# endif
+#endif
+    }
+    else {
+        _fp = fopen(filename.c_str(), modeString.c_str());
+        if (!_fp) {
+            throw system_error(errno, system_category(), "fopen");
+        }
     }
     _autoclose = true;
 
+    // setvbuf must be called before any other operation on the stream.
+    if (bufferSize > 0) {
+        if (!buffer) {
+            _buffer.reset(new char[bufferSize]);
+            buffer = _buffer.get();
+        }
+        if (setvbuf(_fp, static_cast<char*>(buffer), _IOFBF, bufferSize) != 0) {
+            const auto err = errno;
+            fclose(_fp);
+            _fp = nullptr;
+            throw system_error(err, system_category(), "setvbuf");
+        }
+    }
+
 #if defined(__linux)
     // It seems linux does not position the file at the end when opened for appending,
     // at least not after the fopen. Perhaps it does on the first write. In any event
@@ -125,9 +436,16 @@ BinaryFile::~BinaryFile() noexcept {
 
 BinaryFile& BinaryFile::operator=(BinaryFile&& f) noexcept {
     if (&f != this) {
+        // Close any file we already have, before its buffer is released.
+        if (_fp && _autoclose) {
+            fclose(_fp);
+        }
         _fp = f._fp;
         _autoclose = f._autoclose;
+        _buffer = std::move(f._buffer);
+        _direct = f._direct;
         f._fp = nullptr;
+        f._direct = nullptr;
     }
     return *this;
 }
@@ -266,12 +584,248 @@ void BinaryFile::flush() {
     if (fflush(_fp) != 0) {
         throw system_error(errno, system_category(), "fflush");
     }
+#if defined(__linux)
+    // Remove any padding that was added to the final block.
+    if (_direct && _direct->truncate() == -1) {
+        throw system_error(errno, system_category(), "ftruncate");
+    }
+#endif
 
     contract::postconditions({
         KSS_EXPR(tell() == pos)
     });
 }
 
+size_t BinaryFile::readAt(off_t offset, void* buf, size_t n) const {
+    contract::parameters({
+        KSS_EXPR(offset >= 0),
+        KSS_EXPR(buf != nullptr),
+        KSS_EXPR(n != 0)
+    });
+    contract::preconditions({
+        KSS_EXPR(isOpenFor(reading))
+    });
+
+#if defined(__linux)
+    if (_direct) {
+        // The stream may be using the internal buffer, so we need our own.
+        const auto len = min(_direct->bufferSize, _direct->roundUp(n) + _direct->blockSize);
+        unique_ptr<char, decltype(&free)> tmp(_direct->allocate(len), &free);
+        const auto r = _direct->readAt(offset, static_cast<char*>(buf), n, tmp.get(), len);
+        if (r == -1) {
+            throw system_error(errno, system_category(), "pread");
+        }
+        return size_t(r);
+    }
+#endif
+
+    const int fd = fileno(_fp);
+    size_t total = 0;
+    uint8_t* pos = static_cast<uint8_t*>(buf);
+    while (total < n) {
+        const auto bytesRead = pread(fd, pos + total, n - total, offset + off_t(total));
+        if (bytesRead == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, system_category(), "pread");
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        total += size_t(bytesRead);
+    }
+    return total;
+}
+
+void BinaryFile::writeAt(off_t offset, const void* buf, size_t n) {
+    contract::parameters({
+        KSS_EXPR(offset >= 0),
+        KSS_EXPR(buf != nullptr),
+        KSS_EXPR(n != 0)
+    });
+    contract::preconditions({
+        KSS_EXPR(isOpenFor(writing)),
+        KSS_EXPR(!isOpenFor(appending))
+    });
+
+#if defined(__linux)
+    if (_direct) {
+        const auto len = min(_direct->bufferSize, _direct->roundUp(n) + _direct->blockSize);
+        unique_ptr<char, decltype(&free)> tmp(_direct->allocate(len), &free);
+        if (_direct->writeAt(offset, static_cast<const char*>(buf), n, tmp.get(), len) == -1) {
+            throw system_error(errno, system_category(), "pwrite");
+        }
+        return;
+    }
+#endif
+
+    const int fd = fileno(_fp);
+    size_t total = 0;
+    const uint8_t* pos = static_cast<const uint8_t*>(buf);
+    while (total < n) {
+        const auto bytesWritten = pwrite(fd, pos + total, n - total, offset + off_t(total));
+        if (bytesWritten == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw system_error(errno, system_category(), "pwrite");
+        }
+        total += size_t(bytesWritten);
+    }
+}
+
+namespace {
+    // Vectored transfers smaller than this are copied through the FILE* buffer, as
+    // that is cheaper than flushing the stream.
+    constexpr size_t minVectoredSize = 64 * 1024;
+
+    size_t totalLength(const struct iovec* iov, size_t iovcnt) noexcept {
+        size_t total = 0;
+        for (size_t i = 0; i < iovcnt; ++i) {
+            total += iov[i].iov_len;
+        }
+        return total;
+    }
+
+    // Perform preadv/pwritev, or writev if offset is negative, until all the buffers
+    // have been transferred or the end of the file is reached. Returns the number of
+    // bytes transferred.
+    size_t vectoredIO(int fd, const struct iovec* iov, size_t iovcnt, off_t offset, bool writing) {
+        vector<struct iovec> v(iov, iov + iovcnt);
+        size_t first = 0;
+        size_t total = 0;
+        while (first < v.size()) {
+            const int cnt = int(min<size_t>(v.size() - first, IOV_MAX));
+            ssize_t n;
+            if (!writing) {
+                n = ::preadv(fd, &v[first], cnt, offset + off_t(total));
+            }
+            else if (offset < 0) {
+                n = ::writev(fd, &v[first], cnt);
+            }
+            else {
+                n = ::pwritev(fd, &v[first], cnt, offset + off_t(total));
+            }
+
+            if (n == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw system_error(errno, system_category(), writing ? "pwritev" : "preadv");
+            }
+            if (n == 0 && !writing) {
+                break;
+            }
+
+            // Skip the buffers that are complete and adjust the one that is partial.
+            total += size_t(n);
+            size_t remain = size_t(n);
+            while (first < v.size() && remain >= v[first].iov_len) {
+                remain -= v[first].iov_len;
+                ++first;
+            }
+            if (remain > 0) {
+                v[first].iov_base = static_cast<char*>(v[first].iov_base) + remain;
+                v[first].iov_len -= remain;
+            }
+        }
+        return total;
+    }
+}
+
+void BinaryFile::readv(const struct iovec* iov, size_t iovcnt) {
+    contract::parameters({
+        KSS_EXPR(iov != nullptr),
+        KSS_EXPR(iovcnt != 0)
+    });
+    contract::preconditions({
+        KSS_EXPR(isOpenFor(reading))
+    });
+
+    const auto pos = tell();
+    const auto total = totalLength(iov, iovcnt);
+    if (total < minVectoredSize || _direct) {
+        for (size_t i = 0; i < iovcnt; ++i) {
+            if (iov[i].iov_len > 0) {
+                readFully(iov[i].iov_base, iov[i].iov_len);
+            }
+        }
+    }
+    else {
+        // Any data written through the stream must reach the file before we read it.
+        if (fflush(_fp) != 0) {
+            throw system_error(errno, system_category(), "fflush");
+        }
+        const auto n = vectoredIO(fileno(_fp), iov, iovcnt, pos, false);
+        if (fseeko(_fp, pos + off_t(n), SEEK_SET) == -1) {
+            throw system_error(errno, system_category(), "fseeko");
+        }
+        if (n < total) {
+            throw kss::io::Eof();
+        }
+    }
+
+    contract::postconditions({
+        KSS_EXPR(static_cast<size_t>(tell()) == (pos + total))
+    });
+}
+
+void BinaryFile::writev(const struct iovec* iov, size_t iovcnt) {
+    contract::parameters({
+        KSS_EXPR(iov != nullptr),
+        KSS_EXPR(iovcnt != 0)
+    });
+    contract::preconditions({
+        KSS_EXPR(isOpenFor(writing))
+    });
+
+    const auto pos = tell();
+    const auto total = totalLength(iov, iovcnt);
+    if (total < minVectoredSize || _direct) {
+        for (size_t i = 0; i < iovcnt; ++i) {
+            if (iov[i].iov_len > 0) {
+                writeFully(iov[i].iov_base, iov[i].iov_len);
+            }
+        }
+    }
+    else {
+        // The data already in the stream must be written first, then the stream
+        // repositioned to the end of our data.
+        if (fflush(_fp) != 0) {
+            throw system_error(errno, system_category(), "fflush");
+        }
+        const bool append = isOpenFor(appending);
+        vectoredIO(fileno(_fp), iov, iovcnt, append ? -1 : pos, true);
+        const auto rc = (append ? fseeko(_fp, 0, SEEK_END) : fseeko(_fp, pos + off_t(total), SEEK_SET));
+        if (rc == -1) {
+            throw system_error(errno, system_category(), "fseeko");
+        }
+    }
+
+    contract::postconditions({
+        KSS_EXPR(isOpenFor(appending)
+                 ? true
+                 : static_cast<size_t>(tell()) == (pos + total))
+    });
+}
+
+void BinaryFile::prefetch(off_t offset, size_t len) const noexcept {
+    if (!_fp || _direct || len == 0) {
+        return;
+    }
+
+    const int fd = fileno(_fp);
+#if defined(__linux)
+    (void)posix_fadvise(fd, offset, off_t(len), POSIX_FADV_WILLNEED);
+#elif defined(__APPLE__)
+    struct radvisory ra;
+    ra.ra_offset = offset;
+    ra.ra_count = int(min<size_t>(len, INT_MAX));
+    (void)fcntl(fd, F_RDADVISE, &ra);
+#endif
+}
+
 
 // Position in the file.
 bool BinaryFile::eof() const noexcept {
@@ -349,12 +903,27 @@ void BinaryFile::fastForward() {
     }
 }
 
+off_t BinaryFile::size() const {
+    contract::preconditions({
+        KSS_EXPR(_fp != nullptr)
+    });
+
+#if defined(__linux)
+    if (_direct) {
+        return _direct->size;
+    }
+#endif
+
+    struct stat st;
+    if (fstat(fileno(_fp), &st) == -1) {
+        throw system_error(errno, system_category(), "fstat");
+    }
+    return st.st_size;
+}
+
 bool BinaryFile::isOpenFor(mode_t mode) const {
     if (_fp) {
-        const int fd = fileno(_fp);
-        contract::conditions({ KSS_EXPR(fd >= 0) });
-
-        const int flags = fcntl(fd, F_GETFL);
+        const int flags = openFlags();
         if ((mode & reading) && (flags & O_WRONLY)) {
             return false;
         }
@@ -371,3 +940,462 @@ bool BinaryFile::isOpenFor(mode_t mode) const {
     }
     return false;
 }
+
+int BinaryFile::openFlags() const {
+#if defined(__linux)
+    if (_direct) {
+        return _direct->flags;
+    }
+#endif
+
+    const int fd = fileno(_fp);
+    contract::conditions({ KSS_EXPR(fd >= 0) });
+    return fcntl(fd, F_GETFL);
+}
+
+
+// MARK: MappedFile
+
+namespace {
+    // Convert the open mode to the flags for open(2). Note that mmap requires the file
+    // to be readable, even if we only intend to write to it.
+    int toOpenFlags(BinaryFile::mode_t openMode) {
+        switch (openMode) {
+            case BinaryFile::reading:                           return O_RDONLY;
+            case BinaryFile::reading | BinaryFile::updating:    return O_RDWR;
+            case BinaryFile::writing:
+            case BinaryFile::writing | BinaryFile::updating:    return O_RDWR | O_CREAT | O_TRUNC;
+            case BinaryFile::appending:
+            case BinaryFile::appending | BinaryFile::updating:  return O_RDWR | O_CREAT;
+            default:
+                throw invalid_argument("invalid openMode");
+        }
+    }
+
+    int toMadvise(MappedFile::Advice advice) noexcept {
+        switch (advice) {
+            case MappedFile::Advice::sequential:    return MADV_SEQUENTIAL;
+            case MappedFile::Advice::random:        return MADV_RANDOM;
+            case MappedFile::Advice::willNeed:      return MADV_WILLNEED;
+            default:                                return MADV_NORMAL;
+        }
+    }
+}
+
+MappedFile::MappedFile(const string& filename, mode_t openMode) {
+    contract::parameters({
+        KSS_EXPR(!filename.empty())
+    });
+
+    const int flags = toOpenFlags(openMode);
+    _filedes = ::open(filename.c_str(), flags, 0666);
+    if (_filedes == -1) {
+        throw system_error(errno, system_category(), "open");
+    }
+    _writable = ((flags & O_ACCMODE) == O_RDWR);
+
+    try {
+        struct stat st;
+        if (fstat(_filedes, &st) == -1) {
+            throw system_error(errno, system_category(), "fstat");
+        }
+        remap(static_cast<size_t>(st.st_size));
+        _size = _capacity;
+    }
+    catch (...) {
+        close();
+        throw;
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_filedes >= 0),
+        KSS_EXPR(isOpenFor(openMode)),
+        KSS_EXPR(_size == _capacity)
+    });
+}
+
+MappedFile::MappedFile(MappedFile&& f) noexcept {
+    operator=(std::move(f));
+}
+
+MappedFile::~MappedFile() noexcept {
+    close();
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& f) noexcept {
+    if (&f != this) {
+        close();
+        _filedes = f._filedes;
+        _writable = f._writable;
+        _data = f._data;
+        _size = f._size;
+        _capacity = f._capacity;
+        f._filedes = -1;
+        f._data = nullptr;
+        f._size = f._capacity = 0;
+    }
+    return *this;
+}
+
+void MappedFile::close() noexcept {
+    if (_filedes >= 0) {
+        if (_data) {
+            munmap(_data, _capacity);
+        }
+        if (_writable && _capacity != _size) {
+            // Release any reserved space. There is nothing we can do about an error
+            // at this point, and the file contents are still correct.
+            (void)ftruncate(_filedes, static_cast<off_t>(_size));
+        }
+        ::close(_filedes);
+        _filedes = -1;
+        _data = nullptr;
+    }
+}
+
+// Change the size of the mapping. The file must already be at least newCapacity bytes.
+void MappedFile::remap(size_t newCapacity) {
+    if (newCapacity == _capacity) {
+        return;
+    }
+
+    if (newCapacity == 0) {
+        munmap(_data, _capacity);
+        _data = nullptr;
+        _capacity = 0;
+        return;
+    }
+
+    void* addr = MAP_FAILED;
+    if (!_data) {
+        const int prot = PROT_READ | (_writable ? PROT_WRITE : 0);
+        addr = mmap(nullptr, newCapacity, prot, MAP_SHARED, _filedes, 0);
+        if (addr == MAP_FAILED) {
+            throw system_error(errno, system_category(), "mmap");
+        }
+    }
+    else {
+#if defined(__linux)
+        addr = mremap(_data, _capacity, newCapacity, MREMAP_MAYMOVE);
+        if (addr == MAP_FAILED) {
+            throw system_error(errno, system_category(), "mremap");
+        }
+#else
+        const int prot = PROT_READ | (_writable ? PROT_WRITE : 0);
+        addr = mmap(nullptr, newCapacity, prot, MAP_SHARED, _filedes, 0);
+        if (addr == MAP_FAILED) {
+            throw system_error(errno, system_category(), "mmap");
+        }
+        munmap(_data, _capacity);
+#endif
+    }
+
+    _data = static_cast<uint8_t*>(addr);
+    _capacity = newCapacity;
+}
+
+void MappedFile::write(const void* buf, size_t n, size_t offset) {
+    contract::parameters({
+        KSS_EXPR(buf != nullptr),
+        KSS_EXPR(n != 0)
+    });
+    contract::preconditions({
+        KSS_EXPR(isOpenFor(BinaryFile::writing))
+    });
+
+    const auto endPos = offset + n;
+    if (endPos > _capacity) {
+        reserve(max(endPos, _capacity * 2));
+    }
+    if (endPos > _size) {
+        resize(endPos);
+    }
+    memcpy(_data + offset, buf, n);
+
+    contract::postconditions({
+        KSS_EXPR(_size >= endPos)
+    });
+}
+
+void MappedFile::resize(size_t newSize) {
+    contract::preconditions({
+        KSS_EXPR(isOpenFor(BinaryFile::writing))
+    });
+
+    if (newSize > _size) {
+        // Space beyond the end of the file is only guaranteed to be zero if it has
+        // never been used. It may contain old data if the file was previously shrunk.
+        const auto usedEnd = min(newSize, _capacity);
+        if (usedEnd > _size) {
+            memset(_data + _size, 0, usedEnd - _size);
+        }
+        reserve(newSize);
+    }
+    _size = newSize;
+
+    contract::postconditions({
+        KSS_EXPR(_size == newSize),
+        KSS_EXPR(_capacity >= _size)
+    });
+}
+
+void MappedFile::reserve(size_t newCapacity) {
+    contract::preconditions({
+        KSS_EXPR(isOpenFor(BinaryFile::writing))
+    });
+
+    if (newCapacity > _capacity) {
+        if (ftruncate(_filedes, static_cast<off_t>(newCapacity)) == -1) {
+            throw system_error(errno, system_category(), "ftruncate");
+        }
+        remap(newCapacity);
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_capacity >= newCapacity)
+    });
+}
+
+void MappedFile::flush() {
+    contract::preconditions({
+        KSS_EXPR(_filedes >= 0)
+    });
+
+    if (_writable) {
+        if (_capacity != _size) {
+            if (ftruncate(_filedes, static_cast<off_t>(_size)) == -1) {
+                throw system_error(errno, system_category(), "ftruncate");
+            }
+            remap(_size);
+        }
+        if (_data && msync(_data, _size, MS_SYNC) == -1) {
+            throw system_error(errno, system_category(), "msync");
+        }
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_capacity == _size)
+    });
+}
+
+void MappedFile::advise(Advice advice, size_t offset, size_t len) {
+    contract::parameters({
+        KSS_EXPR(offset <= _size),
+        KSS_EXPR(len <= (_size - offset))
+    });
+
+    if (_data && len > 0) {
+        // madvise requires the address to be page aligned.
+        static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const auto start = offset - (offset % pageSize);
+        if (madvise(_data + start, len + (offset - start), toMadvise(advice)) == -1) {
+            throw system_error(errno, system_category(), "madvise");
+        }
+    }
+}
+
+bool MappedFile::isOpenFor(mode_t mode) const noexcept {
+    if (_filedes < 0) {
+        return false;
+    }
+    if (mode & (BinaryFile::writing | BinaryFile::appending | BinaryFile::updating)) {
+        return _writable;
+    }
+    return true;
+}
+
+
+// MARK: VarRecordFile
+
+namespace {
+    using length_t = uint32_t;
+
+    // Create a file if it does not already exist.
+    void createIfMissing(const string& filename) {
+        const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT, 0666);
+        if (fd == -1) {
+            throw system_error(errno, system_category(), "open");
+        }
+        ::close(fd);
+    }
+}
+
+constexpr size_t VarRecordFile::batchBytes;
+
+VarRecordFile::VarRecordFile(const string& filename, mode_t openMode) {
+    contract::parameters({
+        KSS_EXPR(!filename.empty())
+    });
+
+    const auto indexName = indexFilename(filename);
+    switch (openMode) {
+        case BinaryFile::reading:
+            _data = BinaryFile(filename, BinaryFile::reading);
+            _index = MappedFile(indexName, BinaryFile::reading);
+            break;
+        case BinaryFile::writing:
+        case BinaryFile::writing | BinaryFile::updating:
+            _data = BinaryFile(filename, BinaryFile::writing | BinaryFile::updating);
+            _index = MappedFile(indexName, BinaryFile::writing);
+            break;
+        case BinaryFile::reading | BinaryFile::updating:
+        case BinaryFile::appending:
+        case BinaryFile::appending | BinaryFile::updating:
+            // The data is written using writeAt, which cannot be used with O_APPEND.
+            createIfMissing(filename);
+            _data = BinaryFile(filename, BinaryFile::reading | BinaryFile::updating);
+            _index = MappedFile(indexName, BinaryFile::appending);
+            break;
+        default:
+            throw invalid_argument("invalid openMode");
+    }
+
+    recover();
+
+    contract::postconditions({
+        KSS_EXPR(_index.size() == (_count * sizeof(uint64_t)) || !isOpenFor(BinaryFile::writing)),
+        KSS_EXPR(_dataSize <= static_cast<uint64_t>(_data.size()))
+    });
+}
+
+// Determine the valid records, repairing the files if they are writable.
+void VarRecordFile::recover() {
+    const auto dataSize = static_cast<uint64_t>(_data.size());
+    const auto* offsets = reinterpret_cast<const uint64_t*>(_index.data());
+    size_t count = _index.size() / sizeof(uint64_t);
+
+    // The index may end with zeros, if the process stopped before the space reserved
+    // for it was released, or with entries for data that never reached the disk. So
+    // we only trust the entries up to the first that does not start at 0 or follow
+    // the previous one, or that is beyond the end of the data.
+    for (size_t i = 0; i < count; ++i) {
+        if ((i == 0 ? offsets[i] != 0 : offsets[i] <= offsets[i-1])
+            || offsets[i] + sizeof(length_t) > dataSize)
+        {
+            count = i;
+            break;
+        }
+    }
+
+    // Find the last indexed record that is complete.
+    uint64_t end = 0;
+    while (count > 0) {
+        const auto offset = offsets[count-1];
+        length_t len = 0;
+        if (offset + sizeof(len) <= dataSize
+            && _data.readAt(off_t(offset), &len, sizeof(len)) == sizeof(len)
+            && offset + sizeof(len) + len <= dataSize)
+        {
+            end = offset + sizeof(len) + len;
+            break;
+        }
+        --count;
+    }
+
+    if (isOpenFor(BinaryFile::writing)) {
+        _index.resize(count * sizeof(uint64_t));
+        _count = count;
+        _dataSize = end;
+
+        // Index any complete records that follow, and drop a final partial record.
+        vector<uint64_t> newOffsets;
+        uint64_t offset = end;
+        length_t len = 0;
+        while (offset + sizeof(len) <= dataSize
+               && _data.readAt(off_t(offset), &len, sizeof(len)) == sizeof(len)
+               && offset + sizeof(len) + len <= dataSize)
+        {
+            newOffsets.push_back(offset);
+            offset += sizeof(len) + len;
+        }
+        if (!newOffsets.empty()) {
+            _index.append(newOffsets.data(), newOffsets.size() * sizeof(uint64_t));
+            _count += newOffsets.size();
+            _dataSize = offset;
+        }
+        if (_dataSize < dataSize) {
+            if (ftruncate(fileno(_data.handle()), off_t(_dataSize)) == -1) {
+                throw system_error(errno, system_category(), "ftruncate");
+            }
+        }
+    }
+    else {
+        _count = count;
+        _dataSize = end;
+    }
+}
+
+string VarRecordFile::read(size_t recNo) const {
+    const auto len = recordSize(recNo);
+    string rec(len, '\0');
+    if (len > 0) {
+        const auto offset = reinterpret_cast<const uint64_t*>(_index.data())[recNo];
+        if (_data.readAt(off_t(offset + sizeof(length_t)), &rec[0], len) != len) {
+            throw kss::io::Eof();
+        }
+    }
+    return rec;
+}
+
+size_t VarRecordFile::recordSize(size_t recNo) const {
+    contract::parameters({
+        KSS_EXPR(recNo < _count)
+    });
+
+    // The length is implied by the start of the next record, so need not be read.
+    const auto* offsets = reinterpret_cast<const uint64_t*>(_index.data());
+    const auto end = (recNo + 1 < _count ? offsets[recNo + 1] : _dataSize);
+    return size_t(end - offsets[recNo] - sizeof(length_t));
+}
+
+void VarRecordFile::append(const void* data, size_t len) {
+    vector<char> buf;
+    vector<uint64_t> offsets;
+    addToBatch(buf, offsets, data, len);
+    writeBatch(buf, offsets);
+}
+
+void VarRecordFile::addToBatch(vector<char>& buf, vector<uint64_t>& offsets,
+                               const void* data, size_t len) const
+{
+    contract::parameters({
+        KSS_EXPR(data != nullptr || len == 0),
+        KSS_EXPR(len <= numeric_limits<length_t>::max())
+    });
+
+    const length_t prefix = static_cast<length_t>(len);
+    offsets.push_back(_dataSize + buf.size());
+    const auto pos = buf.size();
+    buf.resize(pos + sizeof(prefix) + len);
+    memcpy(&buf[pos], &prefix, sizeof(prefix));
+    if (len > 0) {
+        memcpy(&buf[pos + sizeof(prefix)], data, len);
+    }
+}
+
+void VarRecordFile::writeBatch(const vector<char>& buf, const vector<uint64_t>& offsets) {
+    contract::preconditions({
+        KSS_EXPR(isOpenFor(BinaryFile::writing))
+    });
+
+    if (!offsets.empty()) {
+        _data.writeAt(off_t(_dataSize), buf.data(), buf.size());
+        _index.append(offsets.data(), offsets.size() * sizeof(uint64_t));
+        _dataSize += buf.size();
+        _count += offsets.size();
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_index.size() == (_count * sizeof(uint64_t)))
+    });
+}
+
+void VarRecordFile::flush() {
+    // The data must reach the disk before the index, otherwise after a system crash
+    // the index could refer to data that was never written.
+    _data.flush();
+    if (fsync(fileno(_data.handle())) == -1) {
+        throw system_error(errno, system_category(), "fsync");
+    }
+    _index.flush();
+}
@@ -10,14 +10,26 @@
 #ifndef kssio_binary_file_hpp
 #define kssio_binary_file_hpp
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #include <kss/contract/all.h>
 
+#include <sys/uio.h>
+
 #include "iterator.hpp"
 #include "utility.hpp"
 
@@ -43,6 +55,18 @@ namespace kss { namespace io { namespace file {
         static constexpr mode_t appending = 0x2;
         static constexpr mode_t updating = 0x1;
 
+        /*!
+         Direct mode may be or'ed with any of the above modes to bypass the system's
+         page cache, which prevents large one-pass reads and writes from evicting more
+         useful data. On Linux the file is opened with O_DIRECT, and all I/O goes through
+         an internal buffer that satisfies its alignment requirements. The final partial
+         block is padded when it is written, and the file truncated to its actual size
+         when it is flushed or closed. On macOS the file is opened normally with
+         F_NOCACHE set. It is only available when opening a file by name, and is not
+         supported by all file systems.
+         */
+        static constexpr mode_t direct = 0x10;
+
         /*!
          Open/close a file. Note that the default constructor will not be a usable object.
          It's only purpose will be as a temporary placeholder until another file is move
@@ -54,6 +78,23 @@ namespace kss { namespace io { namespace file {
          */
         BinaryFile() = default;
         explicit BinaryFile(const std::string& filename, mode_t openMode = reading);
+
+        /*!
+         Open a file with a specific buffer size. The stdio default is usually only a few
+         KB, while large sequential reads and writes benefit from a much larger buffer.
+         In direct mode the size is rounded up to a multiple of the block size, and it
+         is also the size of the internal aligned buffer.
+         If buffer is nullptr, a buffer of bufferSize bytes is allocated and owned by the
+         file. Otherwise buffer must be at least bufferSize bytes and must remain valid
+         until the file is closed.
+
+         @throws std::invalid_argument if filename is empty, openMode is invalid or
+            bufferSize is 0.
+         @throws std::system_error if the underlying C routines return an error code.
+         */
+        BinaryFile(const std::string& filename, mode_t openMode, size_t bufferSize,
+                   void* buffer = nullptr);
+
         explicit BinaryFile(FILE* fp);
         explicit BinaryFile(int filedes);
         BinaryFile(BinaryFile&& f);
@@ -81,6 +122,52 @@ namespace kss { namespace io { namespace file {
         void writeFully(const void* buf, size_t n);
         void flush();
 
+        /*!
+         Read/write the data at a given offset in the file. These use pread/pwrite on the
+         underlying file descriptor, hence they neither use nor change the current
+         position in the file, and they may be called concurrently from multiple threads.
+         Note that they also bypass the FILE* buffer, so any data written using the
+         other methods should be flushed before it is read using readAt, and writeAt
+         should not be used on a file opened for appending (the data would be appended
+         regardless of the offset). In direct mode writeAt may not be called
+         concurrently, as it may need to update the same partial blocks.
+
+         @param offset The position in the file, in bytes.
+         @param buf A buffer to read the data into or write the data from.
+         @param n The number of bytes to read or write.
+         @return the number of bytes actually read, which will be less than n only if
+            the end of the file is reached.
+         @throws std::invalid_argument if offset is negative, buf is nullptr or n is 0.
+         @throws std::system_error if the underlying C routines return an error code.
+         */
+        size_t readAt(off_t offset, void* buf, size_t n) const;
+        void writeAt(off_t offset, const void* buf, size_t n);
+
+        /*!
+         Read/write into or from a number of buffers at once. Like the "fully" versions
+         these will either read or write all the buffers, in order, or will fail with an
+         eof exception. When the total size is small the data is copied through the
+         FILE* buffer as usual, otherwise the stream is flushed and the transfer
+         performed directly as a single preadv/pwritev (or writev when appending).
+
+         @param iov The buffers to read into or write from.
+         @param iovcnt The number of buffers.
+         @throws kss::io::Eof if readv reaches the end of the file before filling all
+            the buffers.
+         @throws std::invalid_argument if iov is nullptr or iovcnt is 0.
+         @throws std::system_error if the underlying C routines return an error code.
+         */
+        void readv(const struct iovec* iov, size_t iovcnt);
+        void writev(const struct iovec* iov, size_t iovcnt);
+
+        /*!
+         Ask the system to start reading the given range of the file into the page
+         cache, so that later reads of it need not wait for the disk. This uses
+         posix_fadvise on Linux and F_RDADVISE on macOS. It is only advice, hence any
+         errors are ignored, and it does nothing in direct mode.
+         */
+        void prefetch(off_t offset, size_t len) const noexcept;
+
         /*!
          Report on and change the position in the file. Note that seek and move are limited
          by the size of a long int. Position and set_position can be used to move anywhere
@@ -94,6 +181,13 @@ namespace kss { namespace io { namespace file {
         void rewind();              ///< Same as seek(0) but may be more efficient.
         void fastForward();         ///< Seeks to the end of the file.
 
+        /*!
+         Returns the size of the file in bytes. Data still in the FILE* buffer is not
+         included, hence the file should be flushed first if it has been written to.
+         @throws std::system_error if the underlying C routines return an error code.
+         */
+        off_t size() const;
+
         /*!
          Returns true if the file is valid and is open for the given mode.
          @throws std::invalid_argument if mode does not match a valid open mode
@@ -107,8 +201,17 @@ namespace kss { namespace io { namespace file {
         FILE* handle() noexcept { return _fp; }
 
     private:
-        FILE*   _fp = nullptr;
-        bool    _autoclose = false;
+        FILE*                   _fp = nullptr;
+        bool                    _autoclose = false;
+        std::unique_ptr<char[]> _buffer;
+
+        // Set in direct mode on Linux. It is owned by the stream and freed when it is
+        // closed.
+        struct Direct;
+        Direct*                 _direct = nullptr;
+
+        int openFlags() const;
+        void open(const std::string& filename, mode_t openMode, size_t bufferSize, void* buffer);
     };
 
 
@@ -176,6 +279,7 @@ namespace kss { namespace io { namespace file {
          */
         using input_iterator = kss::io::stream::InputIterator<FileOf<Record>, Record>;
         using output_iterator = kss::io::stream::OutputIterator<FileOf<Record>, Record>;
+        class prefetching_iterator;
 
         /*!
          Open/close a file. Note that the default constructor will not be a usable object.
@@ -197,6 +301,15 @@ namespace kss { namespace io { namespace file {
             });
         }
 
+        FileOf(const std::string& filename, mode_t openMode, size_t bufferSize,
+               void* buffer = nullptr)
+        : BinaryFile(filename, openMode, bufferSize, buffer)
+        {
+            kss::contract::postconditions({
+                KSS_EXPR(isOpenFor(BinaryFile::appending) || (position() == 0))
+            });
+        }
+
         explicit FileOf(FILE* fp) : BinaryFile(fp) {
             kss::contract::postconditions({
                 KSS_EXPR(isOpenFor(BinaryFile::appending) || (position() == 0))
@@ -249,6 +362,120 @@ namespace kss { namespace io { namespace file {
             return read();
         }
 
+        /*!
+         Read/write many records at the current position. These move the records in a
+         single read or write of the underlying file, and perform their checks once for
+         the entire batch rather than once per record. The range version of write
+         accepts any input iterators over records; if they are not pointers the records
+         are copied in chunks before being written.
+
+         @return the number of records read, which will be less than n only if the
+            end of the file is reached. A trailing partial record is not read.
+         @throws std::invalid_argument if out or recs is nullptr and n is not 0.
+         @throws std::system_error if the underlying C routines return an error code
+         */
+        size_t readN(Record* out, size_t n) {
+            kss::contract::parameters({
+                KSS_EXPR(out != nullptr || n == 0)
+            });
+            kss::contract::preconditions({
+                KSS_EXPR(isOpenFor(reading))
+            });
+
+            if (n == 0) {
+                return 0;
+            }
+
+            const auto pos = position();
+            uint8_t* buf = reinterpret_cast<uint8_t*>(out);
+            const size_t nbytes = n * sizeof(Record);
+            size_t total = 0;
+            while (total < nbytes && !BinaryFile::eof()) {
+                total += BinaryFile::read(buf + total, nbytes - total);
+            }
+            if (const auto partial = total % sizeof(Record)) {
+                BinaryFile::move(-off_t(partial));
+            }
+
+            const auto count = total / sizeof(Record);
+            kss::contract::postconditions({
+                KSS_EXPR(position() == (pos + count))
+            });
+            return count;
+        }
+
+        void writeN(const Record* recs, size_t n) {
+            kss::contract::parameters({
+                KSS_EXPR(recs != nullptr || n == 0)
+            });
+            kss::contract::preconditions({
+                KSS_EXPR(isOpenFor(writing))
+            });
+
+            if (n > 0) {
+                const auto pos = position();
+                BinaryFile::writeFully(recs, n * sizeof(Record));
+
+                kss::contract::postconditions({
+                    KSS_EXPR(isOpenFor(appending) || (position() == (pos + n)))
+                });
+            }
+        }
+
+        template <class InputIt>
+        void write(InputIt first, InputIt last) {
+            writeRange(first, last, std::is_pointer<InputIt>());
+        }
+
+        /*!
+         Read/write a specific record without using or changing the position in the
+         file. These are built on BinaryFile::readAt and BinaryFile::writeAt, and have
+         the same restrictions, but may be called concurrently from multiple threads.
+
+         @throws kss::io::Eof if recNo is not in the file (readAt only).
+         @throws std::system_error if the underlying C routines return an error code
+         */
+        Record readAt(size_t recNo) const {
+            Record r;
+            if (BinaryFile::readAt(off_t(recNo * sizeof(Record)), &r, sizeof(Record)) != sizeof(Record)) {
+                throw kss::io::Eof();
+            }
+            return r;
+        }
+
+        void writeAt(const Record& r, size_t recNo) {
+            BinaryFile::writeAt(off_t(recNo * sizeof(Record)), &r, sizeof(Record));
+        }
+
+        /*!
+         Read many records starting at a specific record. This is the bulk version of
+         readAt, and may also be called concurrently from multiple threads.
+         @return the number of records read, which will be less than n only if the
+            end of the file is reached.
+         @throws std::invalid_argument if out is nullptr and n is not 0.
+         @throws std::system_error if the underlying C routines return an error code
+         */
+        size_t readNAt(size_t recNo, Record* out, size_t n) const {
+            kss::contract::parameters({
+                KSS_EXPR(out != nullptr || n == 0)
+            });
+
+            if (n == 0) {
+                return 0;
+            }
+            return BinaryFile::readAt(off_t(recNo * sizeof(Record)), out, n * sizeof(Record))
+                / sizeof(Record);
+        }
+
+        /*!
+         Returns the number of complete records in the file. Like BinaryFile::size this
+         does not include records still in the FILE* buffer.
+         @throws std::system_error if the underlying C routines return an error code
+         */
+        size_t size() const {
+            return size_t(BinaryFile::size()) / sizeof(Record);
+        }
+
         inline FileOf& operator>>(Record& r) {
             r = std::move(read());
             return *this;
@@ -315,6 +542,40 @@ namespace kss { namespace io { namespace file {
         input_iterator ibegin() { return begin(); }
         input_iterator iend()   { return end(); }
 
+        /*!
+         Prefetching iterator access for reading. These have the same restrictions as
+         begin() and end(), but instead of reading one record at a time they read the
+         records in batches using readN, and keep the system reading ahead of the
+         current position by prefetchBytes using BinaryFile::prefetch. Hence the disk
+         I/O overlaps any work being done on the current batch, and a sequential scan
+         can approach the bandwidth of the disk.
+         @throws std::invalid_argument if prefetchBytes is 0.
+         @throws std::system_error if the underlying C routines return an error code
+         */
+        static constexpr size_t defaultPrefetchBytes = 8 * 1024 * 1024;
+
+        prefetching_iterator pbegin(size_t prefetchBytes = defaultPrefetchBytes) {
+            kss::contract::parameters({
+                KSS_EXPR(prefetchBytes > 0)
+            });
+            kss::contract::preconditions({
+                KSS_EXPR(isOpenFor(BinaryFile::reading))
+            });
+
+            rewind();
+            return prefetching_iterator(*this, prefetchBytes);
+        }
+
+        prefetching_iterator pend() { return prefetching_iterator(); }
+
+        /*!
+         Prefetch a range of records. This is the record based version of
+         BinaryFile::prefetch.
+         */
+        void prefetch(size_t recNo, size_t numRecords) const noexcept {
+            BinaryFile::prefetch(off_t(recNo * sizeof(Record)), numRecords * sizeof(Record));
+        }
+
         /*!
          Iterator access for writing. This requires that the file be opened for writing
          or appending. You should not mix the iterator calls with other reading/writing
@@ -354,8 +615,622 @@ namespace kss { namespace io { namespace file {
         void rewind() noexcept      { BinaryFile::rewind(); }
         void fastForward()          { BinaryFile::fastForward(); }
         bool eof() const noexcept   { return BinaryFile::eof(); }
+
+    private:
+        // Pointers can be written directly, other iterators are copied in chunks.
+        template <class InputIt>
+        void writeRange(InputIt first, InputIt last, std::true_type) {
+            writeN(first, static_cast<size_t>(last - first));
+        }
+
+        template <class InputIt>
+        void writeRange(InputIt first, InputIt last, std::false_type) {
+            static constexpr size_t chunkSize = (64 * 1024) / sizeof(Record) + 1;
+            std::vector<Record> chunk;
+            chunk.reserve(chunkSize);
+            for (; first != last; ++first) {
+                chunk.push_back(*first);
+                if (chunk.size() == chunkSize) {
+                    writeN(chunk.data(), chunk.size());
+                    chunk.clear();
+                }
+            }
+            if (!chunk.empty()) {
+                writeN(chunk.data(), chunk.size());
+            }
+        }
     };
 
+    template <class Record>
+    constexpr size_t FileOf<Record>::defaultPrefetchBytes;
+
+
+    /*!
+     The input iterator returned by FileOf::pbegin(). Copies of an iterator share the
+     same batch of records, hence like all input iterators only one of them may be
+     advanced, and advancing it also advances the others.
+     */
+    template <class Record>
+    class FileOf<Record>::prefetching_iterator
+    : public std::iterator<std::input_iterator_tag, Record, ptrdiff_t, const Record*, const Record&>
+    {
+    public:
+        prefetching_iterator() = default;
+
+        bool operator==(const prefetching_iterator& it) const noexcept {
+            return _state == it._state;
+        }
+        bool operator!=(const prefetching_iterator& it) const noexcept {
+            return !operator==(it);
+        }
+
+        /*!
+         Dereference the iterator. This is undefined if we try to dereference the end()
+         value.
+         */
+        const Record& operator*() const { return _state->batch[_state->index]; }
+        const Record* operator->() const { return &_state->batch[_state->index]; }
+
+        /*!
+         Increment the iterator, reading the next batch of records when the current
+         one has been used.
+         @throws kss::io::InvalidState if this is already the end iterator.
+         @throws std::system_error if the underlying C routines return an error code
+         */
+        prefetching_iterator& operator++() {
+            if (!_state) {
+                throw kss::io::InvalidState("This iterator is already at the end state.");
+            }
+            if (++_state->index >= _state->count) {
+                nextBatch();
+            }
+            return *this;
+        }
+        /*!
+         Since copies share the same batch, the postfix increment returns a copy of
+         the record rather than of the iterator. This is sufficient for the usual
+         *it++ expression.
+         */
+        class postfix_value {
+        public:
+            const Record& operator*() const noexcept { return _value; }
+            const Record* operator->() const noexcept { return &_value; }
+        private:
+            friend class prefetching_iterator;
+            explicit postfix_value(const Record& r) : _value(r) {}
+            Record _value;
+        };
+
+        postfix_value operator++(int) {
+            postfix_value v(operator*());
+            operator++();
+            return v;
+        }
+
+    private:
+        friend class FileOf<Record>;
+
+        // Each batch is about this many bytes, which is large enough that the cost of
+        // the readN call is negligible.
+        static constexpr size_t batchBytes = 64 * 1024;
+
+        struct State {
+            FileOf<Record>*     file = nullptr;
+            std::vector<Record> batch;
+            size_t              index = 0;
+            size_t              count = 0;
+            size_t              prefetchBytes = 0;
+            off_t               prefetchedTo = 0;
+        };
+        std::shared_ptr<State> _state;
+
+        prefetching_iterator(FileOf<Record>& file, size_t prefetchBytes)
+        : _state(std::make_shared<State>())
+        {
+            _state->file = &file;
+            _state->batch.resize(std::max<size_t>(1, batchBytes / sizeof(Record)));
+            _state->prefetchBytes = prefetchBytes;
+            nextBatch();
+        }
+
+        // Read the next batch, first asking for more to be read ahead once we are
+        // halfway through what was previously requested.
+        void nextBatch() {
+            auto& st = *_state;
+            const auto pos = off_t(st.file->position() * sizeof(Record));
+            if (pos + off_t(st.prefetchBytes / 2) >= st.prefetchedTo) {
+                const auto from = std::max(pos, st.prefetchedTo);
+                const auto to = pos + off_t(st.prefetchBytes);
+                st.file->BinaryFile::prefetch(from, size_t(to - from));
+                st.prefetchedTo = to;
+            }
+
+            st.index = 0;
+            st.count = st.file->readN(st.batch.data(), st.batch.size());
+            if (st.count == 0) {
+                _state.reset();
+            }
+        }
+    };
+
+    template <class Record>
+    constexpr size_t FileOf<Record>::prefetching_iterator::batchBytes;
+
+    /*!
+     Memory mapped file class. Instead of copying the data through the stdio buffers,
+     as BinaryFile does, this maps the entire file into memory and exposes it as a
+     span of bytes. This is much faster for scanning large files, but note that an
+     I/O error while accessing the memory will result in a SIGBUS rather than an
+     exception.
+
+     The open modes are the same as for BinaryFile, except that the file is always
+     opened for reading. Specifically, reading maps an existing file read-only,
+     reading|updating maps an existing file read-write, writing creates or truncates
+     the file, and appending creates the file if necessary but keeps its contents.
+
+     A writable file will grow as needed when written past its end. To reduce the
+     number of times the mapping must be extended, it grows in larger steps than
+     required, hence the file on disk may be larger than size() until it is flushed
+     or destroyed. Any growth may move the mapping, invalidating any pointers
+     previously obtained from data() or writableData().
+     */
+    class MappedFile {
+    public:
+        using mode_t = BinaryFile::mode_t;
+
+        /*!
+         Hints about how the memory will be accessed, passed to madvise().
+         */
+        enum class Advice {
+            normal,         ///< No special treatment.
+            sequential,     ///< Read ahead aggressively, pages may be freed soon after use.
+            random,         ///< Read ahead as little as possible.
+            willNeed        ///< Start reading the pages in now.
+        };
+
+        /*!
+         Open/close a file. Note that the default constructor will not be a usable object.
+         It's only purpose will be as a temporary placeholder until another file is move
+         assigned into it.
+
+         @throws std::invalid_argument if filename is empty or openMode is invalid.
+         @throws std::system_error if the underlying C routines return an error code.
+         */
+        MappedFile() = default;
+        explicit MappedFile(const std::string& filename, mode_t openMode = BinaryFile::reading);
+        MappedFile(MappedFile&& f) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        ~MappedFile() noexcept;
+
+        MappedFile& operator=(MappedFile&& f) noexcept;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /*!
+         Access the bytes of the file. The writable version requires that the file be
+         open for writing.
+         */
+        const uint8_t* data() const noexcept    { return _data; }
+        const uint8_t* begin() const noexcept   { return _data; }
+        const uint8_t* end() const noexcept     { return _data + _size; }
+        uint8_t* writableData() {
+            kss::contract::preconditions({
+                KSS_EXPR(isOpenFor(BinaryFile::writing))
+            });
+            return _data;
+        }
+
+        size_t size() const noexcept        { return _size; }
+        size_t capacity() const noexcept    { return _capacity; }
+        bool empty() const noexcept         { return _size == 0; }
+
+        /*!
+         Write n bytes at the given offset, or at the end of the file, growing the file
+         if necessary. Writing past the end of the file fills the gap with zeros.
+
+         @throws std::invalid_argument if buf is nullptr or n is 0.
+         @throws std::system_error if the file could not be extended.
+         */
+        void write(const void* buf, size_t n, size_t offset);
+        void append(const void* buf, size_t n) { write(buf, n, _size); }
+
+        /*!
+         Change the size of the file. Growing the file fills the new space with zeros.
+         Reserving space extends the file and mapping without changing size(), so that
+         later writes within that space need not extend them.
+
+         @throws std::system_error if the file could not be extended.
+         */
+        void resize(size_t newSize);
+        void reserve(size_t newCapacity);
+
+        /*!
+         Truncate the file to size(), releasing any reserved space, and write any
+         modified pages to the disk.
+         @throws std::system_error if the underlying C routines return an error code.
+         */
+        void flush();
+
+        /*!
+         Advise the system on how the given range of bytes, or the entire file, will be
+         accessed.
+         @throws std::invalid_argument if the range is not within the file.
+         @throws std::system_error if madvise() fails.
+         */
+        void advise(Advice advice, size_t offset, size_t len);
+        void advise(Advice advice) { advise(advice, 0, _size); }
+
+        /*!
+         Returns true if the file is open for the given mode. Since mapped files are
+         always opened for reading, this is true for any mode other than reading only
+         if the file was opened for writing or updating.
+         */
+        bool isOpenFor(mode_t mode) const noexcept;
+
+    private:
+        int         _filedes = -1;
+        bool        _writable = false;
+        uint8_t*    _data = nullptr;
+        size_t      _size = 0;
+        size_t      _capacity = 0;
+
+        void remap(size_t newCapacity);
+        void close() noexcept;
+    };
+
+    /*!
+     Read only, memory mapped view of a file of records, such as one written by
+     FileOf<Record>. The records are accessed directly in the mapping, hence a lookup
+     costs no more than indexing an array, and the iterators are simply pointers to
+     the records.
+
+     The same restrictions on the Record type apply as for FileOf. The view reflects
+     the size of the file when it was opened; records appended afterwards are not seen.
+     */
+    template <class Record>
+    class MappedFileOf : private MappedFile {
+    public:
+        using value_type = Record;
+        using const_iterator = const Record*;
+        using iterator = const_iterator;
+        using Advice = MappedFile::Advice;
+
+        /*!
+         Open/close a file. Note that the default constructor will not be a usable object.
+         It's only purpose will be as a temporary placeholder until another file is move
+         assigned into it.
+         @throws std::invalid_argument if filename is empty or if the file does not
+            appear to contain the correct type, as determined by its size.
+         @throws std::system_error if the underlying C routines return an error code
+         */
+        MappedFileOf() = default;
+
+        explicit MappedFileOf(const std::string& filename) : MappedFile(filename) {
+            kss::contract::parameters({
+                KSS_EXPR((MappedFile::size() % sizeof(Record)) == 0)
+            });
+        }
+
+        MappedFileOf(MappedFileOf&&) noexcept = default;
+        MappedFileOf(const MappedFileOf&) = delete;
+
+        MappedFileOf& operator=(MappedFileOf&&) noexcept = default;
+        MappedFileOf& operator=(const MappedFileOf&) = delete;
+
+        ~MappedFileOf() noexcept = default;
+
+        /*!
+         Access the records. operator[] is unchecked, while at() checks that recNo is
+         within the file.
+         @throws std::out_of_range if recNo is not in the file (at() only).
+         */
+        const Record& operator[](size_t recNo) const noexcept {
+            return data()[recNo];
+        }
+
+        const Record& at(size_t recNo) const {
+            if (recNo >= size()) {
+                throw std::out_of_range("recNo is past the end of the file");
+            }
+            return data()[recNo];
+        }
+
+        const Record* data() const noexcept {
+            return reinterpret_cast<const Record*>(MappedFile::data());
+        }
+
+        size_t size() const noexcept    { return MappedFile::size() / sizeof(Record); }
+        bool empty() const noexcept     { return size() == 0; }
+
+        const_iterator begin() const noexcept   { return data(); }
+        const_iterator end() const noexcept     { return data() + size(); }
+        const_iterator cbegin() const noexcept  { return begin(); }
+        const_iterator cend() const noexcept    { return end(); }
+
+        /*!
+         Advise the system on how the records will be accessed.
+         @throws std::invalid_argument if the range is not within the file.
+         @throws std::system_error if madvise() fails.
+         */
+        void advise(Advice advice) {
+            MappedFile::advise(advice);
+        }
+
+        void advise(Advice advice, size_t firstRecNo, size_t numRecords) {
+            kss::contract::parameters({
+                KSS_EXPR(firstRecNo <= size()),
+                KSS_EXPR(numRecords <= (size() - firstRecNo))
+            });
+            MappedFile::advise(advice, firstRecNo * sizeof(Record), numRecords * sizeof(Record));
+        }
+    };
+
+    /*!
+     File of variable length records. Each record is appended to the data file as a
+     32 bit length followed by its bytes, while the offset of each record is kept in a
+     sidecar index file (the data file name with ".idx" appended) that is memory mapped.
+     Hence any record may be read in constant time using a single positional read, and
+     many records may be appended with a single write.
+
+     The open modes are the same as for BinaryFile. Reading opens an existing file and
+     index read only, writing creates or truncates both, while reading|updating and
+     appending open them for reading and appending, creating them if necessary. When
+     opened, index entries that cannot be valid, such as the unused space reserved at
+     the end of an index that was not closed, are ignored. When opened for writing, an
+     index that is missing or out of date, for example due to a crash between writing
+     the data and the index, is then rebuilt from the data file, and any partial record
+     at the end of the data is removed. When opened for reading, only the records in
+     the index are visible.
+
+     Records may be read concurrently from multiple threads, but not while records
+     are being appended, as that may move the index mapping.
+     */
+    class VarRecordFile {
+    public:
+        using mode_t = BinaryFile::mode_t;
+
+        /*!
+         Open/close a file. Note that the default constructor will not be a usable object.
+         It's only purpose will be as a temporary placeholder until another file is move
+         assigned into it.
+         @throws std::invalid_argument if filename is empty or openMode is invalid.
+         @throws std::system_error if the underlying C routines return an error code,
+            including if the index does not exist when opening for reading.
+         */
+        VarRecordFile() = default;
+        explicit VarRecordFile(const std::string& filename, mode_t openMode = BinaryFile::reading);
+        VarRecordFile(VarRecordFile&&) = default;
+        VarRecordFile(const VarRecordFile&) = delete;
+        ~VarRecordFile() noexcept = default;
+
+        VarRecordFile& operator=(VarRecordFile&&) = default;
+        VarRecordFile& operator=(const VarRecordFile&) = delete;
+
+        /*!
+         Returns the name of the index file used for the given data file.
+         */
+        static std::string indexFilename(const std::string& filename) {
+            return filename + ".idx";
+        }
+
+        /*!
+         Returns the number of records.
+         */
+        size_t size() const noexcept   { return _count; }
+        bool empty() const noexcept     { return _count == 0; }
+
+        /*!
+         Read a record, or return its size without reading it.
+         @throws std::invalid_argument if recNo is not in the file.
+         @throws kss::io::Eof if the data file has been truncated.
+         @throws std::system_error if the underlying C routines return an error code.
+         */
+        std::string read(size_t recNo) const;
+        size_t recordSize(size_t recNo) const;
+
+        /*!
+         Append one or more records. The range version accepts input iterators over
+         any type with data() and size() methods, such as std::string, and writes the
+         records in batches of about 1MB, each with a single write. The data is always
+         written before the index, hence if the process crashes the index never refers
+         to missing data. Only the records written before the last flush() are sure to
+         survive a crash of the system.
+         @throws std::invalid_argument if data is nullptr and len is not 0, or if a
+            record is 4GB or longer.
+         @throws std::system_error if the underlying C routines return an error code.
+         */
+        void append(const void* data, size_t len);
+        void append(const std::string& rec) { append(rec.data(), rec.size()); }
+
+        template <class InputIt>
+        void append(InputIt first, InputIt last) {
+            std::vector<char> buf;
+            std::vector<uint64_t> offsets;
+            for (; first != last; ++first) {
+                const auto& rec = *first;
+                addToBatch(buf, offsets, rec.data(), rec.size());
+                if (buf.size() >= batchBytes) {
+                    writeBatch(buf, offsets);
+                    buf.clear();
+                    offsets.clear();
+                }
+            }
+            writeBatch(buf, offsets);
+        }
+
+        /*!
+         Flush the data file and wait for it to reach the disk, then do the same for
+         the index, releasing any space reserved for it. The records appended so far
+         will then survive a crash of the system.
+         @throws std::system_error if the underlying C routines return an error code.
+         */
+        void flush();
+
+        /*!
+         Returns true if the file is open for the given mode.
+         */
+        bool isOpenFor(mode_t mode) const { return _index.isOpenFor(mode); }
+
+    private:
+        static constexpr size_t batchBytes = 1024 * 1024;
+
+        BinaryFile  _data;
+        MappedFile  _index;
+        size_t      _count = 0;
+        uint64_t    _dataSize = 0;
+
+        void recover();
+        void addToBatch(std::vector<char>& buf, std::vector<uint64_t>& offsets,
+                        const void* data, size_t len) const;
+        void writeBatch(const std::vector<char>& buf, const std::vector<uint64_t>& offsets);
+    };
+
+    namespace _private {
+        // Call chunkFn(first, last) for consecutive chunks of [0, numRecords) using
+        // nThreads threads. The chunks are handed out as the threads become free, so
+        // that uneven work is spread evenly. If chunkFn throws, no further chunks are
+        // started, and the first exception is rethrown once all the threads have
+        // finished.
+        template <class ChunkFn>
+        void parallelChunks(size_t numRecords, size_t nThreads, size_t minChunk, ChunkFn chunkFn) {
+            if (nThreads == 0) {
+                nThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+            }
+            const size_t chunkSize = std::max(minChunk, numRecords / (nThreads * 8));
+            nThreads = std::min(nThreads, (numRecords + chunkSize - 1) / chunkSize);
+
+            std::atomic<size_t> next { 0 };
+            std::mutex m;
+            std::exception_ptr err;
+            const auto worker = [&] {
+                try {
+                    size_t first;
+                    while ((first = next.fetch_add(chunkSize)) < numRecords) {
+                        chunkFn(first, std::min(first + chunkSize, numRecords));
+                    }
+                }
+                catch (...) {
+                    // Stop the other threads from taking any more chunks.
+                    next = numRecords;
+                    std::lock_guard<std::mutex> l(m);
+                    if (!err) {
+                        err = std::current_exception();
+                    }
+                }
+            };
+
+            std::vector<std::future<void>> futures;
+            for (size_t i = 1; i < nThreads; ++i) {
+                futures.push_back(std::async(std::launch::async, worker));
+            }
+            worker();
+            for (auto& f : futures) {
+                f.get();
+            }
+            if (err) {
+                std::rethrow_exception(err);
+            }
+        }
+
+        // Read the records of a chunk of a file in batches, calling fn for each one.
+        template <class Record, class Fn>
+        void forEachInChunk(const FileOf<Record>& f, size_t first, size_t last,
+                            std::vector<Record>& batch, Fn& fn)
+        {
+            while (first < last) {
+                const auto n = f.readNAt(first, batch.data(), std::min(batch.size(), last - first));
+                if (n == 0) {
+                    throw kss::io::Eof();
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    fn(batch[i]);
+                }
+                first += n;
+            }
+        }
+
+        constexpr size_t parallelBatchBytes = 64 * 1024;
+    }
+
+    /*!
+     Call fn(const Record&) for each record in a file, using nThreads threads (or one
+     per core if nThreads is 0). The records are split into chunks which are read by
+     each thread using FileOf::readNAt, or are accessed directly in the mapping for a
+     MappedFileOf, hence the file position is not used or changed. Note that fn will
+     be called concurrently, and the records are not processed in any particular order.
+
+     For a FileOf, the file should have been flushed if it has been written to, and
+     records added while this is running are not seen.
+
+     @throws kss::io::Eof if the file is truncated while it is being read.
+     @throws std::system_error if the underlying C routines return an error code
+     @throws any exception that fn throws, once all the threads have stopped.
+     */
+    template <class Record, class Fn>
+    void parallelForEach(const FileOf<Record>& f, size_t nThreads, Fn fn) {
+        const auto batchSize = std::max<size_t>(1, _private::parallelBatchBytes / sizeof(Record));
+        _private::parallelChunks(f.size(), nThreads, batchSize, [&](size_t first, size_t last) {
+            std::vector<Record> batch(std::min(batchSize, last - first));
+            _private::forEachInChunk(f, first, last, batch, fn);
+        });
+    }
+
+    template <class Record, class Fn>
+    void parallelForEach(const MappedFileOf<Record>& f, size_t nThreads, Fn fn) {
+        const auto batchSize = std::max<size_t>(1, _private::parallelBatchBytes / sizeof(Record));
+        _private::parallelChunks(f.size(), nThreads, batchSize, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                fn(f[i]);
+            }
+        });
+    }
+
+    /*!
+     Reduce the records of a file to a single value, using nThreads threads (or one
+     per core if nThreads is 0). Each chunk of records is accumulated, starting with
+     init, using accumulate(T, const Record&), and the results of the chunks are then
+     combined using combine(T, T). Since the chunks may be accumulated and combined in
+     any order, init must be an identity value for combine, and combine must be both
+     associative and commutative. Otherwise this has the same behaviour as
+     parallelForEach.
+     */
+    template <class Record, class T, class AccumulateFn, class CombineFn>
+    T parallelReduce(const FileOf<Record>& f, size_t nThreads, T init,
+                     AccumulateFn accumulate, CombineFn combine)
+    {
+        const auto batchSize = std::max<size_t>(1, _private::parallelBatchBytes / sizeof(Record));
+        std::mutex lock;
+        T result = init;
+        _private::parallelChunks(f.size(), nThreads, batchSize, [&](size_t first, size_t last) {
+            std::vector<Record> batch(std::min(batchSize, last - first));
+            T value = init;
+            auto fn = [&](const Record& r) { value = accumulate(std::move(value), r); };
+            _private::forEachInChunk(f, first, last, batch, fn);
+
+            std::lock_guard<std::mutex> l(lock);
+            result = combine(std::move(result), std::move(value));
+        });
+        return result;
+    }
+
+    template <class Record, class T, class AccumulateFn, class CombineFn>
+    T parallelReduce(const MappedFileOf<Record>& f, size_t nThreads, T init,
+                     AccumulateFn accumulate, CombineFn combine)
+    {
+        const auto batchSize = std::max<size_t>(1, _private::parallelBatchBytes / sizeof(Record));
+        std::mutex lock;
+        T result = init;
+        _private::parallelChunks(f.size(), nThreads, batchSize, [&](size_t first, size_t last) {
+            T value = init;
+            for (size_t i = first; i < last; ++i) {
+                value = accumulate(std::move(value), f[i]);
+            }
+
+            std::lock_guard<std::mutex> l(lock);
+            result = combine(std::move(result), std::move(value));
+        });
+        return result;
+    }
+
 } } }
 
 #endif
@@ -0,0 +1,849 @@
+//
+//  completion_poller.cpp
+//  kssio
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#if defined(__linux)
+#   include <sys/syscall.h>
+#   if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#       define KSSIO_HAVE_IO_URING 1
+#       include <linux/io_uring.h>
+#       include <sys/eventfd.h>
+#       include <sys/mman.h>
+#   endif
+#endif
+
+#include <kss/contract/all.h>
+#include <kss/util/all.h>
+
+#include "completion_poller.hpp"
+#include "poller.hpp"
+
+using namespace std;
+using namespace kss::io;
+
+namespace contract = kss::contract;
+
+using std::chrono::milliseconds;
+using kss::util::Finally;
+
+namespace {
+
+    // Convert our interval into the timeout integer used by poll.
+    int timeoutFromInterval(milliseconds ms) noexcept {
+        if (ms == milliseconds::zero()) {
+            return 0;
+        }
+        else if (ms == milliseconds::max()) {
+            return -1;
+        }
+        const auto count = ms.count();
+        if (count > numeric_limits<int>::max()) {
+            return numeric_limits<int>::max();
+        }
+        return static_cast<int>(count);
+    }
+
+    // Handles combine the slot index with its generation, so that a stale handle never
+    // refers to a newer operation. The generation is never 0, hence neither is a handle.
+    inline CompletionPoller::handle_t makeHandle(uint32_t index, uint32_t generation) noexcept {
+        return (static_cast<CompletionPoller::handle_t>(generation) << 32) | index;
+    }
+
+    inline uint32_t indexFromHandle(CompletionPoller::handle_t handle) noexcept {
+        return static_cast<uint32_t>(handle & 0xFFFFFFFFU);
+    }
+
+    inline uint32_t generationFromHandle(CompletionPoller::handle_t handle) noexcept {
+        return static_cast<uint32_t>(handle >> 32);
+    }
+
+    // A slot in the table of outstanding operations.
+    struct OperationSlot {
+        CompletionOperation op;
+        uint32_t            generation { 1 };
+        bool                inUse { false };
+        Poller::handle_t    resource { Poller::invalidHandle };   // Used by the emulated engine.
+    };
+
+    // Perform an operation directly, returning the result of the system call.
+    ssize_t performOperation(const CompletionOperation& op) noexcept {
+        switch (op.type) {
+            case CompletionOperation::Type::read:
+                return ::read(op.filedes, op.buffer, op.length);
+            case CompletionOperation::Type::write:
+                return ::write(op.filedes, op.buffer, op.length);
+            case CompletionOperation::Type::accept:
+            {
+#if defined(__linux)
+                return accept4(op.filedes, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+                const int fd = accept(op.filedes, nullptr, nullptr);
+                if (fd != -1) {
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    fcntl(fd, F_SETFD, FD_CLOEXEC);
+                }
+                return fd;
+#endif
+            }
+        }
+        // should never get here
+        assert(false);
+        errno = EINVAL;
+        return -1;
+    }
+
+#if defined(KSSIO_HAVE_IO_URING)
+    // Minimal wrapper around an io_uring instance. The submission and completion rings
+    // are shared with the kernel, so the indices that the kernel updates must be read
+    // with acquire semantics, and those that we update must be written with release
+    // semantics.
+    class Ring {
+    public:
+        static constexpr uint64_t wakeupTag = numeric_limits<uint64_t>::max();
+        static constexpr uint64_t timeoutTag = numeric_limits<uint64_t>::max() - 1;
+        static constexpr uint64_t cancelTag = numeric_limits<uint64_t>::max() - 2;
+
+        explicit Ring(unsigned entries) {
+            io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (fd == -1) {
+                throw system_error(errno, system_category(), "io_uring_setup");
+            }
+
+            try {
+                mapRings(params);
+                checkOperations();
+            }
+            catch (...) {
+                unmapRings();
+                ::close(fd);
+                throw;
+            }
+        }
+
+        ~Ring() noexcept {
+            unmapRings();
+            ::close(fd);
+        }
+
+        Ring(const Ring&) = delete;
+        Ring& operator=(const Ring&) = delete;
+
+        // Returns the next free submission entry, cleared, or nullptr if the ring is
+        // full. The entry is not made visible to the kernel until the next call to
+        // enter(), by which time the caller will have filled it in.
+        io_uring_sqe* nextSubmission() noexcept {
+            const auto head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            if (pendingTail - head >= sqEntries) {
+                return nullptr;
+            }
+
+            const auto index = pendingTail & *sqMask;
+            auto sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqArray[index] = index;
+            ++pendingTail;
+            return sqe;
+        }
+
+        // Pass any new submissions to the kernel and, if minComplete is non-zero, wait
+        // until at least that many operations have completed. Returns -1 and sets
+        // errno on failure.
+        int enter(unsigned minComplete) noexcept {
+            __atomic_store_n(sqTail, pendingTail, __ATOMIC_RELEASE);
+            const auto toSubmit = pendingTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            if (toSubmit == 0 && minComplete == 0) {
+                return 0;
+            }
+            const unsigned flags = (minComplete > 0 ? IORING_ENTER_GETEVENTS : 0);
+            return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                                            flags, nullptr, 0));
+        }
+
+        // Copy the available completions into cqes, freeing their entries.
+        void reap(vector<io_uring_cqe>& completions) {
+            auto head = *cqHead;
+            const auto tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            while (head != tail) {
+                completions.push_back(cqes[head & *cqMask]);
+                ++head;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+
+    private:
+        int             fd { -1 };
+        void*           sqRing { MAP_FAILED };
+        size_t          sqRingSize { 0 };
+        void*           cqRing { MAP_FAILED };
+        size_t          cqRingSize { 0 };
+        io_uring_sqe*   sqes { nullptr };
+        size_t          sqesSize { 0 };
+        unsigned        sqEntries { 0 };
+        unsigned*       sqHead { nullptr };
+        unsigned*       sqTail { nullptr };
+        unsigned*       sqMask { nullptr };
+        unsigned*       sqArray { nullptr };
+        unsigned        pendingTail { 0 };
+        unsigned*       cqHead { nullptr };
+        unsigned*       cqTail { nullptr };
+        unsigned*       cqMask { nullptr };
+        io_uring_cqe*   cqes { nullptr };
+
+        void* mapRegion(size_t size, off_t offset) {
+            auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            fd, offset);
+            if (ptr == MAP_FAILED) {
+                throw system_error(errno, system_category(), "mmap");
+            }
+            return ptr;
+        }
+
+        void mapRings(const io_uring_params& params) {
+            sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+            }
+
+            sqRing = mapRegion(sqRingSize, IORING_OFF_SQ_RING);
+            cqRing = ((params.features & IORING_FEAT_SINGLE_MMAP)
+                      ? sqRing
+                      : mapRegion(cqRingSize, IORING_OFF_CQ_RING));
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(mapRegion(sqesSize, IORING_OFF_SQES));
+
+            auto sq = static_cast<char*>(sqRing);
+            sqEntries = params.sq_entries;
+            sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            pendingTail = *sqTail;
+
+            auto cq = static_cast<char*>(cqRing);
+            cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        }
+
+        void unmapRings() noexcept {
+            if (sqes) {
+                munmap(sqes, sqesSize);
+            }
+            if (cqRing != MAP_FAILED && cqRing != sqRing) {
+                munmap(cqRing, cqRingSize);
+            }
+            if (sqRing != MAP_FAILED) {
+                munmap(sqRing, sqRingSize);
+            }
+        }
+
+        // Older kernels support io_uring but not all the operations we need, in which
+        // case we treat io_uring as not being available.
+        void checkOperations() {
+            vector<char> buffer(sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op), 0);
+            auto probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+            if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == -1) {
+                throw system_error(errno, system_category(), "io_uring_register");
+            }
+
+            for (const auto op : { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_ACCEPT, IORING_OP_TIMEOUT,
+                                   IORING_OP_TIMEOUT_REMOVE, IORING_OP_ASYNC_CANCEL })
+            {
+                if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                    throw system_error(ENOSYS, system_category(), "io_uring operation not supported");
+                }
+            }
+        }
+    };
+
+    constexpr uint64_t Ring::wakeupTag;
+    constexpr uint64_t Ring::timeoutTag;
+    constexpr uint64_t Ring::cancelTag;
+#endif
+}
+
+
+struct CompletionPoller::Impl {
+    CompletionPoller*           parent = nullptr;
+    CompletionPollerDelegate*   delegate = nullptr;
+    Engine                      engine = Engine::automatic;
+    atomic<thread::id>          runThread;
+
+    // The outstanding operations. These must be protected by a mutex since operations
+    // may be submitted from any thread.
+    mutable mutex               lock;
+    vector<OperationSlot>       slots;
+    vector<uint32_t>            freeSlots;
+    size_t                      numOutstanding { 0 };
+
+    // Allocate a slot for an operation, returning its index. Must be called with the
+    // lock held.
+    uint32_t allocateSlot(const CompletionOperation& op) {
+        if (freeSlots.empty()) {
+            if (slots.size() >= numeric_limits<uint32_t>::max() - 1) {
+                throw runtime_error("Too many operations have been submitted.");
+            }
+            freeSlots.push_back(static_cast<uint32_t>(slots.size()));
+            slots.emplace_back();
+        }
+
+        const auto index = freeSlots.back();
+        freeSlots.pop_back();
+        auto& slot = slots[index];
+        slot.op = op;
+        slot.op.handle = makeHandle(index, slot.generation);
+        slot.inUse = true;
+        slot.resource = Poller::invalidHandle;
+        ++numOutstanding;
+        return index;
+    }
+
+    // Report a completed operation, freeing its slot.
+    void complete(handle_t handle, ssize_t result) {
+        CompletionOperation op;
+        {
+            lock_guard<mutex> l(lock);
+            const auto index = indexFromHandle(handle);
+            if (index >= slots.size()) {
+                return;
+            }
+            auto& slot = slots[index];
+            if (!slot.inUse || slot.generation != generationFromHandle(handle)) {
+                return;
+            }
+
+            op = slot.op;
+            slot.inUse = false;
+            slot.resource = Poller::invalidHandle;
+            if (++slot.generation == 0) {
+                slot.generation = 1;
+            }
+            freeSlots.push_back(index);
+            --numOutstanding;
+        }
+        fireHasCompleted(op, result);
+    }
+
+
+    /// MARK: Emulated engine
+
+    // The emulated engine uses a Poller with a one shot resource for each operation,
+    // performing the operation once the resource is ready. The resource payload is
+    // the index of the operation's slot.
+    class Emulation : public PollerDelegate {
+    public:
+        explicit Emulation(Impl& impl) : impl(impl) {}
+
+        bool pollerShouldStop() const override {
+            return impl.delegate->completionPollerShouldStop();
+        }
+
+        milliseconds pollerMaximumWaitInterval() const override {
+            return impl.delegate->completionPollerMaximumWaitInterval();
+        }
+
+        void pollerResourceReadIsReady(Poller& p, const PolledResource& r) override { perform(p, r); }
+        void pollerResourceWriteIsReady(Poller& p, const PolledResource& r) override { perform(p, r); }
+        void pollerResourceErrorHasOccurred(Poller& p, const PolledResource& r) override { perform(p, r); }
+        void pollerResourceHasDisconnected(Poller& p, const PolledResource& r) override { perform(p, r); }
+
+    private:
+        Impl& impl;
+
+        // Perform the operation for a ready resource. Since several callbacks may be
+        // made for the same event, the resource handle is used to check that the
+        // operation has not already been performed.
+        void perform(Poller& p, const PolledResource& r) {
+            const auto index = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(r.payload));
+            CompletionOperation op;
+            {
+                lock_guard<mutex> l(impl.lock);
+                const auto& slot = impl.slots[index];
+                if (!slot.inUse || slot.resource != r.handle) {
+                    return;
+                }
+                op = slot.op;
+            }
+
+            auto result = performOperation(op);
+            if (result == -1) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    p.rearm(r.handle);
+                    return;
+                }
+                result = -errno;
+            }
+            p.remove(r.handle);
+            impl.complete(op.handle, result);
+        }
+    };
+
+    unique_ptr<Poller>          poller;
+    unique_ptr<Emulation>       emulation;
+
+    void startEmulation() {
+        poller.reset(new Poller());
+        emulation.reset(new Emulation(*this));
+        poller->setDelegate(emulation.get());
+    }
+
+    // Add the resource for an operation. Must be called with the lock held.
+    void submitEmulated(uint32_t index) {
+        auto& slot = slots[index];
+        PolledResource r;
+        r.name = "completion";
+        r.filedes = slot.op.filedes;
+        r.event = (slot.op.type == CompletionOperation::Type::write
+                   ? PolledResource::Event::write : PolledResource::Event::read);
+        r.mode = PolledResource::Mode::oneShot;
+        r.payload = reinterpret_cast<void*>(static_cast<uintptr_t>(index));
+        slot.resource = poller->add(r);
+    }
+
+    void runEmulated() {
+        poller->run();
+    }
+
+
+    /// MARK: io_uring engine
+
+#if defined(KSSIO_HAVE_IO_URING)
+    static constexpr unsigned   ringEntries = 256;
+
+    // The ring, the operations that have been submitted but not yet passed to it, and
+    // the state of our internal wakeup and timeout operations. Apart from queued,
+    // which is protected by the lock, these are only accessed by run().
+    unique_ptr<Ring>            ring;
+    vector<handle_t>            queued;
+    int                         wakeupFiledes { -1 };
+    atomic<bool>                wakeupPending { false };
+    uint64_t                    wakeupBuffer { 0 };
+    bool                        wakeupIsPosted { false };
+    bool                        timeoutIsPosted { false };
+    __kernel_timespec           timeout;
+    vector<io_uring_cqe>        completions;
+
+    void startRing() {
+        ring.reset(new Ring(ringEntries));
+        wakeupFiledes = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (wakeupFiledes == -1) {
+            const auto err = errno;
+            ring.reset();
+            throw system_error(err, system_category(), "eventfd");
+        }
+    }
+
+    // Pass the queued operations to the ring, leaving any that do not fit for the next
+    // pass. Returns true if any are left.
+    bool fillRing() {
+        lock_guard<mutex> l(lock);
+        size_t n = 0;
+        for (; n < queued.size(); ++n) {
+            const auto& op = slots[indexFromHandle(queued[n])].op;
+            auto sqe = ring->nextSubmission();
+            if (!sqe) {
+                break;
+            }
+
+            sqe->fd = op.filedes;
+            sqe->user_data = op.handle;
+            switch (op.type) {
+                case CompletionOperation::Type::read:
+                case CompletionOperation::Type::write:
+                    sqe->opcode = (op.type == CompletionOperation::Type::read
+                                   ? IORING_OP_READ : IORING_OP_WRITE);
+                    sqe->addr = reinterpret_cast<uint64_t>(op.buffer);
+                    sqe->len = static_cast<uint32_t>(min<size_t>(op.length, numeric_limits<uint32_t>::max()));
+                    sqe->off = static_cast<uint64_t>(-1);      // Use the current file position.
+                    break;
+                case CompletionOperation::Type::accept:
+                    sqe->opcode = IORING_OP_ACCEPT;
+                    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+                    break;
+            }
+        }
+        queued.erase(queued.begin(), queued.begin() + static_cast<ptrdiff_t>(n));
+        return !queued.empty();
+    }
+
+    // Keep a read outstanding on the wakeup descriptor, so that wakeup() can interrupt
+    // the wait.
+    void postWakeup() {
+        if (!wakeupIsPosted) {
+            auto sqe = ring->nextSubmission();
+            if (sqe) {
+                sqe->opcode = IORING_OP_READ;
+                sqe->fd = wakeupFiledes;
+                sqe->addr = reinterpret_cast<uint64_t>(&wakeupBuffer);
+                sqe->len = sizeof(wakeupBuffer);
+                sqe->user_data = Ring::wakeupTag;
+                wakeupIsPosted = true;
+            }
+        }
+    }
+
+    // Limit the wait to the delegate's maximum interval. Only one timeout is kept
+    // outstanding at a time.
+    void postTimeout(int ms) {
+        if (!timeoutIsPosted) {
+            auto sqe = ring->nextSubmission();
+            if (sqe) {
+                timeout.tv_sec = ms / 1000;
+                timeout.tv_nsec = (ms % 1000) * 1000000L;
+                sqe->opcode = IORING_OP_TIMEOUT;
+                sqe->addr = reinterpret_cast<uint64_t>(&timeout);
+                sqe->len = 1;
+                sqe->off = 0;
+                sqe->user_data = Ring::timeoutTag;
+                timeoutIsPosted = true;
+            }
+        }
+    }
+
+    // Returns false if run() should exit.
+    bool handleRingResult(int res) {
+        if (res == -1) {
+            switch (errno) {
+                case EAGAIN:
+                case EBUSY:
+                    // Not a problem, the kernel is short of resources so we try again.
+                    return true;
+
+                case EINTR:
+                    syslog(LOG_INFO, "io_uring_enter was interrupted, in %s.", __func__);
+                    return false;
+
+                default:
+                    throw system_error(error_code(errno, system_category()), "io_uring_enter");
+            }
+        }
+
+        completions.clear();
+        ring->reap(completions);
+        for (const auto& cqe : completions) {
+            if (cqe.user_data == Ring::wakeupTag) {
+                wakeupIsPosted = false;
+                wakeupPending = false;
+            }
+            else if (cqe.user_data == Ring::timeoutTag) {
+                timeoutIsPosted = false;
+            }
+            else {
+                complete(cqe.user_data, cqe.res);
+            }
+        }
+        return true;
+    }
+
+    // Cancel the operations that have been passed to the ring and wait until the kernel
+    // has finished with them. Closing the ring is not enough, since its teardown is
+    // asynchronous and operations being performed by kernel workers could still write
+    // to their buffers after the close. The operations are not reported to the delegate.
+    void cancelRing() noexcept {
+        vector<uint64_t> inFlight;
+        try {
+            lock_guard<mutex> l(lock);
+            for (const auto& slot : slots) {
+                if (slot.inUse && find(queued.begin(), queued.end(), slot.op.handle) == queued.end()) {
+                    inFlight.push_back(slot.op.handle);
+                }
+            }
+            if (wakeupIsPosted) {
+                inFlight.push_back(Ring::wakeupTag);
+            }
+            completions.clear();
+        }
+        catch (const exception& e) {
+            syslog(LOG_ERR, "Could not cancel the io_uring operations, exception=%s", e.what());
+            return;
+        }
+
+        size_t remaining = inFlight.size() + (timeoutIsPosted ? 1 : 0);
+        bool needsTimeoutRemoval = timeoutIsPosted;
+        size_t next = 0;
+        while (remaining > 0) {
+            if (needsTimeoutRemoval) {
+                if (auto sqe = ring->nextSubmission()) {
+                    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+                    sqe->addr = Ring::timeoutTag;
+                    sqe->user_data = Ring::cancelTag;
+                    needsTimeoutRemoval = false;
+                }
+            }
+            for (; next < inFlight.size(); ++next) {
+                auto sqe = ring->nextSubmission();
+                if (!sqe) {
+                    break;
+                }
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = inFlight[next];
+                sqe->user_data = Ring::cancelTag;
+            }
+
+            if (ring->enter(1) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                syslog(LOG_ERR, "Could not cancel the io_uring operations, errno=%d", errno);
+                return;
+            }
+
+            try {
+                completions.clear();
+                ring->reap(completions);
+            }
+            catch (const exception& e) {
+                syslog(LOG_ERR, "Could not cancel the io_uring operations, exception=%s", e.what());
+                return;
+            }
+            for (const auto& cqe : completions) {
+                if (cqe.user_data != Ring::cancelTag) {
+                    --remaining;
+                }
+            }
+        }
+    }
+
+    void runRing() {
+        while (!delegate->completionPollerShouldStop()) {
+            postWakeup();
+            const bool moreQueued = fillRing();
+            {
+                lock_guard<mutex> l(lock);
+                if (numOutstanding == 0) {
+                    break;
+                }
+            }
+
+            // Don't wait if there are operations that did not fit in the ring.
+            const auto ms = timeoutFromInterval(delegate->completionPollerMaximumWaitInterval());
+            unsigned minComplete = 1;
+            if (ms == 0 || moreQueued) {
+                minComplete = 0;
+            }
+            else if (ms > 0) {
+                postTimeout(ms);
+            }
+
+            if (!handleRingResult(ring->enter(minComplete))) {
+                break;
+            }
+        }
+    }
+#endif
+
+
+    /// MARK: Callbacks
+
+	// Wrap any exceptions in a syslog and call the delegate.
+    void fireHasStarted() noexcept {
+        try {
+            delegate->completionPollerHasStarted(*parent);
+        }
+        catch (const exception& e) {
+            syslog(LOG_ERR, "Error in completion poller callback, exception=%s", e.what());
+        }
+    }
+
+    void fireWillStop() noexcept {
+        try {
+            delegate->completionPollerWillStop(*parent);
+        }
+        catch (const exception& e) {
+            syslog(LOG_ERR, "Error in completion poller callback, exception=%s", e.what());
+        }
+    }
+
+    void fireHasCompleted(const CompletionOperation& op, ssize_t result) noexcept {
+        try {
+            switch (op.type) {
+                case CompletionOperation::Type::read:
+                    delegate->completionPollerReadHasCompleted(*parent, op, result);
+                    break;
+                case CompletionOperation::Type::write:
+                    delegate->completionPollerWriteHasCompleted(*parent, op, result);
+                    break;
+                case CompletionOperation::Type::accept:
+                    delegate->completionPollerAcceptHasCompleted(*parent, op, result);
+                    break;
+            }
+        }
+        catch (const exception& e) {
+            syslog(LOG_ERR, "Error with completion poller callback, filedes=%d, exception=%s",
+                   op.filedes, e.what());
+        }
+    }
+};
+
+
+///
+/// MARK: CompletionPoller Implementation
+///
+
+constexpr CompletionPoller::handle_t CompletionPoller::invalidHandle;
+
+CompletionPoller::CompletionPoller() : CompletionPoller(Engine::automatic) {
+}
+
+CompletionPoller::CompletionPoller(Engine engine) : _impl(new Impl()) {
+    _impl->parent = this;
+
+#if defined(KSSIO_HAVE_IO_URING)
+    if (engine == Engine::ioUring) {
+        _impl->startRing();
+        _impl->engine = Engine::ioUring;
+    }
+    else if (engine == Engine::automatic) {
+        try {
+            _impl->startRing();
+            _impl->engine = Engine::ioUring;
+        }
+        catch (const system_error& e) {
+            syslog(LOG_INFO, "io_uring is not available, using the emulated engine. %s", e.what());
+        }
+    }
+#else
+    if (engine == Engine::ioUring) {
+        throw invalid_argument("The io_uring engine is not available on this platform.");
+    }
+#endif
+
+    if (_impl->engine != Engine::ioUring) {
+        _impl->startEmulation();
+        _impl->engine = Engine::emulated;
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_impl->parent == this),
+        KSS_EXPR(_impl->delegate == nullptr),
+        KSS_EXPR(_impl->engine != Engine::automatic),
+        KSS_EXPR(_impl->numOutstanding == 0)
+    });
+}
+
+CompletionPoller::~CompletionPoller() noexcept {
+#if defined(KSSIO_HAVE_IO_URING)
+    if (_impl->ring) {
+        _impl->cancelRing();
+        _impl->ring.reset();
+    }
+    if (_impl->wakeupFiledes != -1) {
+        ::close(_impl->wakeupFiledes);
+    }
+#endif
+}
+
+
+void CompletionPoller::setDelegate(CompletionPollerDelegate *delegate) noexcept {
+    _impl->delegate = delegate;
+}
+
+CompletionPoller::Engine CompletionPoller::engine() const noexcept {
+    return _impl->engine;
+}
+
+size_t CompletionPoller::size() const {
+    lock_guard<mutex> l(_impl->lock);
+    return _impl->numOutstanding;
+}
+
+
+CompletionPoller::handle_t CompletionPoller::submit(const CompletionOperation &op) {
+    contract::parameters({
+        KSS_EXPR(op.filedes >= 0),
+        KSS_EXPR(op.type == CompletionOperation::Type::accept || op.buffer != nullptr)
+    });
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    handle_t handle = invalidHandle;
+    {
+        lock_guard<mutex> l(_impl->lock);
+        const auto index = _impl->allocateSlot(op);
+        handle = _impl->slots[index].op.handle;
+        if (_impl->engine == Engine::emulated) {
+            _impl->submitEmulated(index);
+        }
+#if defined(KSSIO_HAVE_IO_URING)
+        else {
+            _impl->queued.push_back(handle);
+        }
+#endif
+    }
+
+    if (_impl->engine == Engine::ioUring && _impl->runThread.load() != this_thread::get_id()) {
+        wakeup();
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_impl->parent == this),
+        KSS_EXPR(handle != invalidHandle)
+    });
+    return handle;
+}
+
+
+void CompletionPoller::wakeup() noexcept {
+    if (_impl->engine == Engine::emulated) {
+        _impl->poller->wakeup();
+    }
+#if defined(KSSIO_HAVE_IO_URING)
+    else if (!_impl->wakeupPending.exchange(true)) {
+        const uint64_t one = 1;
+        if (::write(_impl->wakeupFiledes, &one, sizeof(one)) == -1) {
+            // The counter can only be full if a wakeup is already pending.
+            assert(errno == EAGAIN);
+        }
+    }
+#endif
+}
+
+
+void CompletionPoller::run() {
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    if (!_impl->delegate) {
+        throw runtime_error("No delegate has been assigned.");
+    }
+    _impl->runThread = this_thread::get_id();
+    Finally cleanup([&]{ _impl->runThread = thread::id(); });
+    _impl->fireHasStarted();
+
+    if (_impl->engine == Engine::emulated) {
+        _impl->runEmulated();
+    }
+#if defined(KSSIO_HAVE_IO_URING)
+    else {
+        _impl->runRing();
+    }
+#endif
+
+    _impl->fireWillStop();
+}
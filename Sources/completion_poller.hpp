@@ -0,0 +1,232 @@
+//
+//  completion_poller.hpp
+//  kssio
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#ifndef kssio_completion_poller_hpp
+#define kssio_completion_poller_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include <sys/types.h>
+
+namespace kss {
+    namespace io {
+
+        class CompletionPoller;
+
+        /*!
+         This structure is used to describe an operation to be performed by a
+         CompletionPoller.
+         */
+        struct CompletionOperation {
+
+            /*!
+             An opaque value identifying an operation that has been submitted.
+             */
+            using handle_t = uint64_t;
+
+            /*!
+             The types of operations that may be performed.
+             */
+            enum class Type {
+                read,           //!< Read up to length bytes into buffer.
+                write,          //!< Write up to length bytes from buffer.
+                accept          //!< Accept a connection on a listening socket.
+            };
+
+            Type		type;                   ///< The operation to perform.
+            int			filedes;                ///< The descriptor to perform it on.
+            void*       buffer { nullptr };     ///< The data to read into or write from. Not used by accept.
+            size_t      length { 0 };           ///< The size of buffer. Not used by accept.
+            void*		payload { nullptr };	///< An optional pointer to be passed with the operation record.
+            handle_t    handle { 0 };           ///< Assigned by CompletionPoller::submit(). Any value passed to it is ignored.
+        };
+
+
+        /*!
+         This is the interface for the completion poller delegate. It follows the same
+         pattern as PollerDelegate, except that instead of being told when a resource
+         is ready, the delegate is told when an operation has been performed.
+
+         It is best that the methods of this interface do not throw exceptions. However
+         if they do they will be automatically caught and ignored.
+         */
+        class CompletionPollerDelegate {
+        public:
+
+            /*!
+             Should return true when the poller should stop.
+             */
+            virtual bool completionPollerShouldStop() const = 0;
+
+            /*!
+             Returns the maximum time that the poller waits for completions before
+             checking completionPollerShouldStop(). This has the same meaning as
+             PollerDelegate::pollerMaximumWaitInterval().
+             */
+            virtual std::chrono::milliseconds completionPollerMaximumWaitInterval() const {
+                using namespace std::chrono_literals;
+                return 100ms;
+            }
+
+            /*!
+             Called just after CompletionPoller::run() has begun.
+             */
+            virtual void completionPollerHasStarted(CompletionPoller& p) {}
+
+            /*!
+             Called just before CompletionPoller::run() exits.
+             */
+            virtual void completionPollerWillStop(CompletionPoller& p) {}
+
+            /*!
+             Called when a read has completed. The result is the number of bytes read,
+             0 at end of file, or the negated errno value if the read failed.
+             */
+            virtual void completionPollerReadHasCompleted(CompletionPoller& p,
+                                                          const CompletionOperation& op,
+                                                          ssize_t result) {}
+
+            /*!
+             Called when a write has completed. The result is the number of bytes
+             written, which may be less than the length requested, or the negated errno
+             value if the write failed.
+             */
+            virtual void completionPollerWriteHasCompleted(CompletionPoller& p,
+                                                           const CompletionOperation& op,
+                                                           ssize_t result) {}
+
+            /*!
+             Called when an accept has completed. The result is the descriptor of the new
+             connection, which will be non-blocking and close-on-exec, or the negated
+             errno value if the accept failed. The delegate is responsible for closing
+             the new descriptor.
+             */
+            virtual void completionPollerAcceptHasCompleted(CompletionPoller& p,
+                                                            const CompletionOperation& op,
+                                                            ssize_t result) {}
+        };
+
+
+        /*!
+         This class is used to perform reads, writes and accepts on a number of
+         descriptors at once, reporting each operation when it has been performed. This
+         differs from Poller, which reports when a descriptor is ready and leaves the
+         operation to the delegate.
+
+         On Linux, if the kernel supports it, the operations are submitted to io_uring
+         in batches, so that many operations may be performed with a single system
+         call. Otherwise the operations are emulated by performing them when a Poller
+         reports that their descriptors are ready. The descriptors should be
+         non-blocking when the emulated engine is used.
+
+         Each operation is performed once. To read or write continuously, submit a new
+         operation from the completion callback. The buffers must remain valid until
+         their operations have completed, or until the poller has been destroyed.
+         */
+        class CompletionPoller final {
+        public:
+
+            /*!
+             The mechanism used to perform the operations.
+             */
+            enum class Engine {
+                automatic,          //!< Use io_uring if it is available, otherwise emulated.
+                ioUring,            //!< Use io_uring. Only available on Linux 5.6 or later.
+                emulated            //!< Use a Poller. Available on all platforms.
+            };
+
+            /*!
+             Handles identify the individual operations. Handles are not reused. No
+             valid handle is ever equal to invalidHandle.
+             */
+            using handle_t = CompletionOperation::handle_t;
+            static constexpr handle_t invalidHandle = 0;
+
+            /*!
+             Construct a poller. The default constructor is the same as specifying
+             Engine::automatic.
+
+             @throws std::invalid_argument if Engine::ioUring is requested on a platform
+                other than Linux.
+             @throws std::system_error if the engine could not be created, including
+                if Engine::ioUring is requested but the kernel does not support it.
+             */
+            CompletionPoller();
+            explicit CompletionPoller(Engine engine);
+
+            /*!
+             The destructor cancels any operations that are still outstanding, without
+             reporting them to the delegate, and waits until the kernel has finished
+             with their buffers. It must not be called while run() is executing.
+             */
+            ~CompletionPoller() noexcept;
+
+            CompletionPoller(const CompletionPoller&) = delete;
+            CompletionPoller& operator=(const CompletionPoller&) = delete;
+
+            /*!
+             Set the delegate. This needs to be done before run() is called, and the
+             delegate must remain valid throughout the life of the poller.
+             */
+            void setDelegate(CompletionPollerDelegate* delegate) noexcept;
+
+            /*!
+             Returns the engine actually used by this poller. This will never be
+             Engine::automatic.
+             */
+            Engine engine() const noexcept;
+
+            /*!
+             Returns the number of operations that have been submitted but not yet
+             reported.
+
+             @throws any exception that std::mutex handling can cause.
+             */
+            size_t size() const;
+
+            /*!
+             Submit an operation. This may be called from any thread, including from
+             within the delegate callbacks. Operations submitted while run() is
+             executing are passed to the kernel together on its next pass.
+
+             @return a handle that identifies this operation. The same value is passed
+                to the delegate in CompletionOperation::handle.
+             @throws std::invalid_argument if op.filedes is negative, or if op.buffer is
+                nullptr for a read or write.
+             @throws any exception that std::mutex handling can cause.
+             */
+            handle_t submit(const CompletionOperation& op);
+
+            /*!
+             Interrupt the internal wait, if run() is waiting, so that the delegate's
+             completionPollerShouldStop() is examined right away. This may be called
+             from any thread.
+             */
+            void wakeup() noexcept;
+
+            /*!
+             Run the poller. This will not exit until completionPollerShouldStop()
+             returns true, there are no operations outstanding, or an error occurs. The
+             exit conditions are the same as for Poller::run().
+
+             @throws runtime_error if no delegate has been assigned.
+             @throws system_error if there is a problem with the internal system calls.
+             */
+            void run();
+
+        private:
+            struct Impl;
+            std::unique_ptr<Impl> _impl;
+        };
+    }
+}
+
+#endif
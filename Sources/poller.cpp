@@ -8,17 +8,28 @@
 //
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <poll.h>
 #include <syslog.h>
+#include <unistd.h>
+#include <fcntl.h>
+#if defined(__linux)
+#   include <sys/epoll.h>
+#   include <sys/eventfd.h>
+#endif
 #include <kss/contract/all.h>
 #include <kss/util/all.h>
 
@@ -30,7 +41,9 @@ using namespace kss::io;
 namespace contract = kss::contract;
 
 using std::chrono::milliseconds;
-using kss::util::containers::eraseIf;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+using kss::util::Finally;
 
 
 ///
@@ -70,6 +83,769 @@ namespace {
 			return static_cast<int>(count);
 		}
 	}
+
+    // A slot in the table of resources. Slots are reused once their resource has been
+    // removed, and the generation distinguishes the successive resources that have used
+    // the same slot.
+    struct Slot {
+        PolledResource  resource;
+        uint32_t        generation { 1 };
+        bool            inUse { false };
+        bool            armed { true };         // False once a one shot resource has fired.
+        size_t          positionInGroup { 0 };  // Position in the list of slots with our name.
+    };
+
+    // The number of resources, and their mode, that share a descriptor.
+    struct FiledesUsage {
+        PolledResource::Mode    mode;
+        size_t                  count;
+    };
+
+    // Handles combine the slot index with its generation, so that a stale handle never
+    // refers to a newer resource. The generation is never 0, hence neither is a handle.
+    inline Poller::handle_t makeHandle(uint32_t index, uint32_t generation) noexcept {
+        return (static_cast<Poller::handle_t>(generation) << 32) | index;
+    }
+
+    inline uint32_t indexFromHandle(Poller::handle_t handle) noexcept {
+        return static_cast<uint32_t>(handle & 0xFFFFFFFFU);
+    }
+
+    inline uint32_t generationFromHandle(Poller::handle_t handle) noexcept {
+        return static_cast<uint32_t>(handle >> 32);
+    }
+
+    // A descriptor that is ready, described using the poll() event bits regardless
+    // of which engine produced it.
+    struct ReadyDescriptor {
+        int     filedes;
+        short   revents;
+    };
+
+    // The mechanism used to wait for the monitored descriptors. Each descriptor is
+    // watched at most once, with the union of the events of all the armed resources
+    // that share it. The multiplexer is only ever accessed from within run().
+    class Multiplexer {
+    public:
+        virtual ~Multiplexer() noexcept = default;
+
+        // Start monitoring a descriptor, or change the events of interest for it. This
+        // also rearms the descriptor if it is not level triggered. An events value of 0
+        // means the descriptor is still registered, but disarmed.
+        virtual void watch(int filedes, short events, PolledResource::Mode mode) = 0;
+
+        // Stop monitoring a descriptor.
+        virtual void unwatch(int filedes) = 0;
+
+        // Returns true if the multiplexer can report edge triggered events. If not, the
+        // poller will treat edge triggered resources as one shot resources.
+        virtual bool supportsEdgeTriggered() const noexcept = 0;
+
+        // Wait for events and add the ready descriptors to ready. The return value
+        // follows the same conventions as poll().
+        virtual int wait(int timeout, vector<ReadyDescriptor>& ready) = 0;
+    };
+
+    // Multiplexer based on poll(). Changes are applied directly to the descriptor
+    // array, using an index from each descriptor to its position, so that adding or
+    // removing one descriptor does not touch the others.
+    class PollMultiplexer : public Multiplexer {
+    public:
+        void watch(int filedes, short events, PolledResource::Mode) override {
+            // A disarmed descriptor is left out, since poll() would still
+            // report errors and disconnects on it.
+            if (events == 0) {
+                unwatch(filedes);
+                return;
+            }
+
+            const auto it = positions.find(filedes);
+            if (it != positions.end()) {
+                fds[it->second].events = events;
+            }
+            else {
+                struct pollfd fd;
+                fd.fd = filedes;
+                fd.events = events;
+                fd.revents = 0;
+                positions[filedes] = fds.size();
+                fds.push_back(fd);
+            }
+        }
+
+        void unwatch(int filedes) override {
+            // Move the last descriptor into the position being vacated.
+            const auto it = positions.find(filedes);
+            if (it != positions.end()) {
+                const auto pos = it->second;
+                positions.erase(it);
+                if (pos != fds.size() - 1) {
+                    fds[pos] = fds.back();
+                    positions[fds[pos].fd] = pos;
+                }
+                fds.pop_back();
+            }
+        }
+
+        bool supportsEdgeTriggered() const noexcept override {
+            return false;
+        }
+
+        int wait(int timeout, vector<ReadyDescriptor>& ready) override {
+            // There is a possibility that the user may have attempted to add more resources to
+            // monitor than possible file descriptors. This could lead to a potential security
+            // issue so we explicitly check for that condition and throw an exception.
+            if (fds.size() > numeric_limits<nfds_t>::max()) {
+                throw runtime_error("Too many resources have been added. "
+                                    "This could represent an attempt to cause "
+                                    "an overflow or underflow.");
+            }
+            const auto fdsize = static_cast<nfds_t>(fds.size());
+
+            errno = 0;
+            const auto res = poll(fds.data(), fdsize, timeout);
+            if (res > 0) {
+                // poll() tells us how many descriptors are ready, so we can stop
+                // looking once we have found them all.
+                int remaining = res;
+                for (const auto& fd : fds) {
+                    if (fd.revents) {
+                        ready.push_back(ReadyDescriptor { fd.fd, fd.revents });
+                        if (--remaining == 0) {
+                            break;
+                        }
+                    }
+                }
+            }
+            return res;
+        }
+
+    private:
+        vector<struct pollfd>       fds;
+        unordered_map<int, size_t>  positions;
+    };
+
+#if defined(__linux)
+    // Multiplexer based on epoll(). Descriptors are registered with the kernel as they
+    // are added and removed, and each wait only returns the ones that are ready.
+    class EpollMultiplexer : public Multiplexer {
+    public:
+        EpollMultiplexer() {
+            epfd = epoll_create1(EPOLL_CLOEXEC);
+            if (epfd == -1) {
+                throw system_error(errno, system_category(), "epoll_create1");
+            }
+            events.resize(1);
+        }
+
+        ~EpollMultiplexer() noexcept override {
+            close(epfd);
+        }
+
+        void watch(int filedes, short pollEvents, PolledResource::Mode mode) override {
+            // Descriptors that epoll cannot monitor (i.e. regular files) are always
+            // ready, which is also how poll() treats them.
+            const auto ait = alwaysReady.find(filedes);
+            if (ait != alwaysReady.end()) {
+                ait->second = Registration { pollEvents, mode };
+                return;
+            }
+
+            // A one shot descriptor that has fired is already disarmed by the kernel,
+            // so there is no need to tell it again.
+            const auto it = registered.find(filedes);
+            if (it != registered.end() && pollEvents == 0 && it->second.events == 0) {
+                it->second.mode = mode;
+                return;
+            }
+
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = epollEventsFromPollEvents(pollEvents);
+            if (mode == PolledResource::Mode::edgeTriggered) {
+                ev.events |= EPOLLET;
+            }
+            else if (mode == PolledResource::Mode::oneShot) {
+                ev.events |= EPOLLONESHOT;
+            }
+            ev.data.fd = filedes;
+
+            // If the descriptor was closed, and its number reused, before we were told
+            // to unwatch it, the kernel will have already forgotten about it.
+            int op = (it == registered.end() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD);
+            int res = epoll_ctl(epfd, op, filedes, &ev);
+            if (res == -1 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+                op = EPOLL_CTL_ADD;
+                res = epoll_ctl(epfd, op, filedes, &ev);
+            }
+            if (res == -1) {
+                if (errno == EPERM && op == EPOLL_CTL_ADD) {
+                    alwaysReady[filedes] = Registration { pollEvents, mode };
+                    return;
+                }
+                throw system_error(errno, system_category(), "epoll_ctl");
+            }
+            registered[filedes] = Registration { pollEvents, mode };
+            resizeEventBuffer();
+        }
+
+        void unwatch(int filedes) override {
+            if (alwaysReady.erase(filedes) > 0) {
+                return;
+            }
+
+            const auto it = registered.find(filedes);
+            if (it != registered.end()) {
+                // The descriptor may already have been closed, in which case the kernel
+                // has already removed it from the epoll set.
+                if (epoll_ctl(epfd, EPOLL_CTL_DEL, filedes, nullptr) == -1
+                    && errno != EBADF && errno != ENOENT)
+                {
+                    throw system_error(errno, system_category(), "epoll_ctl");
+                }
+                registered.erase(it);
+                resizeEventBuffer();
+            }
+        }
+
+        bool supportsEdgeTriggered() const noexcept override {
+            return true;
+        }
+
+        int wait(int timeout, vector<ReadyDescriptor>& ready) override {
+            bool haveAlwaysReady = false;
+            for (const auto& p : alwaysReady) {
+                if (p.second.events != 0) {
+                    haveAlwaysReady = true;
+                    timeout = 0;
+                    break;
+                }
+            }
+
+            errno = 0;
+            const auto res = epoll_wait(epfd, events.data(), static_cast<int>(events.size()), timeout);
+            if (res == -1) {
+                return res;
+            }
+
+            for (int i = 0; i < res; ++i) {
+                const auto filedes = events[i].data.fd;
+                ready.push_back(ReadyDescriptor {
+                    filedes, pollEventsFromEpollEvents(events[i].events)
+                });
+
+                auto& reg = registered[filedes];
+                if (reg.mode == PolledResource::Mode::oneShot) {
+                    reg.events = 0;
+                }
+            }
+
+            // The always ready descriptors have no edges, so we treat them as one shot
+            // unless they are level triggered.
+            if (haveAlwaysReady) {
+                for (auto& p : alwaysReady) {
+                    if (p.second.events != 0) {
+                        ready.push_back(ReadyDescriptor { p.first, p.second.events });
+                        if (p.second.mode != PolledResource::Mode::level) {
+                            p.second.events = 0;
+                        }
+                    }
+                }
+            }
+            return static_cast<int>(ready.size());
+        }
+
+    private:
+        struct Registration {
+            short                   events;
+            PolledResource::Mode    mode;
+        };
+
+        int                                 epfd { -1 };
+        unordered_map<int, Registration>    registered;
+        unordered_map<int, Registration>    alwaysReady;
+        vector<struct epoll_event>          events;
+
+        // Size the event buffer so that a single wait can report every registered
+        // descriptor, up to a reasonable limit.
+        void resizeEventBuffer() {
+            static constexpr size_t maxEventsPerWait = 1024;
+            events.resize(max<size_t>(1, min(registered.size(), maxEventsPerWait)));
+        }
+
+        static uint32_t epollEventsFromPollEvents(short pollEvents) noexcept {
+            uint32_t ev = 0;
+            if (pollEvents & POLLIN)    { ev |= EPOLLIN; }
+            if (pollEvents & POLLOUT)   { ev |= EPOLLOUT; }
+            return ev;
+        }
+
+        static short pollEventsFromEpollEvents(uint32_t ev) noexcept {
+            short pollEvents = 0;
+            if (ev & EPOLLIN)   { pollEvents |= POLLIN; }
+            if (ev & EPOLLOUT)  { pollEvents |= POLLOUT; }
+            if (ev & EPOLLERR)  { pollEvents |= POLLERR; }
+            if (ev & EPOLLHUP)  { pollEvents |= POLLHUP; }
+            return pollEvents;
+        }
+    };
+#endif
+
+    // Used to interrupt a wait from another thread. The read end is monitored along
+    // with the resources. On Linux this is an eventfd, elsewhere it is a pipe.
+    class Waker {
+    public:
+        Waker() {
+#if defined(__linux)
+            readFiledes = writeFiledes = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (readFiledes == -1) {
+                throw system_error(errno, system_category(), "eventfd");
+            }
+#else
+            int fds[2];
+            if (pipe(fds) == -1) {
+                throw system_error(errno, system_category(), "pipe");
+            }
+            readFiledes = fds[0];
+            writeFiledes = fds[1];
+            for (const auto fd : fds) {
+                if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1
+                    || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+                {
+                    const auto err = errno;
+                    close(readFiledes);
+                    close(writeFiledes);
+                    throw system_error(err, system_category(), "fcntl");
+                }
+            }
+#endif
+        }
+
+        ~Waker() noexcept {
+            close(readFiledes);
+            if (writeFiledes != readFiledes) {
+                close(writeFiledes);
+            }
+        }
+
+        int filedes() const noexcept { return readFiledes; }
+
+        // Interrupt the wait. Nothing is written if a wakeup is already pending.
+        void wakeup() noexcept {
+            if (!pending.exchange(true)) {
+                const uint64_t one = 1;
+                while (::write(writeFiledes, &one, sizeof(one)) == -1 && errno == EINTR) {
+                }
+            }
+        }
+
+        // Consume the pending wakeups. Note that the pending flag must be cleared
+        // after the read, otherwise a wakeup that arrives in between would be lost.
+        void drain() noexcept {
+            uint64_t buffer[8];
+            while (::read(readFiledes, buffer, sizeof(buffer)) > 0) {
+            }
+            pending = false;
+        }
+
+    private:
+        int             readFiledes { -1 };
+        int             writeFiledes { -1 };
+        atomic<bool>    pending { false };
+    };
+
+    // Create the multiplexer for the requested engine.
+    unique_ptr<Multiplexer> makeMultiplexer(Poller::Engine engine) {
+        switch (engine) {
+            case Poller::Engine::poll:
+                return unique_ptr<Multiplexer>(new PollMultiplexer());
+            case Poller::Engine::epoll:
+#if defined(__linux)
+                return unique_ptr<Multiplexer>(new EpollMultiplexer());
+#else
+                throw invalid_argument("The epoll engine is not available on this platform.");
+#endif
+            case Poller::Engine::automatic:
+                break;
+        }
+        // should never get here
+        assert(false);
+        return nullptr;
+    }
+
+    // Resolve Engine::automatic into the engine that will actually be used.
+    Poller::Engine resolveEngine(Poller::Engine engine) noexcept {
+        if (engine != Poller::Engine::automatic) {
+            return engine;
+        }
+#if defined(__linux)
+        return Poller::Engine::epoll;
+#else
+        return Poller::Engine::poll;
+#endif
+    }
+
+    // A queue of tasks posted to the poller. This is the intrusive multiple producer,
+    // single consumer queue described by Dmitry Vyukov. Pushing is a single atomic
+    // exchange, so any thread may post without taking a lock, and only the thread
+    // running the poller may pop. The stub node keeps the queue from ever being
+    // completely empty, which is what allows push to avoid a compare and swap loop.
+    class TaskQueue {
+    public:
+        struct Node {
+            atomic<Node*>           next { nullptr };
+            function<void()>        task;
+        };
+
+        TaskQueue() noexcept : head(&stub), tail(&stub) {}
+
+        ~TaskQueue() noexcept {
+            while (auto* node = pop()) {
+                delete node;
+            }
+        }
+
+        TaskQueue(const TaskQueue&) = delete;
+        TaskQueue& operator=(const TaskQueue&) = delete;
+
+        // Add a node to the queue. This may be called from any thread.
+        void push(Node* node) noexcept {
+            node->next.store(nullptr, memory_order_relaxed);
+            Node* prev = head.exchange(node, memory_order_acq_rel);
+            prev->next.store(node, memory_order_release);
+        }
+
+        // Returns true if there may be nodes in the queue. Only the consumer may call this.
+        bool mayHaveNodes() const noexcept {
+            return head.load(memory_order_acquire) != &stub;
+        }
+
+        // Returns the most recently pushed node, or nullptr if there are none. This
+        // marks the end of a drain, so that nodes pushed by the tasks themselves wait
+        // for the next one. Only the consumer may call this.
+        Node* last() const noexcept {
+            Node* h = head.load(memory_order_acquire);
+            return (h == &stub ? nullptr : h);
+        }
+
+        // Remove the oldest node, returning nullptr if the queue is empty or if a
+        // producer is in the middle of pushing it. In the latter case the producer
+        // will wake the poller once it has finished. Only the consumer may call this.
+        Node* pop() noexcept {
+            Node* t = tail;
+            Node* next = t->next.load(memory_order_acquire);
+            if (t == &stub) {
+                if (!next) {
+                    return nullptr;
+                }
+                tail = t = next;
+                next = next->next.load(memory_order_acquire);
+            }
+            if (next) {
+                tail = next;
+                return t;
+            }
+            if (t != head.load(memory_order_acquire)) {
+                return nullptr;
+            }
+            push(&stub);
+            next = t->next.load(memory_order_acquire);
+            if (next) {
+                tail = next;
+                return t;
+            }
+            return nullptr;
+        }
+
+    private:
+        atomic<Node*>   head;
+        Node*           tail;
+        Node            stub;
+    };
+
+    // Combine two poll() timeouts, returning the one that expires first.
+    int earliestTimeout(int a, int b) noexcept {
+        if (a < 0) { return b; }
+        if (b < 0) { return a; }
+        return min(a, b);
+    }
+
+    // A hierarchical timer wheel with a resolution of one tick. Each level has 256
+    // buckets, and each bucket of a level spans a full turn of the level below it. A
+    // timer is placed in the lowest level whose current turn includes its deadline, and
+    // is moved down (cascaded) when the wheel reaches the start of its bucket. Timers too
+    // far away for the top level wait in an overflow bucket. The buckets are intrusive
+    // doubly linked lists, so adding and removing a timer take constant time. This class
+    // is not thread safe.
+    class TimerWheel {
+    public:
+        using tick_t = uint64_t;
+        using handle_t = PollerTimer::handle_t;
+
+        TimerWheel() {
+            for (auto& head : heads) {
+                head = none;
+            }
+            for (auto& tail : tails) {
+                tail = none;
+            }
+            for (auto& level : occupied) {
+                for (auto& word : level) {
+                    word = 0;
+                }
+            }
+        }
+
+        // Add a timer that expires at the given tick, returning its handle.
+        handle_t add(const PollerTimer& timer, tick_t deadline) {
+            if (freeEntries.empty()) {
+                if (entries.size() > numeric_limits<uint32_t>::max() - 1) {
+                    throw runtime_error("Too many timers have been scheduled.");
+                }
+                freeEntries.push_back(static_cast<uint32_t>(entries.size()));
+                entries.emplace_back();
+            }
+
+            const auto index = freeEntries.back();
+            freeEntries.pop_back();
+            auto& e = entries[index];
+            e.timer = timer;
+            e.timer.handle = makeHandle(index, e.generation);
+            e.inUse = true;
+            e.deadline = max(deadline, current + 1);
+            insert(index);
+            ++numTimers;
+            return e.timer.handle;
+        }
+
+        // Remove a timer. Returns false if the handle is not valid.
+        bool remove(handle_t handle) {
+            const auto index = indexFromHandle(handle);
+            if (!find(handle)) {
+                return false;
+            }
+
+            auto& e = entries[index];
+            unlink(index);
+            e.timer = PollerTimer();
+            e.inUse = false;
+            if (++e.generation == 0) {
+                e.generation = 1;
+            }
+            freeEntries.push_back(index);
+            --numTimers;
+            return true;
+        }
+
+        // Returns the timer for a handle, or nullptr if the handle is not valid.
+        const PollerTimer* find(handle_t handle) const noexcept {
+            const auto index = indexFromHandle(handle);
+            if (index < entries.size()) {
+                const auto& e = entries[index];
+                if (e.inUse && e.generation == generationFromHandle(handle)) {
+                    return &e.timer;
+                }
+            }
+            return nullptr;
+        }
+
+        // Put an expired timer back into the wheel, period ticks after its previous
+        // deadline. If that has already passed, it expires on the next tick.
+        void repeat(handle_t handle, tick_t period) {
+            const auto index = indexFromHandle(handle);
+            auto& e = entries[index];
+            assert(find(handle) && e.bucket == noBucket);
+            e.deadline = max(e.deadline + period, current + 1);
+            insert(index);
+        }
+
+        size_t size() const noexcept { return numTimers; }
+
+        // Returns the next tick at which advance() will have something to do, or the
+        // maximum tick if there is nothing in the wheel.
+        tick_t nextTick() const noexcept {
+            tick_t next = numeric_limits<tick_t>::max();
+            for (unsigned level = 0; level < numLevels; ++level) {
+                const unsigned shift = bitsPerLevel * level;
+                const auto idx = nextOccupied(level, ((current >> shift) & levelMask) + 1);
+                if (idx < bucketsPerLevel) {
+                    const auto turn = (current >> (shift + bitsPerLevel)) << (shift + bitsPerLevel);
+                    next = min(next, turn | (tick_t(idx) << shift));
+                }
+            }
+            if (heads[overflowBucket] != none) {
+                const unsigned shift = bitsPerLevel * numLevels;
+                next = min(next, ((current >> shift) + 1) << shift);
+            }
+            return next;
+        }
+
+        // Advance the wheel to the given tick, appending the handles of the timers that
+        // expire to expired. The expired timers remain valid, but outside of the wheel,
+        // until they are either removed or repeated.
+        void advance(tick_t tick, vector<handle_t>& expired) {
+            while (current < tick) {
+                const auto next = nextTick();
+                if (next > tick) {
+                    current = tick;
+                    break;
+                }
+
+                current = next;
+                if ((current & levelMask) == 0) {
+                    cascade();
+                }
+                expireBucket(current & levelMask, expired);
+            }
+        }
+
+    private:
+        static constexpr unsigned   bitsPerLevel = 8;
+        static constexpr unsigned   bucketsPerLevel = 1U << bitsPerLevel;
+        static constexpr tick_t     levelMask = bucketsPerLevel - 1;
+        static constexpr unsigned   numLevels = 4;
+        static constexpr unsigned   overflowBucket = numLevels * bucketsPerLevel;
+        static constexpr uint32_t   noBucket = overflowBucket + 1;
+        static constexpr uint32_t   none = numeric_limits<uint32_t>::max();
+        static constexpr unsigned   wordsPerLevel = bucketsPerLevel / 64;
+
+        struct Entry {
+            PollerTimer timer;
+            tick_t      deadline { 0 };
+            uint32_t    generation { 1 };
+            bool        inUse { false };
+            uint32_t    bucket { noBucket };
+            uint32_t    prev { none };
+            uint32_t    next { none };
+        };
+
+        vector<Entry>       entries;
+        vector<uint32_t>    freeEntries;
+        size_t              numTimers { 0 };
+        tick_t              current { 0 };
+        uint32_t            heads[overflowBucket + 1];
+        uint32_t            tails[overflowBucket + 1];
+        uint64_t            occupied[numLevels][wordsPerLevel];
+
+        // Returns the first occupied bucket of a level at or after from, or
+        // bucketsPerLevel if there is none.
+        unsigned nextOccupied(unsigned level, tick_t from) const noexcept {
+            for (auto word = from / 64; word < wordsPerLevel; ++word) {
+                auto bits = occupied[level][word];
+                if (word == from / 64) {
+                    bits &= (~uint64_t(0) << (from % 64));
+                }
+                if (bits) {
+                    return static_cast<unsigned>(word * 64 + __builtin_ctzll(bits));
+                }
+            }
+            return bucketsPerLevel;
+        }
+
+        // Place a timer in the bucket for its deadline, relative to the current tick.
+        void insert(uint32_t index) {
+            auto& e = entries[index];
+            uint32_t bucket = overflowBucket;
+            for (unsigned level = 0; level < numLevels; ++level) {
+                const unsigned shift = bitsPerLevel * (level + 1);
+                if ((e.deadline >> shift) == (current >> shift)) {
+                    const auto idx = (e.deadline >> (bitsPerLevel * level)) & levelMask;
+                    bucket = static_cast<uint32_t>(level * bucketsPerLevel + idx);
+                    break;
+                }
+            }
+
+            // Timers are appended so that those expiring on the same tick are reported
+            // in the order they were scheduled.
+            e.bucket = bucket;
+            e.prev = tails[bucket];
+            e.next = none;
+            if (e.prev != none) {
+                entries[e.prev].next = index;
+            }
+            else {
+                heads[bucket] = index;
+            }
+            tails[bucket] = index;
+            if (bucket != overflowBucket) {
+                occupied[bucket / bucketsPerLevel][(bucket % bucketsPerLevel) / 64]
+                    |= (uint64_t(1) << (bucket % 64));
+            }
+        }
+
+        // Take a timer out of its bucket, if it is in one.
+        void unlink(uint32_t index) {
+            auto& e = entries[index];
+            if (e.bucket == noBucket) {
+                return;
+            }
+
+            if (e.prev != none) {
+                entries[e.prev].next = e.next;
+            }
+            else {
+                heads[e.bucket] = e.next;
+            }
+            if (e.next != none) {
+                entries[e.next].prev = e.prev;
+            }
+            else {
+                tails[e.bucket] = e.prev;
+            }
+            if (heads[e.bucket] == none && e.bucket != overflowBucket) {
+                occupied[e.bucket / bucketsPerLevel][(e.bucket % bucketsPerLevel) / 64]
+                    &= ~(uint64_t(1) << (e.bucket % 64));
+            }
+            e.bucket = noBucket;
+            e.prev = e.next = none;
+        }
+
+        // Take all the timers out of a bucket, returning the first of them. The rest
+        // follow through their next links.
+        uint32_t takeBucket(uint32_t bucket) {
+            const auto first = heads[bucket];
+            heads[bucket] = none;
+            tails[bucket] = none;
+            if (bucket != overflowBucket) {
+                occupied[bucket / bucketsPerLevel][(bucket % bucketsPerLevel) / 64]
+                    &= ~(uint64_t(1) << (bucket % 64));
+            }
+            return first;
+        }
+
+        // The current tick starts a new turn of level 0. Move the timers in the buckets
+        // that start at this tick down to the lower levels.
+        void cascade() {
+            for (unsigned level = numLevels; level > 0; --level) {
+                const unsigned shift = bitsPerLevel * level;
+                if ((current & ((tick_t(1) << shift) - 1)) != 0) {
+                    continue;
+                }
+
+                const auto bucket = (level == numLevels ? overflowBucket
+                                     : level * bucketsPerLevel + ((current >> shift) & levelMask));
+                auto index = takeBucket(static_cast<uint32_t>(bucket));
+                while (index != none) {
+                    const auto next = entries[index].next;
+                    insert(index);
+                    index = next;
+                }
+            }
+        }
+
+        // Move the timers of a level 0 bucket into expired.
+        void expireBucket(tick_t idx, vector<handle_t>& expired) {
+            auto index = takeBucket(static_cast<uint32_t>(idx));
+            while (index != none) {
+                auto& e = entries[index];
+                const auto next = e.next;
+                e.bucket = noBucket;
+                e.prev = e.next = none;
+                expired.push_back(e.timer.handle);
+                index = next;
+            }
+        }
+    };
 }
 
 ///
@@ -79,29 +855,307 @@ namespace {
 struct Poller::Impl {
 	Poller*			parent { nullptr };
 	PollerDelegate*	delegate { nullptr };
+    PollerStats*    stats { nullptr };
+    Engine          engine { Engine::automatic };
 
 	// Note that the set of resources to be monitored must be protected by a
-	// mutex to handle add and remove calls while run is still executing.
-	vector<PolledResource> 	resources;
-	bool					resourcesHaveChanged { false };
-	mutex	 				resourceLock;
-
-	// Trigger the callbacks for a single resource.
-	void triggerCallbacksForResource(const struct pollfd& fd,
-                                     const PolledResource& resource) noexcept
-    {
-        if (fd.revents & POLLERR)	{ fireErrorHasOccurred(resource); }
-        if (fd.revents & POLLHUP)	{ fireHasDisconnected(resource); }
-        if (fd.revents & POLLIN)	{ fireReadIsReady(resource); }
-        if (fd.revents & POLLOUT)	{ fireWriteIsReady(resource); }
+	// mutex to handle add and remove calls while run is still executing. The
+    // resources are kept in a table of slots, indexed by the handles, with indices
+    // by name and by descriptor. The slots that have changed are queued so that
+    // run() only needs to update its copy of those.
+    vector<Slot>                                slots;
+    vector<uint32_t>                            freeSlots;
+    unordered_map<string, vector<uint32_t>>     slotsByName;
+    unordered_map<int, FiledesUsage>            usageByFiledes;
+    vector<uint32_t>                            changedSlots;
+    size_t                                      numResources { 0 };
+	atomic<bool>			                    resourcesHaveChanged { false };
+	mutex	 				                    resourceLock;
+
+    // The copy of the slots used by run(), an index from each descriptor to the
+    // slots that share it, and the multiplexer. These are only accessed by run().
+    unique_ptr<Multiplexer>                     multiplexer;
+    Waker                                       waker;
+    atomic<thread::id>                          runThread;
+    vector<Slot>                                liveSlots;
+    unordered_map<int, vector<uint32_t>>        liveSlotsByFiledes;
+    size_t                                      numLiveResources { 0 };
+    vector<int>                                 filedesToWatch;
+    vector<PolledEvent>                         readyEvents;
+
+    // The timers. The wheel is protected by its own lock since timers may be scheduled
+    // and cancelled from any thread. Its ticks are milliseconds since the poller was
+    // created.
+    TimerWheel                                  timers;
+    mutex                                       timerLock;
+    const chrono::steady_clock::time_point      timerOrigin { chrono::steady_clock::now() };
+    vector<handle_t>                            expiredTimers;
+
+    // The tasks posted to the poller.
+    TaskQueue                                   tasks;
+
+    // The statistics for the current pass of run(), only used if stats is set.
+    nanoseconds                                 timeInCallbacks { 0 };
+    size_t                                      numEvents { 0 };
+
+    // Note that a slot has changed. Must be called with the resource lock held.
+    void slotHasChanged(uint32_t index) {
+        changedSlots.push_back(index);
+        resourcesHaveChanged = true;
+    }
+
+    // Interrupt run() if it is waiting. There is no need to do this from within
+    // run() itself, i.e. from the delegate callbacks, since it is not waiting.
+    void wakeup() noexcept {
+        if (runThread.load() != this_thread::get_id()) {
+            waker.wakeup();
+        }
+    }
+
+    // Returns the slot for a handle, or nullptr if the handle is not valid. Must be
+    // called with the resource lock held.
+    Slot* findSlot(handle_t handle) noexcept {
+        const auto index = indexFromHandle(handle);
+        if (index < slots.size()) {
+            auto& slot = slots[index];
+            if (slot.inUse && slot.generation == generationFromHandle(handle)) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    // Add a resource to a free slot, returning its handle. Must be called with the
+    // resource lock held.
+    handle_t addSlot(const PolledResource& resource) {
+        const auto uit = usageByFiledes.find(resource.filedes);
+        if (uit != usageByFiledes.end() && uit->second.mode != resource.mode) {
+            throw invalid_argument("Resources sharing a file descriptor must use the same mode.");
+        }
+
+        if (freeSlots.empty()) {
+            if (slots.size() > numeric_limits<uint32_t>::max()) {
+                throw runtime_error("Too many resources have been added.");
+            }
+            freeSlots.push_back(static_cast<uint32_t>(slots.size()));
+            slots.emplace_back();
+        }
+
+        auto& group = slotsByName[resource.name];
+        const auto index = freeSlots.back();
+        auto& slot = slots[index];
+        const auto handle = makeHandle(index, slot.generation);
+        group.push_back(index);
+        freeSlots.pop_back();
+
+        slot.resource = resource;
+        slot.resource.handle = handle;
+        slot.inUse = true;
+        slot.armed = true;
+        slot.positionInGroup = group.size() - 1;
+
+        if (uit == usageByFiledes.end()) {
+            usageByFiledes[resource.filedes] = FiledesUsage { resource.mode, 1 };
+        }
+        else {
+            ++uit->second.count;
+        }
+
+        ++numResources;
+        slotHasChanged(index);
+        return handle;
+    }
+
+    // Remove the resource in a slot. Must be called with the resource lock held.
+    void removeSlot(uint32_t index) {
+        auto& slot = slots[index];
+        assert(slot.inUse);
+
+        // Remove it from its name group by moving the last slot of the group into
+        // its position.
+        const auto git = slotsByName.find(slot.resource.name);
+        assert(git != slotsByName.end());
+        auto& group = git->second;
+        const auto lastIndex = group.back();
+        group[slot.positionInGroup] = lastIndex;
+        slots[lastIndex].positionInGroup = slot.positionInGroup;
+        group.pop_back();
+        if (group.empty()) {
+            slotsByName.erase(git);
+        }
+
+        const auto uit = usageByFiledes.find(slot.resource.filedes);
+        assert(uit != usageByFiledes.end());
+        if (--uit->second.count == 0) {
+            usageByFiledes.erase(uit);
+        }
+
+        slot.resource = PolledResource();
+        slot.inUse = false;
+        if (++slot.generation == 0) {
+            slot.generation = 1;
+        }
+        freeSlots.push_back(index);
+
+        --numResources;
+        slotHasChanged(index);
+    }
+
+    // Rearm the resource in a slot. Returns true if it needed rearming. Must be
+    // called with the resource lock held.
+    bool rearmSlot(uint32_t index) {
+        auto& slot = slots[index];
+        if (slot.resource.mode == PolledResource::Mode::level) {
+            return false;
+        }
+        slot.armed = true;
+        slotHasChanged(index);
+        return true;
+    }
+
+    // Tell the multiplexer about the armed events for a descriptor.
+    void watch(int filedes) {
+        const auto it = liveSlotsByFiledes.find(filedes);
+        if (it == liveSlotsByFiledes.end()) {
+            multiplexer->unwatch(filedes);
+            return;
+        }
+
+        short events = 0;
+        PolledResource::Mode mode = PolledResource::Mode::level;
+        for (const auto index : it->second) {
+            const auto& slot = liveSlots[index];
+            mode = slot.resource.mode;
+            if (slot.armed) {
+                events |= eventsFromResourceEvent(slot.resource.event);
+            }
+        }
+        multiplexer->watch(filedes, events, mode);
+    }
+
+    // Remove a slot from the copy used by run().
+    void removeLiveSlot(uint32_t index) {
+        auto& live = liveSlots[index];
+        const auto filedes = live.resource.filedes;
+        const auto it = liveSlotsByFiledes.find(filedes);
+        assert(it != liveSlotsByFiledes.end());
+        auto& indices = it->second;
+        indices.erase(find(indices.begin(), indices.end(), index));
+        if (indices.empty()) {
+            liveSlotsByFiledes.erase(it);
+        }
+
+        live.inUse = false;
+        --numLiveResources;
+        filedesToWatch.push_back(filedes);
+    }
+
+    // Bring the changed slots of the copy used by run() up to date, and pass the
+    // affected descriptors on to the multiplexer. Only the slots that have changed
+    // are copied.
+    void refreshLiveResourcesIfNecessary() {
+        if (!resourcesHaveChanged) {
+            return;
+        }
+
+        {
+            lock_guard<mutex> lock(resourceLock);
+            resourcesHaveChanged = false;
+            if (liveSlots.size() < slots.size()) {
+                liveSlots.resize(slots.size());
+            }
+
+            for (const auto index : changedSlots) {
+                const auto& master = slots[index];
+                auto& live = liveSlots[index];
+
+                // Only the arming can change for an existing resource.
+                if (live.inUse && master.inUse && live.generation == master.generation) {
+                    live.armed = master.armed;
+                    filedesToWatch.push_back(live.resource.filedes);
+                    continue;
+                }
+
+                if (live.inUse) {
+                    removeLiveSlot(index);
+                }
+                if (master.inUse) {
+                    live = master;
+                    liveSlotsByFiledes[live.resource.filedes].push_back(index);
+                    ++numLiveResources;
+                    filedesToWatch.push_back(live.resource.filedes);
+                }
+            }
+            changedSlots.clear();
+        }
+
+        sort(filedesToWatch.begin(), filedesToWatch.end());
+        filedesToWatch.erase(unique(filedesToWatch.begin(), filedesToWatch.end()),
+                             filedesToWatch.end());
+        for (const auto filedes : filedesToWatch) {
+            watch(filedes);
+        }
+        filedesToWatch.clear();
+    }
+
+    // Returns true if a resource should be disarmed once it has been reported.
+    bool shouldDisarmAfterReporting(const Slot& slot) const noexcept {
+        switch (slot.resource.mode) {
+            case PolledResource::Mode::level:           return false;
+            case PolledResource::Mode::edgeTriggered:   return !multiplexer->supportsEdgeTriggered();
+            case PolledResource::Mode::oneShot:         return true;
+        }
+        // should never get here
+        assert(false);
+        return false;
+    }
+
+    // Disarm a resource, both in our copy and in the master table. This is done before
+    // the callbacks are made so that the delegate may rearm it from within them.
+    void disarm(uint32_t index) {
+        auto& live = liveSlots[index];
+        live.armed = false;
+
+        lock_guard<mutex> lock(resourceLock);
+        auto& master = slots[index];
+        if (master.inUse && master.generation == live.generation) {
+            master.armed = false;
+        }
+    }
+
+	// Add the events for a single resource to the set to be reported. Note that since
+    // the descriptor may be shared by several resources, we only report the events this
+    // one asked for. Returns true if the resource was disarmed.
+	bool addReadyEvents(short revents, uint32_t index) {
+        const auto& slot = liveSlots[index];
+        if (!slot.armed) {
+            return false;
+        }
+
+        const auto& resource = slot.resource;
+        revents &= (eventsFromResourceEvent(resource.event) | POLLERR | POLLHUP);
+        if (!revents) {
+            return false;
+        }
+
+        const bool disarming = shouldDisarmAfterReporting(slot);
+        if (disarming) {
+            disarm(index);
+        }
+
+        PolledEvent ev;
+        ev.resource = &resource;
+        ev.errorHasOccurred = (revents & POLLERR);
+        ev.hasDisconnected = (revents & POLLHUP);
+        ev.readIsReady = (revents & POLLIN);
+        ev.writeIsReady = (revents & POLLOUT);
+        readyEvents.push_back(ev);
+        return disarming;
 	}
 
 	// Handle the results of a poll call. Returns true if we should keep polling and false
 	// if we should exit the main loop.
-	bool handlePollResult(int res,
-                          const vector<struct pollfd>& fds,
-                          const vector<PolledResource>& currentResources)
-    {
+	bool handlePollResult(int res, const vector<ReadyDescriptor>& ready) {
 		// Check for the exceptional conditions.
 		if (res == -1) {
 			assert(errno != 0);
@@ -129,20 +1183,131 @@ struct Poller::Impl {
 			return true;;
 		}
 
-		// Trigger the callbacks.
+		// Trigger the callbacks. The events are collected so that they can be reported
+        // to the delegate together.
 		else {
-			const auto len = fds.size();
-			for (size_t i = 0; i < len; ++i) {
-				triggerCallbacksForResource(fds[i], currentResources[i]);
-			}
+            readyEvents.clear();
+            for (const auto& rd : ready) {
+                if (rd.filedes == waker.filedes()) {
+                    waker.drain();
+                    continue;
+                }
+
+                const auto it = liveSlotsByFiledes.find(rd.filedes);
+                if (it != liveSlotsByFiledes.end()) {
+                    bool disarmed = false;
+                    for (const auto index : it->second) {
+                        disarmed |= addReadyEvents(rd.revents, index);
+                    }
+
+                    // Any resources on the descriptor that did not fire must be rearmed.
+                    if (disarmed) {
+                        watch(rd.filedes);
+                    }
+                }
+            }
+
+            if (!readyEvents.empty()) {
+                fireResourcesAreReady();
+            }
 			return true;
 		}
 	}
 
-	// Wrap any exceptions in a syslog and call the delegate.
-	void firePollerCallback(const function<void(Poller&)>& cb) noexcept {
+    // The current tick of the timer wheel.
+    TimerWheel::tick_t currentTick() const noexcept {
+        const auto elapsed = chrono::steady_clock::now() - timerOrigin;
+        return static_cast<TimerWheel::tick_t>(chrono::duration_cast<milliseconds>(elapsed).count());
+    }
+
+    // The tick at which a timer with the given delay is due. The current time is
+    // rounded up to the next tick, otherwise a timer scheduled part way through a
+    // tick could expire up to a tick before its delay had passed.
+    TimerWheel::tick_t deadlineAfter(milliseconds delay) const noexcept {
+        const auto elapsed = chrono::steady_clock::now() - timerOrigin;
+        const auto ms = chrono::duration_cast<milliseconds>(elapsed);
+        const auto now = static_cast<TimerWheel::tick_t>(ms.count()) + (elapsed > ms ? 1 : 0);
+        return now + static_cast<TimerWheel::tick_t>(delay.count());
+    }
+
+    // Returns true if there are any timers scheduled.
+    bool hasTimers() {
+        lock_guard<mutex> lock(timerLock);
+        return timers.size() > 0;
+    }
+
+    // Returns the poll() timeout needed to wake up in time for the next timer.
+    int timeoutForTimers() {
+        lock_guard<mutex> lock(timerLock);
+        const auto next = timers.nextTick();
+        if (next == numeric_limits<TimerWheel::tick_t>::max()) {
+            return -1;
+        }
+
+        const auto now = currentTick();
+        if (next <= now) {
+            return 0;
+        }
+        return static_cast<int>(min<TimerWheel::tick_t>(next - now, numeric_limits<int>::max()));
+    }
+
+    // Advance the timer wheel and report the timers that have expired. The lock is not
+    // held while the delegate is called, so that it may schedule and cancel timers. A
+    // timer cancelled by an earlier callback in the same pass is not reported.
+    void handleTimers() {
+        {
+            lock_guard<mutex> lock(timerLock);
+            if (timers.size() == 0) {
+                return;
+            }
+            timers.advance(currentTick(), expiredTimers);
+        }
+
+        for (const auto handle : expiredTimers) {
+            PollerTimer timer;
+            {
+                lock_guard<mutex> lock(timerLock);
+                const auto t = timers.find(handle);
+                if (!t) {
+                    continue;
+                }
+                timer = *t;
+                if (timer.period > milliseconds::zero()) {
+                    timers.repeat(handle, static_cast<TimerWheel::tick_t>(timer.period.count()));
+                }
+                else {
+                    timers.remove(handle);
+                }
+            }
+            fireTimerHasExpired(timer);
+        }
+        expiredTimers.clear();
+    }
+
+    // Run the tasks that were posted before we started. Tasks posted by the tasks
+    // themselves are left for the next pass so that they cannot starve the resources.
+    void runTasks() noexcept {
+        auto* const last = tasks.last();
+        if (!last) {
+            return;
+        }
+        while (auto* node = tasks.pop()) {
+            unique_ptr<TaskQueue::Node> guard(node);
+            fireTask(node->task);
+            if (node == last) {
+                break;
+            }
+        }
+    }
+
+	// Wrap any exceptions in a syslog and call the delegate. The callbacks are passed
+    // as pointers to the delegate methods, rather than as std::function objects, so
+    // that dispatching an event is a single virtual call and never allocates.
+    using PollerCallback = void (PollerDelegate::*)(Poller&);
+
+	void firePollerCallback(PollerCallback cb) noexcept {
         try {
-            cb(*parent);
+            (delegate->*cb)(*parent);
         }
         catch (const exception& e) {
             syslog(LOG_ERR, "Error in poller callback, exception=%s", e.what());
@@ -150,61 +1315,127 @@ struct Poller::Impl {
 	}
 
 	inline void fireHasStarted() noexcept {
-        firePollerCallback([&](Poller& p){ delegate->pollerHasStarted(p); });
+        firePollerCallback(&PollerDelegate::pollerHasStarted);
     }
 	inline void fireWillStop() noexcept {
-        firePollerCallback([&](Poller& p) { delegate->pollerWillStop(p); });
+        firePollerCallback(&PollerDelegate::pollerWillStop);
     }
 
-	void fireResourceCallback(const PolledResource& resource,
-                              const function<void(Poller&, const PolledResource&)> cb)& noexcept
-    {
+    void fireResourcesAreReady() noexcept {
+        const auto start = (stats ? steady_clock::now() : steady_clock::time_point());
         try {
-            cb(*parent, resource);
+            delegate->pollerResourcesAreReady(*parent, readyEvents);
         }
         catch (const exception& e) {
-            syslog(LOG_ERR, "Error with poller resource callback, resource=%s, exception=%s",
-                   resource.name.c_str(), e.what());
+            syslog(LOG_ERR, "Error with poller resources callback, exception=%s", e.what());
         }
-	}
+        if (stats) {
+            timeInCallbacks += steady_clock::now() - start;
+            numEvents += readyEvents.size();
+        }
+    }
 
-	inline void fireReadIsReady(const PolledResource& resource) {
-		fireResourceCallback(resource, [&](Poller& p, const PolledResource& r) {
-			delegate->pollerResourceReadIsReady(p, r);
-		});
-	}
+    void fireTask(const function<void()>& task) noexcept {
+        const auto start = (stats ? steady_clock::now() : steady_clock::time_point());
+        try {
+            task();
+        }
+        catch (const exception& e) {
+            syslog(LOG_ERR, "Error in posted task, exception=%s", e.what());
+        }
+        if (stats) {
+            timeInCallbacks += steady_clock::now() - start;
+            ++numEvents;
+        }
+    }
 
-	inline void fireWriteIsReady(const PolledResource& resource) {
-		fireResourceCallback(resource, [&](Poller& p, const PolledResource& r) {
-			delegate->pollerResourceWriteIsReady(p, r);
-		});
-	}
+    void fireTimerHasExpired(const PollerTimer& timer) noexcept {
+        const auto start = (stats ? steady_clock::now() : steady_clock::time_point());
+        try {
+            delegate->pollerTimerHasExpired(*parent, timer);
+        }
+        catch (const exception& e) {
+            syslog(LOG_ERR, "Error with poller timer callback, timer=%s, exception=%s",
+                   timer.name.c_str(), e.what());
+        }
+        if (stats) {
+            const auto latency = steady_clock::now() - start;
+            stats->recordCallback(timer.name, latency);
+            timeInCallbacks += latency;
+            ++numEvents;
+        }
+    }
+};
 
-	inline void fireErrorHasOccurred(const PolledResource& resource) {
-		fireResourceCallback(resource, [&](Poller& p, const PolledResource& r) {
-			delegate->pollerResourceErrorHasOccurred(p, r);
-		});
-	}
 
-	inline void fireHasDisconnected(const PolledResource& resource) {
-		fireResourceCallback(resource, [&](Poller& p, const PolledResource& r) {
-			delegate->pollerResourceHasDisconnected(p, r);
-		});
+///
+/// MARK: PollerDelegate Implementation
+///
+
+namespace {
+	// Wrap any exceptions in a syslog and call the delegate. The callback is passed as
+    // a pointer to the delegate method so that the dispatch never allocates. If the
+    // poller is collecting statistics, the callback is timed.
+    using ResourceCallback = void (PollerDelegate::*)(Poller&, const PolledResource&);
+
+	void fireResourceCallback(PollerDelegate& delegate, Poller& p,
+                              const PolledResource& resource, ResourceCallback cb) noexcept
+    {
+        auto* stats = p.stats();
+        const auto start = (stats ? steady_clock::now() : steady_clock::time_point());
+        try {
+            (delegate.*cb)(p, resource);
+        }
+        catch (const exception& e) {
+            syslog(LOG_ERR, "Error with poller resource callback, resource=%s, exception=%s",
+                   resource.name.c_str(), e.what());
+        }
+        if (stats) {
+            stats->recordCallback(resource.name, steady_clock::now() - start);
+        }
 	}
-};
+}
+
+void PollerDelegate::pollerResourcesAreReady(Poller &p, const vector<PolledEvent> &events) {
+    for (const auto& ev : events) {
+        const auto& resource = *ev.resource;
+        if (ev.errorHasOccurred) {
+            fireResourceCallback(*this, p, resource, &PollerDelegate::pollerResourceErrorHasOccurred);
+        }
+        if (ev.hasDisconnected) {
+            fireResourceCallback(*this, p, resource, &PollerDelegate::pollerResourceHasDisconnected);
+        }
+        if (ev.readIsReady) {
+            fireResourceCallback(*this, p, resource, &PollerDelegate::pollerResourceReadIsReady);
+        }
+        if (ev.writeIsReady) {
+            fireResourceCallback(*this, p, resource, &PollerDelegate::pollerResourceWriteIsReady);
+        }
+    }
+}
 
 
 ///
 /// MARK: Poller Implementation
 ///
 
-Poller::Poller() : _impl(new Impl()) {
+constexpr Poller::handle_t Poller::invalidHandle;
+
+Poller::Poller() : Poller(Engine::automatic) {
+}
+
+Poller::Poller(Engine engine) : _impl(new Impl()) {
 	_impl->parent = this;
+    _impl->engine = resolveEngine(engine);
+    _impl->multiplexer = makeMultiplexer(_impl->engine);
+    _impl->multiplexer->watch(_impl->waker.filedes(), POLLIN, PolledResource::Mode::level);
 
     contract::postconditions({
         KSS_EXPR(_impl->parent == this),
         KSS_EXPR(_impl->delegate == nullptr),
-        KSS_EXPR(_impl->resources.empty()),
+        KSS_EXPR(_impl->engine != Engine::automatic),
+        KSS_EXPR(_impl->multiplexer != nullptr),
+        KSS_EXPR(_impl->numResources == 0),
         KSS_EXPR(_impl->resourcesHaveChanged == false)
     });
 }
@@ -250,21 +1481,59 @@ void Poller::setDelegate(kss::io::PollerDelegate *delegate) noexcept {
     });
 }
 
+Poller::Engine Poller::engine() const noexcept {
+    return _impl->engine;
+}
+
+void Poller::setStats(PollerStats* stats) noexcept {
+    _impl->stats = stats;
+}
+
+PollerStats* Poller::stats() const noexcept {
+    return _impl->stats;
+}
+
+
+size_t Poller::size() const {
+    lock_guard<mutex> lock(_impl->resourceLock);
+    return _impl->numResources;
+}
+
 
-void Poller::add(const kss::io::PolledResource &resource) {
+Poller::handle_t Poller::add(const kss::io::PolledResource &resource) {
     contract::preconditions({
         KSS_EXPR(_impl->parent == this)
     });
 
     lock_guard<mutex> lock(_impl->resourceLock);
-    _impl->resources.push_back(resource);
-    _impl->resourcesHaveChanged = true;
+    const auto handle = _impl->addSlot(resource);
+    _impl->wakeup();
 
     contract::postconditions({
         KSS_EXPR(_impl->parent == this),
-        KSS_EXPR(!_impl->resources.empty()),
+        KSS_EXPR(handle != invalidHandle),
+        KSS_EXPR(_impl->numResources > 0),
         KSS_EXPR(_impl->resourcesHaveChanged == true)
     });
+    return handle;
+}
+
+
+void Poller::remove(handle_t handle) {
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    lock_guard<mutex> lock(_impl->resourceLock);
+    if (_impl->findSlot(handle)) {
+        _impl->removeSlot(indexFromHandle(handle));
+        _impl->wakeup();
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_impl->parent == this),
+        KSS_EXPR(_impl->findSlot(handle) == nullptr)
+    });
 }
 
 
@@ -274,13 +1543,55 @@ void Poller::remove(const string &resourceName) {
     });
 
     lock_guard<mutex> lock(_impl->resourceLock);
-    const auto n = _impl->resources.size();
-    eraseIf(_impl->resources, [&](const PolledResource& resource) {
-        return (resource.name == resourceName);
+    const auto it = _impl->slotsByName.find(resourceName);
+    if (it != _impl->slotsByName.end()) {
+        // Removing the last slot of the group will also remove the group, so we
+        // need to work on a copy.
+        const auto indices = it->second;
+        for (const auto index : indices) {
+            _impl->removeSlot(index);
+        }
+        _impl->wakeup();
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_impl->parent == this),
+        KSS_EXPR(_impl->slotsByName.find(resourceName) == _impl->slotsByName.end())
+    });
+}
+
+
+void Poller::rearm(handle_t handle) {
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    lock_guard<mutex> lock(_impl->resourceLock);
+    if (_impl->findSlot(handle) && _impl->rearmSlot(indexFromHandle(handle))) {
+        _impl->wakeup();
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_impl->parent == this)
     });
+}
+
 
-    if (_impl->resources.size() != n) {
-        _impl->resourcesHaveChanged = true;
+void Poller::rearm(const string &resourceName) {
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    lock_guard<mutex> lock(_impl->resourceLock);
+    const auto it = _impl->slotsByName.find(resourceName);
+    if (it != _impl->slotsByName.end()) {
+        bool rearmed = false;
+        for (const auto index : it->second) {
+            rearmed |= _impl->rearmSlot(index);
+        }
+        if (rearmed) {
+            _impl->wakeup();
+        }
     }
 
     contract::postconditions({
@@ -295,16 +1606,80 @@ void Poller::removeAll() {
     });
 
 	lock_guard<mutex> lock(_impl->resourceLock);
-	_impl->resources.clear();
+    const auto len = _impl->slots.size();
+    for (size_t index = 0; index < len; ++index) {
+        if (_impl->slots[index].inUse) {
+            _impl->removeSlot(static_cast<uint32_t>(index));
+        }
+    }
 	_impl->resourcesHaveChanged = true;
+    _impl->wakeup();
 
     contract::postconditions({
         KSS_EXPR(_impl->parent == this),
-        KSS_EXPR(_impl->resources.empty()),
+        KSS_EXPR(_impl->numResources == 0),
+        KSS_EXPR(_impl->slotsByName.empty()),
         KSS_EXPR(_impl->resourcesHaveChanged == true)
     });
 }
 
+Poller::handle_t Poller::schedule(const PollerTimer &timer) {
+    contract::parameters({
+        KSS_EXPR(timer.delay >= milliseconds::zero()),
+        KSS_EXPR(timer.period >= milliseconds::zero())
+    });
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    lock_guard<mutex> lock(_impl->timerLock);
+    const auto handle = _impl->timers.add(timer, _impl->deadlineAfter(timer.delay));
+    _impl->wakeup();
+
+    contract::postconditions({
+        KSS_EXPR(_impl->parent == this),
+        KSS_EXPR(handle != invalidHandle),
+        KSS_EXPR(_impl->timers.size() > 0)
+    });
+    return handle;
+}
+
+
+void Poller::cancel(handle_t timer) {
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    lock_guard<mutex> lock(_impl->timerLock);
+    _impl->timers.remove(timer);
+
+    contract::postconditions({
+        KSS_EXPR(_impl->parent == this),
+        KSS_EXPR(_impl->timers.find(timer) == nullptr)
+    });
+}
+
+
+void Poller::post(function<void()> task) {
+    contract::parameters({
+        KSS_EXPR(bool(task))
+    });
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    unique_ptr<TaskQueue::Node> node(new TaskQueue::Node());
+    node->task = move(task);
+    _impl->tasks.push(node.release());
+    _impl->wakeup();
+}
+
+
+void Poller::wakeup() noexcept {
+    _impl->wakeup();
+}
+
+
 void Poller::run() {
     contract::preconditions({
         KSS_EXPR(_impl->parent == this)
@@ -313,57 +1688,49 @@ void Poller::run() {
 	if (!_impl->delegate) {
 		throw runtime_error("No delegate has been assigned.");
 	}
+    _impl->runThread = this_thread::get_id();
+    Finally cleanup([&]{ _impl->runThread = thread::id(); });
 	_impl->fireHasStarted();
 
-	vector<struct pollfd> fds;
-	vector<PolledResource> currentResources;
-
+	vector<ReadyDescriptor> ready;
 	while (!_impl->delegate->pollerShouldStop()) {
 
-		// If our current resources are out of date, we need to update them now.
-		if (_impl->resourcesHaveChanged) {
-			{
-				lock_guard<mutex> lock(_impl->resourceLock);
-				currentResources = _impl->resources;
-				_impl->resourcesHaveChanged = false;
-			}
-
-			fds.resize(currentResources.size());
-			const auto len = currentResources.size();
-			for (size_t i = 0; i < len; ++i) {
-				const auto& r = currentResources[i];
-				fds[i].fd = r.filedes;
-				fds[i].events = eventsFromResourceEvent(r.event);
-			}
-		}
-
-		// Setup for the poll call. Note that if there are no resources to examine,
-		// we exit the loop.
-		if (fds.empty()) {
+		// If our current resources are out of date, we need to update them now. Note
+        // that if there are no resources to examine, timers to wait for, or tasks to
+        // run, we exit the loop.
+        _impl->refreshLiveResourcesIfNecessary();
+        const bool hasTasks = _impl->tasks.mayHaveNodes();
+		if (_impl->numLiveResources == 0 && !_impl->hasTimers() && !hasTasks) {
 			break;
 		}
-		else {
-			for (auto& fd : fds) {
-				fd.revents = 0;
-			}
-		}
 
-		// There is a possibility that the user may have attempted to add more resources to
-		// monitor than possible file descriptors. This could lead to a potential security
-		// issue so we explicitly check for that condition and throw an exception.
-		if (fds.size() > numeric_limits<nfds_t>::max()) {
-			throw runtime_error("Too many resources have been added. "
-                                "This could represent an attempt to cause "
-                                "an overflow or underflow.");
-		}
-		const auto fdsize = static_cast<nfds_t>(fds.size());
-
-		// Execute the poll and examine the results.
-		errno = 0;
-		const auto res = poll(fds.data(), fdsize, timeoutFromInterval(_impl->delegate->pollerMaximumWaitInterval()));
-		if (!_impl->handlePollResult(res, fds, currentResources)) {
+		// Execute the poll and examine the results. Resources may have been added or
+        // removed while we were waiting, so we check again before triggering the callbacks.
+        // The wait is cut short if a timer is due before the maximum wait interval, and
+        // skipped if there are tasks waiting, since tasks posted from within run() do
+        // not trigger a wakeup.
+        ready.clear();
+        const auto timeout = (hasTasks ? 0
+                              : earliestTimeout(timeoutFromInterval(_impl->delegate->pollerMaximumWaitInterval()),
+                                                _impl->timeoutForTimers()));
+        auto* stats = _impl->stats;
+        const auto waitStart = (stats ? steady_clock::now() : steady_clock::time_point());
+		const auto res = _impl->multiplexer->wait(timeout, ready);
+        const auto waitEnd = (stats ? steady_clock::now() : steady_clock::time_point());
+        if (res > 0) {
+            _impl->refreshLiveResourcesIfNecessary();
+        }
+		if (!_impl->handlePollResult(res, ready)) {
 			break;
 		}
+        _impl->handleTimers();
+        _impl->runTasks();
+
+        if (stats) {
+            stats->recordWakeup(waitEnd - waitStart, _impl->timeInCallbacks, _impl->numEvents);
+            _impl->timeInCallbacks = nanoseconds::zero();
+            _impl->numEvents = 0;
+        }
 	}
 
 	_impl->fireWillStop();
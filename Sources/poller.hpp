@@ -11,8 +11,13 @@
 #define kssio_poller_hpp
 
 #include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "poller_stats.hpp"
 
 namespace kss {
     namespace io {
@@ -25,6 +30,11 @@ namespace kss {
          */
         struct PolledResource {
 
+            /*!
+             An opaque value identifying a resource that has been added to a poller.
+             */
+            using handle_t = uint64_t;
+
             /*!
              This enumeration is used to describe what type of events we are interested
              in for a given resource.
@@ -35,10 +45,55 @@ namespace kss {
                 any					//!< We want to know when we can read or write.
             };
 
+            /*!
+             This enumeration is used to describe how often we are told about an event.
+             Resources that share a file descriptor must all use the same mode.
+             */
+            enum class Mode {
+                level,              //!< Report the event for as long as the resource is ready.
+                edgeTriggered,      //!< Report the event only when the resource becomes ready.
+                oneShot             //!< Report one event, then ignore the resource until rearmed.
+            };
+
             std::string	name;					///< A name used to identify the resource.
             int			filedes { 0 };			///< The resource file descriptor.
             Event		event;					///< The type of events we wish to monitor.
+            Mode        mode { Mode::level };   ///< How often we wish to be told about the events.
             void*		payload { nullptr };	///< An optional pointer to be passed with the resource record.
+            handle_t    handle { 0 };           ///< Assigned by Poller::add(). Any value passed to add() is ignored.
+        };
+
+
+        /*!
+         This structure is used to describe the events that have occurred on a
+         resource. It is passed to PollerDelegate::pollerResourcesAreReady().
+         */
+        struct PolledEvent {
+            const PolledResource*   resource { nullptr };           ///< The resource the events occurred on.
+            bool                    readIsReady { false };          ///< The resource is available for reading.
+            bool                    writeIsReady { false };         ///< The resource is available for writing.
+            bool                    errorHasOccurred { false };     ///< An error has occurred on the resource.
+            bool                    hasDisconnected { false };      ///< The resource has disconnected.
+        };
+
+
+        /*!
+         This structure is used to describe a timer to be run by a Poller. Timers are
+         run by the same thread as the resource callbacks, so no locking is needed
+         between the two.
+         */
+        struct PollerTimer {
+
+            /*!
+             An opaque value identifying a timer that has been scheduled.
+             */
+            using handle_t = uint64_t;
+
+            std::string                 name;                   ///< Used for logging and identification.
+            std::chrono::milliseconds   delay;                  ///< The time until the first expiration.
+            std::chrono::milliseconds   period { 0 };           ///< If non-zero, the timer repeats at this interval.
+            void*                       payload { nullptr };    ///< An optional pointer to be passed with the timer.
+            handle_t                    handle { 0 };           ///< Assigned by Poller::schedule(). Any value passed to it is ignored.
         };
 
 
@@ -64,11 +119,17 @@ namespace kss {
 
             /*!
              Returns the maximum time duration that each call to the internal poll
-             (or select) call should wait before returning a result. The smaller the
-             value, the more responsive the system is to stopping and to monitored
-             resources being added and removed. However the smaller the value is the
-             closer Poller::run() is to a "busy wait." For most applications the
-             default given here (100ms) is likely a fairly good value.
+             (or select) call should wait before returning a result. Adding, removing
+             and rearming resources, as well as Poller::wakeup(), interrupt the wait
+             immediately, so this value only matters if pollerShouldStop() can change
+             without Poller::wakeup() being called. The smaller the value, the more
+             responsive the system is to such a change. However the smaller the value
+             is the closer Poller::run() is to a "busy wait." For most applications the
+             default given here (100ms) is likely a fairly good value, and applications
+             that always call Poller::wakeup() can safely return milliseconds::max().
+
+             If timers have been scheduled, the wait will be shortened as needed so
+             that they expire on time. Hence this value need not be related to them.
 
              Although it probably isn't a great idea, this method can return different
              values at different times. The new value will come into effect the next
@@ -100,6 +161,20 @@ namespace kss {
              */
             virtual void pollerWillStop(Poller& p) {}
 
+            /*!
+             Called once for each pass of Poller::run() in which resources are ready,
+             with the events for all of them. Delegates that can handle the events
+             together, say with one batched write flush or one lock acquisition, should
+             override this method. The default implementation calls the individual
+             callbacks below for each event, in the same order that they are described.
+             If this method is overridden, the individual callbacks are not called.
+
+             Note that the events, and the resources they point to, are only valid for
+             the duration of the call. Resources added, removed or rearmed from within
+             the call take effect on the next pass.
+             */
+            virtual void pollerResourcesAreReady(Poller& p, const std::vector<PolledEvent>& events);
+
             /*!
              Called when a resource is available for reading.
              */
@@ -125,20 +200,44 @@ namespace kss {
              */
             virtual void pollerResourceHasDisconnected(Poller& p,
                                                        const PolledResource& resource) {}
+
+            /*!
+             Called when a timer has expired. A periodic timer will already have been
+             rescheduled, so it may be cancelled from within this callback.
+             */
+            virtual void pollerTimerHasExpired(Poller& p, const PollerTimer& timer) {}
         };
 
 
         /*!
          This class is used to provide multiplexed reading and writing to IO devices.
-         It is essentially a wrapper around the poll method, but you shouldn't depend
-         on that. (It would be possible to provide an implementation based on select
-         if necessary, but at present poll is available on all the architectures that
-         are of interest to me.)
+         It is essentially a wrapper around an operating system event mechanism, but
+         you shouldn't depend on which one. On Linux the default is epoll, which only
+         reports the descriptors that are actually ready. On other architectures, or
+         when explicitly requested, it falls back to the portable poll method.
          */
         class Poller final {
         public:
 
+            /*!
+             The mechanism used to wait for the resources.
+             */
+            enum class Engine {
+                automatic,          //!< Use the best engine available on this platform.
+                poll,               //!< Use poll(). Available on all platforms.
+                epoll               //!< Use epoll(). Only available on Linux.
+            };
+
+            /*!
+             Construct a poller. The default constructor is the same as specifying
+             Engine::automatic.
+
+             @throws std::invalid_argument if the requested engine is not available on
+                this platform.
+             @throws std::system_error if the engine could not be created.
+             */
             Poller();
+            explicit Poller(Engine engine);
             ~Poller() noexcept;
 
 
@@ -148,6 +247,14 @@ namespace kss {
             Poller(const Poller&) = delete;
             Poller& operator=(const Poller&) = delete;
 
+            /*!
+             Handles identify the individual resources. Handles are not reused, so
+             a handle to a resource that has been removed is simply ignored. No valid
+             handle is ever equal to invalidHandle.
+             */
+            using handle_t = PolledResource::handle_t;
+            static constexpr handle_t invalidHandle = 0;
+
             /*!
              Set the delegate. This needs to be done before run() is called. If called
              while run() is still executing, undefined behaviour could result.
@@ -158,53 +265,168 @@ namespace kss {
              */
             void setDelegate(PollerDelegate* delegate) noexcept;
 
+            /*!
+             Returns the engine actually used by this poller. This will never be
+             Engine::automatic.
+             */
+            Engine engine() const noexcept;
+
+            /*!
+             Enable the collection of statistics about the main loop. This needs to be
+             done before run() is called, and the statistics object must remain valid
+             throughout the life of the poller, or until setStats(nullptr) is called
+             while run() is not executing. A statistics object should only be given to one
+             poller at a time. Statistics are not collected by default, in which case
+             the only overhead is a few pointer comparisons per pass of run().
+             */
+            void setStats(PollerStats* stats) noexcept;
+
+            /*!
+             Returns the statistics object given to setStats(), or nullptr if statistics
+             are not being collected.
+             */
+            PollerStats* stats() const noexcept;
+
+            /*!
+             Returns the number of resources being monitored. This may be called from
+             any thread, although the value may be out of date by the time it is used.
+
+             @throws any exception that std::mutex handling can cause.
+             */
+            size_t size() const;
+
             /*!
              Add a resource to be monitored. If called while run() is still executing,
-             the change will not take place until the internal poll completes and
-             is called again. Note that the resources names are really for information
+             the internal poll is interrupted so that the change takes place right
+             away. Note that the resources names are really for information
              only and they need not be unique if you really don't care to distinguish
              one from the other. (Or if you wanted to group them by some sort of
              class criteria.)
 
+             @return a handle that identifies this resource. The same value is passed
+                to the delegate callbacks in PolledResource::handle.
              @throws any exception that std::mutex handling can cause.
              @throws any exception that std::vector insertion may throw.
+             @throws std::invalid_argument if the resource shares a file descriptor with
+                an existing resource that uses a different mode.
              */
-            void add(const PolledResource& resource);
+            handle_t add(const PolledResource& resource);
 
             /*!
-             Remove the resource of the given name from being monitored. If called while
-             run() is still executing, the change will not take place until the internal
-             poll call completes and is called again. Note that removing a resource
-             that does not exist is not an error, it just does nothing.
+             Remove a resource from being monitored. If called while run() is still
+             executing, the internal poll is interrupted so that the change takes place
+             right away. Note that removing a resource that does not exist is not an
+             error, it just does nothing.
 
-             If the resource names are not unique, then remove will remove all the
-             resource settings of the given name. If desired you could use this to
-             group resources by some sort of class criteria.
+             Removing by handle takes constant time and removes exactly one resource.
+             Removing by name removes all the resources of the given name, taking time
+             proportional to their number. If desired you could use this to group
+             resources by some sort of class criteria.
 
              @throws any exception that std::mutex handling can cause.
              */
+            void remove(handle_t handle);
             void remove(const std::string& resourceName);
 
+            /*!
+             Rearm the resource with the given handle, or all the resources of the
+             given name. This is used with resources that are not level triggered.
+
+             A PolledResource::Mode::oneShot resource stops being monitored as soon as
+             one of its callbacks has been called. Calling rearm() will start monitoring
+             it again. This is typically done once the delegate has finished handling
+             the event.
+
+             A PolledResource::Mode::edgeTriggered resource is only reported when its
+             state changes, so the delegate should read or write until it would block
+             before expecting another callback. Calling rearm() will report the resource
+             again if it is still ready. Note that the poll engine has no way of seeing
+             state changes, so it treats edge triggered resources as one shot resources.
+             Hence portable code should always call rearm() once it has finished with an
+             edge triggered resource.
+
+             Rearming a level triggered resource, or one that does not exist, does nothing.
+
+             @throws any exception that std::mutex handling can cause.
+             */
+            void rearm(handle_t handle);
+            void rearm(const std::string& resourceName);
+
             /*!
              Remove all the monitored resources. If called while run() is still executing,
-             the change will not take place until the internal poll call completes and
-             is called again. This will also cause run() to exit.
+             the internal poll is interrupted so that the change takes place right
+             away. Unless there are timers scheduled, this will also cause run() to exit.
              */
             void removeAll();
 
+            /*!
+             Schedule a timer. Its expiration will be reported by the delegate's
+             pollerTimerHasExpired() from within run(), after timer.delay has passed and
+             then every timer.period if that is non-zero. Timers have a resolution of
+             one millisecond, and are kept in a hierarchical timer wheel, so scheduling
+             and cancelling take constant time regardless of how many are scheduled.
+             This may be called from any thread, including from within the delegate
+             callbacks.
+
+             @return a handle that identifies this timer. The same value is passed to
+                the delegate in PollerTimer::handle. Timer handles are separate from
+                resource handles and cannot be used with remove() or rearm().
+             @throws std::invalid_argument if timer.delay or timer.period is negative.
+             @throws any exception that std::mutex handling can cause.
+             */
+            handle_t schedule(const PollerTimer& timer);
+
+            /*!
+             Cancel a timer. Cancelling a timer that has already expired (if it is not
+             periodic), or that has already been cancelled, does nothing. Once this
+             returns the timer will not be reported again, even if it has already
+             expired as part of the same pass of run().
+
+             @throws any exception that std::mutex handling can cause.
+             */
+            void cancel(handle_t timer);
+
+            /*!
+             Run a task on the thread running run(). This may be called from any thread,
+             including from within the delegate callbacks. The tasks are queued without
+             locking and the internal poll is interrupted, so that they are run promptly
+             in the order they were posted. They are run after the callbacks for the
+             current pass, so a task never runs in the middle of a batch of events.
+
+             Tasks posted from within a task are run on the next pass, so a task that
+             reposts itself cannot starve the resources. Tasks that are still queued when
+             run() exits are run by the next call to run(), or are discarded, without
+             being run, when the poller is destroyed. Any exception thrown by a task is
+             caught and logged, the same as for the delegate callbacks.
+
+             @throws std::invalid_argument if task is empty.
+             @throws any exception that allocating the queue entry may throw.
+             */
+            void post(std::function<void()> task);
+
+            /*!
+             Interrupt the internal poll, if run() is waiting in it, so that the
+             delegate's pollerShouldStop() is examined right away. The typical use is to
+             set whatever pollerShouldStop() checks and then call wakeup(), which allows
+             the delegate to use an infinite maximum wait interval without delaying the
+             shutdown. This may be called from any thread.
+             */
+            void wakeup() noexcept;
+
             /*!
              Run the poller. This will not exit until one of the following occurs:
 
              - The delegate's pollerShouldStop() returned true and the internal poll
-             was completed either due to a timeout or an event occuring. (In the
-             latter case, the delegate callbacks will be called before pollerShouldStop()
-             will be examined. Assuming that the maximum wait interval is not infinite,
-             this should be the normal exit condition.
-
-             - There are no resources to monitor. This would be unusual, but if you
-             are calling add and remove during the run, it is possible. You would then
-             need to manually determine when to call run again, presumably after
-             adding at least one resource to monitor.
+             was completed either due to a timeout, an event occuring, or a call to
+             wakeup(). (In the case of an event, the delegate callbacks will be called
+             before pollerShouldStop() will be examined.) This should be the normal
+             exit condition.
+
+             - There are no resources to monitor, no timers scheduled and no tasks
+             posted. This would be unusual, but if you are calling add and remove
+             during the run, it is possible. You would then need to manually determine
+             when to call run again, presumably after adding at least one resource to
+             monitor.
 
              - The internal poll call reports an EINTR signal. This would be the case
              if you have your thead configured to be interruptable and it got
@@ -0,0 +1,370 @@
+//
+//  poller_pool.cpp
+//  kssio
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <syslog.h>
+
+#if defined(__linux)
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
+#include <kss/contract/all.h>
+
+#include "poller_pool.hpp"
+
+using namespace std;
+using namespace kss::io;
+
+namespace contract = kss::contract;
+
+using std::chrono::milliseconds;
+
+namespace {
+
+    // A single poller and the thread that runs it. The worker is the delegate of its
+    // poller, passing the callbacks on to the delegate of the pool while also allowing
+    // the pool to stop the poller.
+    class Worker final : public PollerDelegate {
+    public:
+        Worker(Poller::Engine engine, PollerDelegate* const& delegate,
+               const atomic<bool>& stopping)
+        : poller(engine), delegate(delegate), stopping(stopping)
+        {
+            poller.setDelegate(this);
+        }
+
+        Poller                  poller;
+        thread                  th;
+        atomic<bool>            failed { false };
+
+        // Tell the thread that there may be something new to do, in case it is waiting
+        // for resources.
+        void notify() {
+            {
+                lock_guard<mutex> lock(m);
+                hasWork = true;
+            }
+            cv.notify_one();
+            poller.wakeup();
+        }
+
+        // Run the poller until the pool is stopped. The poller's run() will exit if it
+        // runs out of resources, in which case we wait until we are notified that
+        // there are new ones. If run() throws, the worker is marked as failed so that
+        // the pool stops giving it new work.
+        void run() {
+            while (!stopping) {
+                try {
+                    poller.run();
+                }
+                catch (const exception& e) {
+                    syslog(LOG_ERR, "Poller pool thread has failed, exception=%s", e.what());
+                    failed = true;
+                    return;
+                }
+
+                if (stopping || d().pollerShouldStop()) {
+                    break;
+                }
+
+                unique_lock<mutex> lock(m);
+                cv.wait(lock, [&]{ return stopping || hasWork || poller.size() > 0; });
+                hasWork = false;
+            }
+        }
+
+        bool pollerShouldStop() const override {
+            return (stopping || d().pollerShouldStop());
+        }
+
+        milliseconds pollerMaximumWaitInterval() const override {
+            return d().pollerMaximumWaitInterval();
+        }
+
+        void pollerHasStarted(Poller& p) override {
+            d().pollerHasStarted(p);
+        }
+
+        void pollerWillStop(Poller& p) override {
+            d().pollerWillStop(p);
+        }
+
+        void pollerResourcesAreReady(Poller& p, const vector<PolledEvent>& events) override {
+            d().pollerResourcesAreReady(p, events);
+        }
+
+        void pollerResourceReadIsReady(Poller& p, const PolledResource& resource) override {
+            d().pollerResourceReadIsReady(p, resource);
+        }
+
+        void pollerResourceWriteIsReady(Poller& p, const PolledResource& resource) override {
+            d().pollerResourceWriteIsReady(p, resource);
+        }
+
+        void pollerResourceErrorHasOccurred(Poller& p, const PolledResource& resource) override {
+            d().pollerResourceErrorHasOccurred(p, resource);
+        }
+
+        void pollerResourceHasDisconnected(Poller& p, const PolledResource& resource) override {
+            d().pollerResourceHasDisconnected(p, resource);
+        }
+
+        void pollerTimerHasExpired(Poller& p, const PollerTimer& timer) override {
+            d().pollerTimerHasExpired(p, timer);
+        }
+
+    private:
+        PollerDelegate* const&          delegate;
+        const atomic<bool>&             stopping;
+        mutex                           m;
+        condition_variable              cv;
+        bool                            hasWork { false };
+
+        // The pool's delegate. The pool will not start without one.
+        PollerDelegate& d() const noexcept {
+            assert(delegate != nullptr);
+            return *delegate;
+        }
+    };
+
+    // Pin a thread to a CPU.
+    void pinThread(thread& th, int cpu) {
+#if defined(__linux)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        const auto err = pthread_setaffinity_np(th.native_handle(), sizeof(set), &set);
+        if (err != 0) {
+            throw system_error(err, system_category(), "pthread_setaffinity_np");
+        }
+#else
+        // Thread affinity is not supported, so we quietly ignore the request.
+        (void)th;
+        (void)cpu;
+#endif
+    }
+}
+
+
+struct PollerPool::Impl {
+    PollerPool*                 parent = nullptr;
+    PollerDelegate*             delegate = nullptr;
+    Distribution                distribution = Distribution::roundRobin;
+    vector<unique_ptr<Worker>>  workers;
+    vector<int>                 cpus;
+    atomic<size_t>              nextWorker { 0 };
+    atomic<bool>                stopping { false };
+    bool                        running = false;
+
+    Worker& worker(size_t i) {
+        if (i >= workers.size()) {
+            throw out_of_range("Poller " + to_string(i) + " is not in the pool.");
+        }
+        return *workers[i];
+    }
+
+    // Choose the worker for a new resource, skipping any that have failed.
+    size_t chooseWorker() {
+        if (distribution == Distribution::leastLoaded) {
+            size_t best = workers.size();
+            size_t bestSize = 0;
+            for (size_t i = 0; i < workers.size(); ++i) {
+                if (workers[i]->failed) {
+                    continue;
+                }
+                const auto sz = workers[i]->poller.size();
+                if (best == workers.size() || sz < bestSize) {
+                    best = i;
+                    bestSize = sz;
+                    if (bestSize == 0) {
+                        break;
+                    }
+                }
+            }
+            if (best == workers.size()) {
+                throw runtime_error("All the pollers in the pool have failed.");
+            }
+            return best;
+        }
+        return nextLiveWorker();
+    }
+
+    // Choose the next worker in turn, skipping any that have failed.
+    size_t nextLiveWorker() {
+        for (size_t n = 0; n < workers.size(); ++n) {
+            const auto i = nextWorker++ % workers.size();
+            if (!workers[i]->failed) {
+                return i;
+            }
+        }
+        throw runtime_error("All the pollers in the pool have failed.");
+    }
+};
+
+
+PollerPool::PollerPool(size_t numPollers, Distribution distribution, Poller::Engine engine)
+: _impl(new Impl())
+{
+    if (numPollers == 0) {
+        numPollers = max(thread::hardware_concurrency(), 1U);
+    }
+
+    _impl->parent = this;
+    _impl->distribution = distribution;
+    _impl->workers.reserve(numPollers);
+    for (size_t i = 0; i < numPollers; ++i) {
+        _impl->workers.emplace_back(new Worker(engine, _impl->delegate, _impl->stopping));
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_impl->parent == this),
+        KSS_EXPR(_impl->workers.size() > 0),
+        KSS_EXPR(_impl->running == false)
+    });
+}
+
+PollerPool::~PollerPool() noexcept {
+    stop();
+}
+
+
+void PollerPool::setDelegate(PollerDelegate *delegate) noexcept {
+    _impl->delegate = delegate;
+}
+
+void PollerPool::pinToCpus(const vector<int> &cpus) {
+    contract::parameters({
+        KSS_EXPR(all_of(cpus.begin(), cpus.end(), [](int cpu) { return cpu >= 0; }))
+    });
+    _impl->cpus = cpus;
+}
+
+size_t PollerPool::size() const noexcept {
+    return _impl->workers.size();
+}
+
+bool PollerPool::hasFailed(size_t poller) const {
+    return _impl->worker(poller).failed;
+}
+
+
+PollerPool::Handle PollerPool::add(const PolledResource &resource) {
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    const auto i = _impl->chooseWorker();
+    auto& w = *_impl->workers[i];
+    const Handle handle { i, w.poller.add(resource) };
+    w.notify();
+    return handle;
+}
+
+void PollerPool::remove(const Handle &handle) {
+    _impl->worker(handle.poller).poller.remove(handle.handle);
+}
+
+void PollerPool::remove(const string &resourceName) {
+    for (auto& w : _impl->workers) {
+        w->poller.remove(resourceName);
+    }
+}
+
+void PollerPool::rearm(const Handle &handle) {
+    _impl->worker(handle.poller).poller.rearm(handle.handle);
+}
+
+void PollerPool::rearm(const string &resourceName) {
+    for (auto& w : _impl->workers) {
+        w->poller.rearm(resourceName);
+    }
+}
+
+
+PollerPool::Handle PollerPool::schedule(const PollerTimer &timer) {
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    const auto i = _impl->nextLiveWorker();
+    auto& w = *_impl->workers[i];
+    const Handle handle { i, w.poller.schedule(timer) };
+    w.notify();
+    return handle;
+}
+
+void PollerPool::cancel(const Handle &timer) {
+    _impl->worker(timer.poller).poller.cancel(timer.handle);
+}
+
+
+void PollerPool::start() {
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    if (!_impl->delegate) {
+        throw runtime_error("No delegate has been assigned.");
+    }
+    if (_impl->running) {
+        throw runtime_error("The pool has already been started.");
+    }
+
+    _impl->running = true;
+    _impl->stopping = false;
+    try {
+        const auto& cpus = _impl->cpus;
+        for (size_t i = 0; i < _impl->workers.size(); ++i) {
+            auto& w = *_impl->workers[i];
+            w.failed = false;
+            w.th = thread([&w] { w.run(); });
+            if (!cpus.empty()) {
+                pinThread(w.th, cpus[i % cpus.size()]);
+            }
+        }
+    }
+    catch (...) {
+        stop();
+        throw;
+    }
+
+    contract::postconditions({
+        KSS_EXPR(_impl->parent == this),
+        KSS_EXPR(_impl->running == true)
+    });
+}
+
+void PollerPool::stop() noexcept {
+    if (!_impl || !_impl->running) {
+        return;
+    }
+
+    _impl->stopping = true;
+    for (auto& w : _impl->workers) {
+        w->notify();
+    }
+    for (auto& w : _impl->workers) {
+        if (w->th.joinable()) {
+            w->th.join();
+        }
+    }
+    _impl->running = false;
+    _impl->stopping = false;
+}
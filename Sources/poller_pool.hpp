@@ -0,0 +1,189 @@
+//
+//  poller_pool.hpp
+//  kssio
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#ifndef kssio_poller_pool_hpp
+#define kssio_poller_pool_hpp
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "poller.hpp"
+
+namespace kss {
+    namespace io {
+
+        /*!
+         A pool of pollers, each run by its own thread, used to spread the dispatch of
+         events over several cores. New resources are assigned to one of the pollers,
+         and are then handled entirely by that poller's thread.
+
+         The pool uses a single PollerDelegate for all of its pollers, so existing
+         delegates may be used unchanged, with two differences. First, the callbacks
+         will be made from several threads at once, so the delegate must be thread safe.
+         Second, the Poller passed to the callbacks is the one handling the resource,
+         and it is that poller that should be used to remove or rearm it from within
+         the callbacks.
+
+         The pool does not exit when its pollers run out of resources. Instead the
+         threads wait for new resources until stop() is called. As a result the
+         delegate's pollerHasStarted() and pollerWillStop() may be called several
+         times by each thread.
+         */
+        class PollerPool final {
+        public:
+
+            /*!
+             How new resources are assigned to the pollers.
+             */
+            enum class Distribution {
+                roundRobin,         //!< Assign resources to each poller in turn.
+                leastLoaded         //!< Assign each resource to the poller with the fewest resources.
+            };
+
+            /*!
+             Identifies a resource or timer added to the pool. The poller member is the
+             index of the poller handling it, and handle is the handle returned by that
+             poller's add() or schedule() method.
+             */
+            struct Handle {
+                size_t              poller;
+                Poller::handle_t    handle;
+            };
+
+            /*!
+             Construct a pool. The threads are not started until start() is called.
+
+             @param numPollers the number of pollers, and hence threads, to use. If this
+                is 0 the number of hardware threads will be used.
+             @param distribution how new resources are assigned to the pollers.
+             @param engine the engine used by each of the pollers.
+             @throws std::invalid_argument if the requested engine is not available on
+                this platform.
+             @throws std::system_error if the pollers could not be created.
+             */
+            explicit PollerPool(size_t numPollers = 0,
+                                Distribution distribution = Distribution::roundRobin,
+                                Poller::Engine engine = Poller::Engine::automatic);
+
+            /*!
+             The destructor will call stop() if the pool is still running.
+             */
+            ~PollerPool() noexcept;
+
+            PollerPool(const PollerPool&) = delete;
+            PollerPool& operator=(const PollerPool&) = delete;
+
+            /*!
+             Set the delegate. This needs to be done before start() is called, and the
+             delegate must remain valid throughout the life of the pool. Note that
+             pollerShouldStop() returning true will only stop the poller that called it,
+             so normally the pool should be stopped using stop().
+             */
+            void setDelegate(PollerDelegate* delegate) noexcept;
+
+            /*!
+             Pin the threads to specific CPUs. Thread i will be pinned to
+             cpus[i % cpus.size()]. This needs to be done before start() is called. On
+             platforms that do not support thread affinity this does nothing.
+
+             @throws std::invalid_argument if cpus contains a negative value.
+             */
+            void pinToCpus(const std::vector<int>& cpus);
+
+            /*!
+             Returns the number of pollers in the pool.
+             */
+            size_t size() const noexcept;
+
+            /*!
+             Returns true if the thread running the given poller has failed. This happens
+             when the poller's run() throws an exception, which is also written to the
+             syslog. A failed poller is not given any new resources or timers, and the
+             ones it already has are no longer serviced, so they should be removed and
+             added again to move them to another poller. Restarting the pool clears the
+             failure.
+
+             @throws std::out_of_range if poller is not less than size().
+             */
+            bool hasFailed(size_t poller) const;
+
+            /*!
+             Add a resource to one of the pollers, chosen according to the distribution
+             given to the constructor. Pollers that have failed are skipped. This may be
+             called from any thread, and before or after start().
+
+             @throws std::runtime_error if all the pollers have failed.
+             @throws any exception that Poller::add() may throw.
+             */
+            Handle add(const PolledResource& resource);
+
+            /*!
+             Remove a resource. Removing a resource by name removes the resources of
+             that name from all the pollers.
+
+             @throws std::out_of_range if handle.poller is not less than size().
+             @throws any exception that Poller::remove() may throw.
+             */
+            void remove(const Handle& handle);
+            void remove(const std::string& resourceName);
+
+            /*!
+             Rearm a resource. Rearming a resource by name rearms the resources of that
+             name on all the pollers.
+
+             @throws std::out_of_range if handle.poller is not less than size().
+             @throws any exception that Poller::rearm() may throw.
+             */
+            void rearm(const Handle& handle);
+            void rearm(const std::string& resourceName);
+
+            /*!
+             Schedule a timer on one of the pollers, chosen in turn and skipping any that
+             have failed. Its expiration will be reported from that poller's thread.
+             Note that timers scheduled from within the delegate callbacks using the
+             Poller passed to them will run on that poller's thread.
+
+             @throws std::runtime_error if all the pollers have failed.
+             @throws any exception that Poller::schedule() may throw.
+             */
+            Handle schedule(const PollerTimer& timer);
+
+            /*!
+             Cancel a timer.
+
+             @throws std::out_of_range if timer.poller is not less than size().
+             @throws any exception that Poller::cancel() may throw.
+             */
+            void cancel(const Handle& timer);
+
+            /*!
+             Start the threads. Each thread runs its poller until stop() is called.
+
+             @throws std::runtime_error if no delegate has been assigned or the pool
+                has already been started.
+             @throws std::system_error if a thread could not be created or pinned.
+             */
+            void start();
+
+            /*!
+             Stop the threads, waiting for them to exit. Calling stop() on a pool that
+             is not running does nothing. Once stopped, the pool may be started again.
+             This must not be called from within the delegate callbacks.
+             */
+            void stop() noexcept;
+
+        private:
+            struct Impl;
+            std::unique_ptr<Impl> _impl;
+        };
+    }
+}
+
+#endif
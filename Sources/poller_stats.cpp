@@ -0,0 +1,280 @@
+//
+//  poller_stats.cpp
+//  kssio
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <kss/contract/all.h>
+
+#include "poller_stats.hpp"
+
+using namespace std;
+using namespace kss::io;
+
+namespace contract = kss::contract;
+
+using std::chrono::nanoseconds;
+
+
+///
+/// MARK: Internal Utilities
+///
+
+namespace {
+
+    // The histogram buckets. Values below 16 each have their own bucket. Above that,
+    // each power of two is divided into 16 buckets, so that the width of a bucket is
+    // never more than 1/16 of the values it contains.
+    constexpr unsigned subBucketBits = 4;
+    constexpr unsigned subBuckets = 1U << subBucketBits;
+    constexpr size_t numBuckets = subBuckets + (64 - subBucketBits) * subBuckets;
+
+    inline size_t bucketFromValue(uint64_t value) noexcept {
+        if (value < subBuckets) {
+            return static_cast<size_t>(value);
+        }
+        const unsigned exponent = 63U - static_cast<unsigned>(__builtin_clzll(value));
+        const unsigned shift = exponent - subBucketBits;
+        return subBuckets + shift * subBuckets + ((value >> shift) & (subBuckets - 1));
+    }
+
+    inline uint64_t lowestValueInBucket(size_t bucket) noexcept {
+        if (bucket < subBuckets) {
+            return bucket;
+        }
+        const auto shift = (bucket - subBuckets) / subBuckets;
+        const auto sub = (bucket - subBuckets) % subBuckets;
+        return (subBuckets + sub) << shift;
+    }
+
+    inline uint64_t highestValueInBucket(size_t bucket) noexcept {
+        if (bucket < subBuckets) {
+            return bucket;
+        }
+        const auto shift = (bucket - subBuckets) / subBuckets;
+        return lowestValueInBucket(bucket) + ((uint64_t(1) << shift) - 1);
+    }
+
+    inline uint64_t toCount(nanoseconds ns) noexcept {
+        return ns.count() > 0 ? static_cast<uint64_t>(ns.count()) : 0;
+    }
+
+    inline int64_t now() noexcept {
+        return chrono::duration_cast<nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // The slowest callback for a name. These form a list that is only ever added to,
+    // at its head, by the writing thread, so that it may be read without locking.
+    // A name is never changed once its entry has been published.
+    struct NameEntry {
+        const string            name;
+        atomic<uint64_t>        slowest { 0 };
+        NameEntry*              next { nullptr };
+
+        explicit NameEntry(const string& n) : name(n) {}
+    };
+}
+
+
+///
+/// MARK: PollerStats Implementation
+///
+
+struct PollerStats::Impl {
+    // Everything read by other threads is atomic. Since there is only one writer, the
+    // counters are updated with a relaxed load and store rather than a locked
+    // read-modify-write.
+    atomic<int64_t>                         start { now() };
+    atomic<uint64_t>                        wakeups { 0 };
+    atomic<uint64_t>                        events { 0 };
+    atomic<uint64_t>                        timeInPoll { 0 };
+    atomic<uint64_t>                        timeInCallbacks { 0 };
+    atomic<uint64_t>                        callbacks { 0 };
+    array<atomic<uint64_t>, numBuckets>     histogram;
+    atomic<NameEntry*>                      names { nullptr };
+
+    // Only used by the writing thread.
+    unordered_map<string, NameEntry*>       entriesByName;
+
+    Impl() {
+        for (auto& count : histogram) {
+            count.store(0, memory_order_relaxed);
+        }
+    }
+
+    ~Impl() noexcept {
+        auto* entry = names.load();
+        while (entry) {
+            auto* next = entry->next;
+            delete entry;
+            entry = next;
+        }
+    }
+
+    static inline void add(atomic<uint64_t>& counter, uint64_t value) noexcept {
+        counter.store(counter.load(memory_order_relaxed) + value, memory_order_relaxed);
+    }
+
+    // Returns the entry for a name, creating it if necessary, or nullptr if it could
+    // not be created.
+    NameEntry* entryForName(const string& name) noexcept {
+        try {
+            const auto it = entriesByName.find(name);
+            if (it != entriesByName.end()) {
+                return it->second;
+            }
+
+            unique_ptr<NameEntry> entry(new NameEntry(name));
+            entriesByName[name] = entry.get();
+            entry->next = names.load(memory_order_relaxed);
+            names.store(entry.get(), memory_order_release);
+            return entry.release();
+        }
+        catch (const exception&) {
+            return nullptr;
+        }
+    }
+};
+
+PollerStats::PollerStats() : _impl(new Impl()) {
+}
+
+PollerStats::~PollerStats() noexcept = default;
+
+
+uint64_t PollerStats::wakeups() const noexcept {
+    return _impl->wakeups.load(memory_order_relaxed);
+}
+
+uint64_t PollerStats::events() const noexcept {
+    return _impl->events.load(memory_order_relaxed);
+}
+
+double PollerStats::wakeupsPerSecond() const noexcept {
+    const auto elapsed = now() - _impl->start.load(memory_order_relaxed);
+    if (elapsed <= 0) {
+        return 0.;
+    }
+    return double(wakeups()) * 1e9 / double(elapsed);
+}
+
+double PollerStats::eventsPerWakeup() const noexcept {
+    const auto w = wakeups();
+    return (w == 0 ? 0. : double(events()) / double(w));
+}
+
+nanoseconds PollerStats::timeInPoll() const noexcept {
+    return nanoseconds(_impl->timeInPoll.load(memory_order_relaxed));
+}
+
+nanoseconds PollerStats::timeInCallbacks() const noexcept {
+    return nanoseconds(_impl->timeInCallbacks.load(memory_order_relaxed));
+}
+
+uint64_t PollerStats::callbacks() const noexcept {
+    return _impl->callbacks.load(memory_order_relaxed);
+}
+
+
+nanoseconds PollerStats::callbackLatencyAtPercentile(double percentile) const {
+    contract::parameters({
+        KSS_EXPR(percentile >= 0. && percentile <= 100.)
+    });
+
+    // The total is taken from the histogram itself, rather than callbacks(), so that
+    // it is consistent with the counts we walk through.
+    uint64_t total = 0;
+    for (const auto& count : _impl->histogram) {
+        total += count.load(memory_order_relaxed);
+    }
+    if (total == 0) {
+        return nanoseconds::zero();
+    }
+
+    const auto target = max<uint64_t>(1, static_cast<uint64_t>(ceil(percentile / 100. * double(total))));
+    uint64_t seen = 0;
+    size_t last = 0;
+    for (size_t bucket = 0; bucket < numBuckets; ++bucket) {
+        const auto count = _impl->histogram[bucket].load(memory_order_relaxed);
+        if (count > 0) {
+            last = bucket;
+            seen += count;
+            if (seen >= target) {
+                break;
+            }
+        }
+    }
+    return nanoseconds(static_cast<nanoseconds::rep>(highestValueInBucket(last)));
+}
+
+vector<pair<nanoseconds, uint64_t>> PollerStats::callbackLatencyHistogram() const {
+    vector<pair<nanoseconds, uint64_t>> buckets;
+    for (size_t bucket = 0; bucket < numBuckets; ++bucket) {
+        const auto count = _impl->histogram[bucket].load(memory_order_relaxed);
+        if (count > 0) {
+            const auto lowest = static_cast<nanoseconds::rep>(lowestValueInBucket(bucket));
+            buckets.emplace_back(nanoseconds(lowest), count);
+        }
+    }
+    return buckets;
+}
+
+vector<pair<string, nanoseconds>> PollerStats::slowestCallbacks() const {
+    vector<pair<string, nanoseconds>> slowest;
+    for (auto* entry = _impl->names.load(memory_order_acquire); entry; entry = entry->next) {
+        const auto latency = static_cast<nanoseconds::rep>(entry->slowest.load(memory_order_relaxed));
+        slowest.emplace_back(entry->name, nanoseconds(latency));
+    }
+    sort(slowest.begin(), slowest.end(), [](const auto& a, const auto& b) {
+        return a.second > b.second;
+    });
+    return slowest;
+}
+
+
+void PollerStats::reset() noexcept {
+    _impl->wakeups.store(0, memory_order_relaxed);
+    _impl->events.store(0, memory_order_relaxed);
+    _impl->timeInPoll.store(0, memory_order_relaxed);
+    _impl->timeInCallbacks.store(0, memory_order_relaxed);
+    _impl->callbacks.store(0, memory_order_relaxed);
+    for (auto& count : _impl->histogram) {
+        count.store(0, memory_order_relaxed);
+    }
+    for (auto* entry = _impl->names.load(memory_order_acquire); entry; entry = entry->next) {
+        entry->slowest.store(0, memory_order_relaxed);
+    }
+    _impl->start.store(now(), memory_order_relaxed);
+}
+
+
+void PollerStats::recordCallback(const string& name, nanoseconds latency) noexcept {
+    const auto value = toCount(latency);
+    Impl::add(_impl->callbacks, 1);
+    Impl::add(_impl->histogram[bucketFromValue(value)], 1);
+
+    auto* entry = _impl->entryForName(name);
+    if (entry && value > entry->slowest.load(memory_order_relaxed)) {
+        entry->slowest.store(value, memory_order_relaxed);
+    }
+}
+
+void PollerStats::recordWakeup(nanoseconds timeInPoll, nanoseconds timeInCallbacks,
+                               size_t numEvents) noexcept
+{
+    Impl::add(_impl->wakeups, 1);
+    Impl::add(_impl->events, numEvents);
+    Impl::add(_impl->timeInPoll, toCount(timeInPoll));
+    Impl::add(_impl->timeInCallbacks, toCount(timeInCallbacks));
+}
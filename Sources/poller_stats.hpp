@@ -0,0 +1,148 @@
+//
+//  poller_stats.hpp
+//  kssio
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#ifndef kssio_poller_stats_hpp
+#define kssio_poller_stats_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace kss {
+    namespace io {
+
+        /*!
+         This class collects statistics about the main loop of a Poller, which can be
+         used to tell if the poller is overloaded. It is enabled by passing it to
+         Poller::setStats().
+
+         The statistics are only written by the thread running Poller::run(), but may be
+         read at any time, from any thread, without locking. Since the values are read
+         individually they may not be exactly consistent with each other, although each
+         one will be correct on its own.
+
+         Callback latencies are kept in a histogram with logarithmic buckets, each
+         divided into 16 linear sub-buckets, in the style of HdrHistogram. Hence any
+         latency reported from the histogram is within about 6% of the actual value.
+         */
+        class PollerStats final {
+        public:
+            using nanoseconds = std::chrono::nanoseconds;
+
+            PollerStats();
+            ~PollerStats() noexcept;
+
+            PollerStats(const PollerStats&) = delete;
+            PollerStats& operator=(const PollerStats&) = delete;
+
+            /*!
+             Returns the number of times the poller has woken up, whether due to ready
+             resources, expired timers, a call to Poller::wakeup() or a timeout.
+             */
+            uint64_t wakeups() const noexcept;
+
+            /*!
+             Returns the number of events handled by the poller. Each ready resource,
+             each expired timer and each posted task that is run counts as one event.
+             */
+            uint64_t events() const noexcept;
+
+            /*!
+             Returns the number of wakeups per second since the statistics were created
+             or last reset.
+             */
+            double wakeupsPerSecond() const noexcept;
+
+            /*!
+             Returns the average number of events, as counted by events(), handled for
+             each wakeup.
+             */
+            double eventsPerWakeup() const noexcept;
+
+            /*!
+             Returns the total time spent waiting in poll() (or epoll_wait()).
+             */
+            nanoseconds timeInPoll() const noexcept;
+
+            /*!
+             Returns the total time spent in the delegate callbacks and posted tasks. If
+             this approaches the elapsed time the poller has been running, it is
+             overloaded.
+             */
+            nanoseconds timeInCallbacks() const noexcept;
+
+            /*!
+             Returns the number of callbacks recorded by recordCallback().
+             */
+            uint64_t callbacks() const noexcept;
+
+            /*!
+             Returns the callback latency at the given percentile, which must be in the
+             range [0, 100]. The value is the highest latency that falls in the same
+             histogram bucket as the actual value. Returns zero if no callbacks have been
+             recorded.
+
+             @throws std::invalid_argument if percentile is out of range.
+             */
+            nanoseconds callbackLatencyAtPercentile(double percentile) const;
+
+            /*!
+             Returns the non-empty buckets of the callback latency histogram, in order,
+             as pairs of the lowest latency that falls in the bucket and the number of
+             callbacks that fell in it.
+
+             @throws any exception that std::vector may throw.
+             */
+            std::vector<std::pair<nanoseconds, uint64_t>> callbackLatencyHistogram() const;
+
+            /*!
+             Returns the latency of the slowest callback for each resource or timer name,
+             sorted from the slowest to the fastest.
+
+             @throws any exception that std::vector or std::string may throw.
+             */
+            std::vector<std::pair<std::string, nanoseconds>> slowestCallbacks() const;
+
+            /*!
+             Reset the statistics to zero. The names seen by slowestCallbacks() are
+             retained, but with their latencies reset to zero. If this is called while
+             the poller is running, a value that is being updated at the same moment may
+             not be reset.
+             */
+            void reset() noexcept;
+
+            /*!
+             Record a single delegate callback. This is called by the poller for each of
+             the individual resource callbacks made by the default implementation of
+             PollerDelegate::pollerResourcesAreReady(), and for each timer callback. A
+             delegate that overrides pollerResourcesAreReady() may call it to record its
+             own per-resource timings. It must only be called from the thread running
+             Poller::run().
+             */
+            void recordCallback(const std::string& name, nanoseconds latency) noexcept;
+
+            /*!
+             Record a single pass of the poller's main loop. This is called by the poller
+             and should not normally be called directly. It must only be called from the
+             thread running Poller::run().
+             */
+            void recordWakeup(nanoseconds timeInPoll, nanoseconds timeInCallbacks,
+                              size_t numEvents) noexcept;
+
+        private:
+            struct Impl;
+            std::unique_ptr<Impl> _impl;
+        };
+    }
+}
+
+#endif
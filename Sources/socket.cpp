@@ -7,15 +7,21 @@
 //  Licensing follows the MIT License.
 //
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <cstdio>
 #include <cstring>
 #include <system_error>
 
 #include <netdb.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#if defined(__APPLE__)
+#   include <sys/sysctl.h>
+#endif
 #include <kss/contract/all.h>
+#include <kss/util/all.h>
 
 #include "socket.hpp"
 
@@ -24,31 +30,97 @@ using namespace kss::io::net;
 
 namespace contract = kss::contract;
 
+using kss::util::Finally;
+
 
 namespace {
+    // Throw an exception if we do not support the address family.
+    void verifyAddressFamily(const struct sockaddr* addr) {
+        if (addr->sa_family != AF_INET && addr->sa_family != AF_INET6) {
+            throw system_error(EAFNOSUPPORT, system_category(),
+                               "only AF_INET and AF_INET6 are currently supported");
+        }
+    }
+
+    // Attempt to bind to a port, returning 0 if successful or the errno value if not.
+    // Since failing to bind is expected while searching for a port, this does not
+    // throw. The address family must already have been verified.
+    int tryToBind(int sock, int port, struct sockaddr* addr, socklen_t addrLen) noexcept {
+        if (addr->sa_family == AF_INET) {
+            reinterpret_cast<struct sockaddr_in*>(addr)->sin_port = htons(port);
+        }
+        else {
+            reinterpret_cast<struct sockaddr_in6*>(addr)->sin6_port = htons(port);
+        }
+        return (::bind(sock, addr, addrLen) == -1 ? errno : 0);
+    }
+
     // Attempt to bind to a port. If successful we return the port number, otherwise
     // we throw an exception.
     int attemptToBind(int sock, int port, struct sockaddr* addr, socklen_t addrLen) {
-        switch (addr->sa_family) {
-            case AF_INET: {
-                struct sockaddr_in* a = reinterpret_cast<struct sockaddr_in*>(addr);
-                a->sin_port = htons(port);
-                break;
-            }
-            case AF_INET6: {
-                struct sockaddr_in6* a = reinterpret_cast<struct sockaddr_in6*>(addr);
-                a->sin6_port = htons(port);
-                break;
-            }
-            default:
-                throw system_error(EAFNOSUPPORT, system_category(),
-                                   "only AF_INET and AF_INET6 are currently supported");
+        verifyAddressFamily(addr);
+        const int err = tryToBind(sock, port, addr, addrLen);
+        if (err != 0) {
+            throw system_error(err, system_category(), "bind");
         }
+        return port;
+    }
 
-        if (::bind(sock, addr, addrLen) == -1) {
-            throw system_error(errno, system_category(), "bind");
+    // Returns true if the ports the kernel chooses from when binding to port 0 all
+    // fall within [startingPort, endingPort]. Returns false if the range cannot be
+    // determined.
+    bool ephemeralPortsAreWithin(int startingPort, int endingPort) noexcept {
+        int first = 0;
+        int last = 0;
+#if defined(__linux)
+        FILE* f = fopen("/proc/sys/net/ipv4/ip_local_port_range", "r");
+        if (!f) {
+            return false;
         }
-        return port;
+        const int n = fscanf(f, "%d %d", &first, &last);
+        fclose(f);
+        if (n != 2) {
+            return false;
+        }
+#elif defined(__APPLE__)
+        size_t len = sizeof(first);
+        if (sysctlbyname("net.inet.ip.portrange.first", &first, &len, nullptr, 0) == -1) {
+            return false;
+        }
+        len = sizeof(last);
+        if (sysctlbyname("net.inet.ip.portrange.last", &last, &len, nullptr, 0) == -1) {
+            return false;
+        }
+#else
+        return false;
+#endif
+        return (first > 0 && first <= last && first >= startingPort && last <= endingPort);
+    }
+
+    // Returns the port a socket is bound to.
+    int boundPort(int sock) {
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        if (getsockname(sock, reinterpret_cast<struct sockaddr*>(&addr), &len) == -1) {
+            throw system_error(errno, system_category(), "getsockname");
+        }
+        if (addr.ss_family == AF_INET6) {
+            return ntohs(reinterpret_cast<struct sockaddr_in6*>(&addr)->sin6_port);
+        }
+        return ntohs(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port);
+    }
+
+    // Allow the socket to share its port with others that do the same.
+    void setReusePort(int sock) {
+#if defined(SO_REUSEPORT)
+        const int on = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) {
+            throw system_error(errno, system_category(), "setsockopt");
+        }
+#else
+        throw system_error(ENOPROTOOPT, system_category(),
+                           "SO_REUSEPORT is not supported on this platform");
+#endif
     }
 
     // Throw an exception if port is not a valid port number.
@@ -76,10 +148,11 @@ int kss::io::net::bindToPort(int sock, int port,
 
     // Sanity checks on the inputs.
     const int requestedPort = port;
-    if (port != nextAvailablePort) {
+    const bool searching = (port == nextAvailablePort || port == anyAvailablePort);
+    if (!searching) {
         verifyPortNumber("port", port);
     }
-    if (port == nextAvailablePort) {
+    else {
         verifyPortNumber("startingPort", startingPort);
         verifyPortNumber("endingPort", endingPort);
         if (startingPort > endingPort) {
@@ -97,23 +170,35 @@ int kss::io::net::bindToPort(int sock, int port,
         addrLen = sizeof(defaultAddr);
     }
 
-    if (port != nextAvailablePort) {
+    if (!searching) {
         // Attempt to bind to exactly the port specified.
         port = attemptToBind(sock, port, addr, (socklen_t)addrLen);
     }
     else {
-        // Attempt to find a port we can bind to.
+        verifyAddressFamily(addr);
+
+        // If any port will do, and every port the kernel would choose is acceptable,
+        // let the kernel choose. This takes a single call no matter how many ports
+        // are in use.
+        if (requestedPort == anyAvailablePort && ephemeralPortsAreWithin(startingPort, endingPort)) {
+            const int err = tryToBind(sock, 0, addr, (socklen_t)addrLen);
+            if (err == 0) {
+                return boundPort(sock);
+            }
+            if (err != EADDRINUSE) {
+                throw system_error(err, system_category(), "bind");
+            }
+        }
+
+        // Attempt to find a port we can bind to. A port in use is the normal case
+        // while searching, so it is not treated as an error.
         for (port = startingPort; port <= endingPort; ++port) {
-            try {
-                return attemptToBind(sock, port, addr, (socklen_t)addrLen);
+            const int err = tryToBind(sock, port, addr, (socklen_t)addrLen);
+            if (err == 0) {
+                return port;
             }
-            catch (const system_error& e) {
-                if (e.code() == error_code(EADDRINUSE, system_category())) {
-                    continue;
-                }
-                else {
-                    throw;
-                }
+            if (err != EADDRINUSE) {
+                throw system_error(err, system_category(), "bind");
             }
         }
 
@@ -125,7 +210,7 @@ int kss::io::net::bindToPort(int sock, int port,
     }
 
     contract::postconditions({
-        KSS_EXPR(requestedPort == nextAvailablePort
+        KSS_EXPR(searching
                  ? port >= startingPort && port <= endingPort
                  : port == requestedPort)
     });
@@ -134,17 +219,57 @@ int kss::io::net::bindToPort(int sock, int port,
 }
 
 
-int kss::io::net::findNextAvailablePort(int startingPort, int endingPort) {
-    // We determine the next available port by using bindToPort. If successful, then we
-    // shutdown the socket and return the port number.
-    const int sock = ::socket(AF_INET, SOCK_STREAM, 0);
-    if (sock == -1) {
-        throw system_error(errno, system_category(), "socket");
+int kss::io::net::bindToPort(const vector<int>& sockets, int port,
+                             struct sockaddr* addr, size_t addrLen,
+                             int startingPort, int endingPort)
+{
+    contract::parameters({
+        KSS_EXPR(!sockets.empty()),
+        KSS_EXPR(all_of(sockets.begin(), sockets.end(), [](int sock) { return sock > 0; }))
+    });
+
+    for (const auto sock : sockets) {
+        setReusePort(sock);
+    }
+
+    // Once the first socket is bound, the others must use the same port.
+    const int boundPort = bindToPort(sockets.front(), port, addr, addrLen, startingPort, endingPort);
+    for (size_t i = 1; i < sockets.size(); ++i) {
+        bindToPort(sockets[i], boundPort, addr, addrLen);
     }
+    return boundPort;
+}
+
+
+namespace {
+    // Find an available port by binding a temporary socket using bindToPort. If
+    // successful, then we shutdown the socket and return the port number.
+    int findPort(int searchType, int startingPort, int endingPort) {
+        const int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (sock == -1) {
+            throw system_error(errno, system_category(), "socket");
+        }
+
+        Finally cleanup([&]{
+            shutdown(sock, SHUT_RDWR);
+            close(sock);
+        });
+        return bindToPort(sock, searchType, nullptr, 0, startingPort, endingPort);
+    }
+}
+
+int kss::io::net::findNextAvailablePort(int startingPort, int endingPort) {
+    const int port = findPort(nextAvailablePort, startingPort, endingPort);
+
+    contract::postconditions({
+        KSS_EXPR(port >= startingPort && port <= endingPort)
+    });
+
+    return port;
+}
 
-    const int port = bindToPort(sock, nextAvailablePort, nullptr, 0, startingPort, endingPort);
-    shutdown(sock, SHUT_RDWR);
-    close(sock);
+int kss::io::net::findAvailablePort(int startingPort, int endingPort) {
+    const int port = findPort(anyAvailablePort, startingPort, endingPort);
 
     contract::postconditions({
         KSS_EXPR(port >= startingPort && port <= endingPort)
@@ -17,6 +17,7 @@
 #include <chrono>
 #include <limits>
 #include <string>
+#include <vector>
 #include <sys/socket.h>
 
 namespace kss {
@@ -24,6 +25,7 @@ namespace kss {
         namespace net {
 
             constexpr int nextAvailablePort = -2;
+            constexpr int anyAvailablePort = -4;
             constexpr int defaultStartingPort = 5000;
             constexpr int maxPossiblePortAsInt = std::min((int)std::numeric_limits<uint16_t>::max(),
                                                           std::numeric_limits<int>::max()-1);
@@ -34,9 +36,16 @@ namespace kss {
              is kss::network::nextAvailablePort, then this will search for an available
              port, starting at startingPort (5000 by default), and bind.
 
+             If the requested port is anyAvailablePort, then any available port between
+             startingPort and endingPort will do. If all the ports the kernel chooses from
+             when binding to port 0 (its ephemeral port range) lie within that range, the
+             kernel is left to choose, which takes a single call however many ports are
+             in use. Otherwise this is the same as nextAvailablePort. With the default
+             range, the kernel is normally able to choose.
+
              @param socket the socket we wish to bind
-             @param port the port we wish to bind to, may be nextAvailablePort to automatically
-                choose one.
+             @param port the port we wish to bind to, may be nextAvailablePort or
+                anyAvailablePort to automatically choose one.
              @param addr detas of the address we wish to bind. The port of this address
              will be changed as part of the binding. If NULL, then an address that assumes
              the AF_INET family and INADDR_ANY address will be used.
@@ -49,8 +58,8 @@ namespace kss {
 
              @throws std::invalid_argument if sock is invalid (not positive)
              @throws std::invalid_argument if port is not nextAvailablePort and port is invalid
-             @throws std::invalid_argument if port is nextAvailablePort and startingPort or
-                maxPort are invalid or if startingPort > maxPort
+             @throws std::invalid_argument if port is nextAvailablePort or anyAvailablePort
+                and startingPort or maxPort are invalid or if startingPort > maxPort
              @throws std::system_error if we were unable to bind
              */
             int bindToPort(int socket,
@@ -60,6 +69,36 @@ namespace kss {
                            int startingPort = defaultStartingPort,
                            int endingPort = maxPossiblePortAsInt);
 
+            /*!
+             Bind several sockets to the same port, so that each may be used as a listener
+             by its own thread. SO_REUSEPORT is set on each socket before it is bound,
+             which on Linux causes the kernel to spread the incoming connections across
+             the listeners, giving each thread its own accept queue. (Other platforms may
+             allow the sockets to share the port without spreading the connections.)
+
+             The parameters, other than the sockets, have the same meaning as for the
+             single socket version. If the port is nextAvailablePort, the first socket is
+             used to find an available port, and the others are bound to the same one.
+             If an exception is thrown, some of the sockets may already have been bound,
+             so they should all be closed.
+
+             @param sockets the sockets we wish to bind. They must all be of the same type
+                and family.
+             @return the port that we bound to
+
+             @throws std::invalid_argument if sockets is empty or any socket is invalid
+             @throws std::invalid_argument if the port parameters are invalid, as for
+                the single socket version
+             @throws std::system_error if SO_REUSEPORT is not supported or we were unable
+                to bind
+             */
+            int bindToPort(const std::vector<int>& sockets,
+                           int port,
+                           struct sockaddr* addr = nullptr,
+                           size_t addrLen = 0,
+                           int startingPort = defaultStartingPort,
+                           int endingPort = maxPossiblePortAsInt);
+
             /*!
              Return the next available port for creating a service, starting at startingPort
              (5000 by default) and ending with endingPort (maxPossiblePortAsInt by default.
@@ -80,6 +119,19 @@ namespace kss {
              */
             int findNextAvailablePort(int startingPort = defaultStartingPort,
                                       int endingPort = maxPossiblePortAsInt);
+
+            /*!
+             Return any available port between startingPort and endingPort. This is the
+             same as findNextAvailablePort() except that the port is not necessarily the
+             lowest one available. Since it uses anyAvailablePort, it is much faster when
+             many of the ports are in use, and it has the same race condition.
+
+             @throws std::invalid_argument if startingPort or endingPort are invalid or
+                if startingPort > endingPort
+             @throws std::system_error if we were unable to find a suitable port
+             */
+            int findAvailablePort(int startingPort = defaultStartingPort,
+                                  int endingPort = maxPossiblePortAsInt);
         }
     }
 }
@@ -0,0 +1,623 @@
+//
+//  tcp_server.cpp
+//  kssio
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <kss/contract/all.h>
+
+#include "tcp_server.hpp"
+
+using namespace std;
+using namespace kss::io;
+using namespace kss::io::net;
+
+namespace contract = kss::contract;
+
+using std::chrono::milliseconds;
+
+
+///
+/// MARK: Internal Utilities
+///
+
+namespace {
+
+    // The maximum number of connections accepted in a single pass. The listener is
+    // level triggered, so any more are accepted on the next pass, after the existing
+    // connections have had a turn.
+    constexpr size_t acceptBatchSize = 64;
+
+    // The most we try to read in a single call.
+    constexpr size_t readChunkSize = 16 * 1024;
+
+    // Prevent a write to a connection the peer has closed from raising SIGPIPE.
+#if defined(MSG_NOSIGNAL)
+    constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+    constexpr int sendFlags = 0;
+#endif
+
+    inline bool wouldBlock(int err) noexcept {
+        return (err == EAGAIN || err == EWOULDBLOCK);
+    }
+
+    // Accept a connection, returning a non-blocking, close-on-exec descriptor or -1.
+    int acceptConnection(int listener, struct sockaddr_storage& addr) noexcept {
+        socklen_t len = sizeof(addr);
+#if defined(__linux)
+        return accept4(listener, reinterpret_cast<struct sockaddr*>(&addr), &len,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        const int fd = accept(listener, reinterpret_cast<struct sockaddr*>(&addr), &len);
+        if (fd != -1) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+#   if defined(SO_NOSIGPIPE)
+            const int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#   endif
+        }
+        return fd;
+#endif
+    }
+
+    class Connection;
+
+    // The part of the server that the connections need to call back into.
+    class ConnectionManager {
+    public:
+        virtual ~ConnectionManager() noexcept = default;
+        virtual Poller& poller() noexcept = 0;
+        virtual size_t readLimit() const noexcept = 0;
+        virtual size_t writeLimit() const noexcept = 0;
+        virtual void dataHasArrived(Connection& c) noexcept = 0;
+        virtual void canWrite(Connection& c) noexcept = 0;
+        virtual void closeConnection(Connection& c) noexcept = 0;
+    };
+
+    // Our implementation of a connection. The read buffer holds the unconsumed data
+    // in [inStart, inEnd), and the write buffer the unsent data from outStart to its
+    // end. Both are compacted lazily, so that consuming or sending part of the data
+    // does not move the rest.
+    class Connection final : public TcpConnection {
+    public:
+        Connection(ConnectionManager& manager, id_t id, int filedes,
+                   const struct sockaddr_storage& peer) noexcept
+        : manager(manager), ident(id), fd(filedes), peer(peer)
+        {
+            // Edge triggered resources must be rearmed when the poll engine is used.
+            rearmRequired = (manager.poller().engine() == Poller::Engine::poll);
+        }
+
+        Poller::handle_t    readHandle { Poller::invalidHandle };
+        Poller::handle_t    writeHandle { Poller::invalidHandle };
+        bool                closed { false };
+        Connection*         nextClosed { nullptr };
+
+        id_t id() const noexcept override { return ident; }
+        int filedes() const noexcept override { return fd; }
+        const struct sockaddr_storage& peerAddress() const noexcept override { return peer; }
+        const char* data() const noexcept override { return input.data() + inStart; }
+        size_t available() const noexcept override { return inEnd - inStart; }
+        size_t pending() const noexcept override { return output.size() - outStart; }
+        bool isClosing() const noexcept override { return closing; }
+
+        void consume(size_t n) override {
+            contract::parameters({
+                KSS_EXPR(n <= available())
+            });
+
+            inStart += n;
+            if (inStart == inEnd) {
+                inStart = inEnd = 0;
+            }
+            if (readPaused && !closing && available() < manager.readLimit()) {
+                readPaused = false;
+                manager.poller().rearm(readHandle);
+            }
+        }
+
+        bool write(const void* data, size_t len) override {
+            contract::parameters({
+                KSS_EXPR(data != nullptr || len == 0)
+            });
+
+            if (closing) {
+                return false;
+            }
+
+            // Only send directly if nothing is waiting, otherwise the data would be
+            // sent out of order.
+            auto p = static_cast<const char*>(data);
+            if (pending() == 0) {
+                const auto sent = send(p, len);
+                if (closed) {
+                    return false;
+                }
+                p += sent;
+                len -= sent;
+            }
+            if (len > 0) {
+                output.insert(output.end(), p, p + len);
+                if (rearmRequired) {
+                    manager.poller().rearm(writeHandle);
+                }
+            }
+
+            const bool belowLimit = (pending() <= manager.writeLimit());
+            if (!belowLimit) {
+                blocked = true;
+            }
+            return belowLimit;
+        }
+
+        void close() noexcept override {
+            if (closing) {
+                return;
+            }
+            closing = true;
+            if (pending() == 0) {
+                manager.closeConnection(*this);
+            }
+        }
+
+        // Close the connection without sending the data that is waiting.
+        void abort() noexcept {
+            closing = true;
+            output.clear();
+            outStart = 0;
+            manager.closeConnection(*this);
+        }
+
+        // Called when the read resource has been reported.
+        void handleReadEvent(const PolledEvent& ev) {
+            if (ev.errorHasOccurred) {
+                abort();
+                return;
+            }
+            if (closing || readPaused) {
+                return;
+            }
+
+            // Read until the socket would block, or the buffer is full. An edge
+            // triggered resource will not be reported again until more data arrives,
+            // so stopping for any other reason would strand the data.
+            const auto limit = manager.readLimit();
+            size_t received = 0;
+            bool endOfFile = false;
+            while (available() < limit) {
+                const auto want = min(limit - available(), readChunkSize);
+                reserveInput(want);
+                const auto n = ::recv(fd, input.data() + inEnd, want, 0);
+                if (n > 0) {
+                    inEnd += static_cast<size_t>(n);
+                    received += static_cast<size_t>(n);
+                }
+                else if (n == 0) {
+                    endOfFile = true;
+                    break;
+                }
+                else if (errno == EINTR) {
+                    continue;
+                }
+                else if (wouldBlock(errno)) {
+                    break;
+                }
+                else {
+                    abort();
+                    return;
+                }
+            }
+            readPaused = (!endOfFile && available() >= limit);
+
+            if (received > 0) {
+                manager.dataHasArrived(*this);
+                if (closed) {
+                    return;
+                }
+            }
+            if (endOfFile) {
+                close();
+            }
+            else if (!readPaused && !closing && rearmRequired) {
+                manager.poller().rearm(readHandle);
+            }
+        }
+
+        // Called when the write resource has been reported.
+        void handleWriteEvent(const PolledEvent& ev) {
+            if (ev.errorHasOccurred) {
+                abort();
+                return;
+            }
+            if (pending() > 0) {
+                flush();
+            }
+        }
+
+    private:
+        ConnectionManager&                  manager;
+        const id_t                          ident;
+        const int                           fd;
+        const struct sockaddr_storage       peer;
+        vector<char>                        input;
+        size_t                              inStart { 0 };
+        size_t                              inEnd { 0 };
+        vector<char>                        output;
+        size_t                              outStart { 0 };
+        bool                                rearmRequired { false };
+        bool                                readPaused { false };
+        bool                                closing { false };
+        bool                                blocked { false };
+
+        // Make room for len more bytes at the end of the read buffer.
+        void reserveInput(size_t len) {
+            if (inEnd + len <= input.size()) {
+                return;
+            }
+            if (inStart > 0) {
+                memmove(input.data(), input.data() + inStart, inEnd - inStart);
+                inEnd -= inStart;
+                inStart = 0;
+            }
+            if (inEnd + len > input.size()) {
+                input.resize(inEnd + len);
+            }
+        }
+
+        // Send as much as the socket will take without blocking, returning the number
+        // of bytes sent. The connection is aborted if the send fails.
+        size_t send(const char* p, size_t len) noexcept {
+            size_t sent = 0;
+            while (sent < len) {
+                const auto n = ::send(fd, p + sent, len - sent, sendFlags);
+                if (n >= 0) {
+                    sent += static_cast<size_t>(n);
+                }
+                else if (errno == EINTR) {
+                    continue;
+                }
+                else if (wouldBlock(errno)) {
+                    break;
+                }
+                else {
+                    abort();
+                    break;
+                }
+            }
+            return sent;
+        }
+
+        // Send what we can of the write buffer.
+        void flush() {
+            outStart += send(output.data() + outStart, pending());
+            if (closed) {
+                return;
+            }
+            if (pending() == 0) {
+                output.clear();
+                outStart = 0;
+            }
+
+            if (closing) {
+                if (pending() == 0) {
+                    manager.closeConnection(*this);
+                    return;
+                }
+            }
+            else if (blocked && pending() <= manager.writeLimit()) {
+                blocked = false;
+                manager.canWrite(*this);
+                if (closed) {
+                    return;
+                }
+            }
+
+            if (pending() > 0 && rearmRequired) {
+                manager.poller().rearm(writeHandle);
+            }
+        }
+    };
+}
+
+
+///
+/// MARK: TcpServer::Impl Implementation
+///
+
+// The server is the delegate of its poller. The listener is added as a level
+// triggered resource with no payload, and each connection as a pair of edge triggered
+// resources, one for reading and one for writing, with the connection as their payload.
+struct TcpServer::Impl : public PollerDelegate, public ConnectionManager {
+    TcpServer*                                          parent { nullptr };
+    TcpServerDelegate*                                  delegate { nullptr };
+    Poller                                              thePoller;
+    int                                                 listener { -1 };
+    int                                                 port { 0 };
+    size_t                                              theReadLimit { defaultReadLimit };
+    size_t                                              theWriteLimit { defaultWriteLimit };
+
+    // The connections are only accessed by the thread running the poller. Closed
+    // connections are kept, in a list linked through the connections themselves, until
+    // the next batch of events, since events for them may still follow in the current
+    // one.
+    unordered_map<TcpConnection::id_t, unique_ptr<Connection>>  connections;
+    Connection*                                         closedConnections { nullptr };
+    TcpConnection::id_t                                 lastId { 0 };
+    atomic<size_t>                                      numConnections { 0 };
+
+    explicit Impl(Poller::Engine engine) : thePoller(engine) {}
+
+    ~Impl() noexcept {
+        for (const auto& c : connections) {
+            ::close(c.second->filedes());
+        }
+        if (listener != -1) {
+            ::close(listener);
+        }
+        destroyClosedConnections();
+    }
+
+    void destroyClosedConnections() noexcept {
+        while (closedConnections) {
+            auto* next = closedConnections->nextClosed;
+            delete closedConnections;
+            closedConnections = next;
+        }
+    }
+
+    // ConnectionManager
+    Poller& poller() noexcept override { return thePoller; }
+    size_t readLimit() const noexcept override { return theReadLimit; }
+    size_t writeLimit() const noexcept override { return theWriteLimit; }
+
+    void dataHasArrived(Connection& c) noexcept override {
+        fireConnectionCallback(c, &TcpServerDelegate::tcpServerDataHasArrived);
+    }
+
+    void canWrite(Connection& c) noexcept override {
+        fireConnectionCallback(c, &TcpServerDelegate::tcpServerConnectionCanWrite);
+    }
+
+    void closeConnection(Connection& c) noexcept override {
+        if (c.closed) {
+            return;
+        }
+        c.closed = true;
+        try {
+            thePoller.remove(c.readHandle);
+            thePoller.remove(c.writeHandle);
+        }
+        catch (const exception& e) {
+            syslog(LOG_ERR, "Could not remove connection from poller, exception=%s", e.what());
+        }
+        fireConnectionCallback(c, &TcpServerDelegate::tcpServerConnectionWillClose);
+        ::close(c.filedes());
+
+        const auto it = connections.find(c.id());
+        assert(it != connections.end());
+        it->second.release();
+        connections.erase(it);
+        c.nextClosed = closedConnections;
+        closedConnections = &c;
+        --numConnections;
+    }
+
+    // PollerDelegate
+    bool pollerShouldStop() const override {
+        return delegate->tcpServerShouldStop();
+    }
+
+    milliseconds pollerMaximumWaitInterval() const override {
+        return delegate->tcpServerMaximumWaitInterval();
+    }
+
+    void pollerResourcesAreReady(Poller&, const vector<PolledEvent>& events) override {
+        destroyClosedConnections();
+        for (const auto& ev : events) {
+            const auto& resource = *ev.resource;
+            if (!resource.payload) {
+                acceptConnections();
+                continue;
+            }
+
+            auto* c = static_cast<Connection*>(resource.payload);
+            if (c->closed) {
+                continue;
+            }
+            try {
+                if (resource.handle == c->readHandle) {
+                    c->handleReadEvent(ev);
+                }
+                else {
+                    c->handleWriteEvent(ev);
+                }
+            }
+            catch (const exception& e) {
+                syslog(LOG_ERR, "Error handling connection %llu, exception=%s",
+                       static_cast<unsigned long long>(c->id()), e.what());
+                c->abort();
+            }
+        }
+    }
+
+    // Accept a batch of new connections.
+    void acceptConnections() noexcept {
+        for (size_t i = 0; i < acceptBatchSize; ++i) {
+            struct sockaddr_storage addr;
+            memset(&addr, 0, sizeof(addr));
+            const int fd = acceptConnection(listener, addr);
+            if (fd == -1) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if (!wouldBlock(errno)) {
+                    syslog(LOG_ERR, "Could not accept connection, error=%s", strerror(errno));
+                }
+                break;
+            }
+            openConnection(fd, addr);
+        }
+    }
+
+    void openConnection(int fd, const struct sockaddr_storage& addr) noexcept {
+        try {
+            unique_ptr<Connection> conn(new Connection(*this, ++lastId, fd, addr));
+
+            PolledResource r;
+            r.name = "connection";
+            r.filedes = fd;
+            r.mode = PolledResource::Mode::edgeTriggered;
+            r.payload = conn.get();
+            r.event = PolledResource::Event::read;
+            conn->readHandle = thePoller.add(r);
+            r.event = PolledResource::Event::write;
+            try {
+                conn->writeHandle = thePoller.add(r);
+            }
+            catch (const exception&) {
+                thePoller.remove(conn->readHandle);
+                throw;
+            }
+
+            auto& c = *conn;
+            connections[c.id()] = move(conn);
+            ++numConnections;
+            fireConnectionCallback(c, &TcpServerDelegate::tcpServerConnectionHasOpened);
+        }
+        catch (const exception& e) {
+            syslog(LOG_ERR, "Could not open connection, exception=%s", e.what());
+            ::close(fd);
+        }
+    }
+
+	// Wrap any exceptions in a syslog and call the delegate.
+    using ConnectionCallback = void (TcpServerDelegate::*)(TcpServer&, TcpConnection&);
+
+    void fireConnectionCallback(Connection& c, ConnectionCallback cb) noexcept {
+        try {
+            (delegate->*cb)(*parent, c);
+        }
+        catch (const exception& e) {
+            syslog(LOG_ERR, "Error with tcp server callback, connection=%llu, exception=%s",
+                   static_cast<unsigned long long>(c.id()), e.what());
+        }
+    }
+};
+
+
+///
+/// MARK: TcpServer Implementation
+///
+
+constexpr size_t TcpServer::defaultReadLimit;
+constexpr size_t TcpServer::defaultWriteLimit;
+
+TcpServer::TcpServer(int port, struct sockaddr* addr, size_t addrLen, Poller::Engine engine)
+: _impl(new Impl(engine))
+{
+    _impl->parent = this;
+
+    const int family = (addr ? addr->sa_family : AF_INET);
+    _impl->listener = ::socket(family, SOCK_STREAM, 0);
+    if (_impl->listener == -1) {
+        throw system_error(errno, system_category(), "socket");
+    }
+    const int listener = _impl->listener;
+    if (fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK) == -1
+        || fcntl(listener, F_SETFD, FD_CLOEXEC) == -1)
+    {
+        throw system_error(errno, system_category(), "fcntl");
+    }
+    const int on = 1;
+    if (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1) {
+        throw system_error(errno, system_category(), "setsockopt");
+    }
+
+    _impl->port = bindToPort(listener, port, addr, addrLen);
+    if (listen(listener, SOMAXCONN) == -1) {
+        throw system_error(errno, system_category(), "listen");
+    }
+
+    PolledResource r;
+    r.name = "listener";
+    r.filedes = listener;
+    r.event = PolledResource::Event::read;
+    _impl->thePoller.setDelegate(_impl.get());
+    _impl->thePoller.add(r);
+
+    contract::postconditions({
+        KSS_EXPR(_impl->parent == this),
+        KSS_EXPR(_impl->delegate == nullptr),
+        KSS_EXPR(_impl->listener != -1),
+        KSS_EXPR(_impl->port > 0)
+    });
+}
+
+TcpServer::~TcpServer() noexcept = default;
+
+
+void TcpServer::setDelegate(TcpServerDelegate* delegate) noexcept {
+    _impl->delegate = delegate;
+}
+
+void TcpServer::setBufferLimits(size_t readLimit, size_t writeLimit) {
+    contract::parameters({
+        KSS_EXPR(readLimit > 0),
+        KSS_EXPR(writeLimit > 0)
+    });
+
+    _impl->theReadLimit = readLimit;
+    _impl->theWriteLimit = writeLimit;
+}
+
+int TcpServer::port() const noexcept {
+    return _impl->port;
+}
+
+size_t TcpServer::size() const noexcept {
+    return _impl->numConnections;
+}
+
+
+void TcpServer::post(function<void()> task) {
+    _impl->thePoller.post(move(task));
+}
+
+void TcpServer::wakeup() noexcept {
+    _impl->thePoller.wakeup();
+}
+
+
+void TcpServer::run() {
+    contract::preconditions({
+        KSS_EXPR(_impl->parent == this)
+    });
+
+    if (!_impl->delegate) {
+        throw runtime_error("No delegate has been assigned.");
+    }
+    _impl->thePoller.run();
+    _impl->destroyClosedConnections();
+}
@@ -0,0 +1,262 @@
+//
+//  tcp_server.hpp
+//  kssio
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#ifndef kssio_tcp_server_hpp
+#define kssio_tcp_server_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <sys/socket.h>
+
+#include "poller.hpp"
+#include "socket.hpp"
+
+namespace kss {
+    namespace io {
+        namespace net {
+
+            class TcpServer;
+
+            /*!
+             A connection accepted by a TcpServer. Connections are created and destroyed
+             by the server, and are only valid from within the delegate callbacks, or
+             from tasks posted to the server, until tcpServerConnectionWillClose() has
+             been called for them. None of the methods may be called from any other
+             thread.
+
+             Incoming data is collected in a read buffer, which the delegate examines
+             with data() and available() and removes with consume(). Once the buffer
+             holds the server's read limit the server stops reading from the socket,
+             which pushes back on the peer through TCP flow control, until the delegate
+             consumes some of it.
+
+             Outgoing data is sent right away if the socket will accept it, with the
+             remainder kept in a write buffer and sent as the socket allows. Once the
+             buffer holds more than the server's write limit, write() returns false,
+             and tcpServerConnectionCanWrite() is called when it has drained again.
+             */
+            class TcpConnection {
+            public:
+                using id_t = uint64_t;
+
+                virtual ~TcpConnection() noexcept = default;
+
+                /*!
+                 Returns an identifier for this connection that is unique within its
+                 server.
+                 */
+                virtual id_t id() const noexcept = 0;
+
+                /*!
+                 Returns the connected socket. It is non-blocking and owned by the
+                 connection, so it must not be closed or read from directly.
+                 */
+                virtual int filedes() const noexcept = 0;
+
+                /*!
+                 Returns the address of the peer.
+                 */
+                virtual const struct sockaddr_storage& peerAddress() const noexcept = 0;
+
+                /*!
+                 Returns the data that has been read but not yet consumed. The pointer
+                 is only valid until the next call to consume() or the callback
+                 returns, whichever comes first.
+                 */
+                virtual const char* data() const noexcept = 0;
+                virtual size_t available() const noexcept = 0;
+
+                /*!
+                 Remove the first n bytes from the read buffer.
+
+                 @throws std::invalid_argument if n is greater than available().
+                 @throws any exception that Poller::rearm() may throw.
+                 */
+                virtual void consume(size_t n) = 0;
+
+                /*!
+                 Write len bytes to the connection, buffering any that cannot be sent
+                 right away. Writing to a connection that is closing does nothing.
+
+                 @return false if the write buffer now holds more than the server's
+                    write limit, or if the connection is closing. Otherwise true.
+                 @throws std::invalid_argument if data is nullptr and len is not zero.
+                 @throws any exception that std::vector may throw.
+                 */
+                virtual bool write(const void* data, size_t len) = 0;
+
+                /*!
+                 Returns the number of bytes waiting in the write buffer.
+                 */
+                virtual size_t pending() const noexcept = 0;
+
+                /*!
+                 Close the connection. No more data is read, but any data still in the
+                 write buffer is sent before the socket is closed. Closing a connection
+                 that is already closing does nothing.
+                 */
+                virtual void close() noexcept = 0;
+
+                /*!
+                 Returns true once close() has been called, or the peer has closed its
+                 end of the connection.
+                 */
+                virtual bool isClosing() const noexcept = 0;
+            };
+
+
+            /*!
+             This is the interface for the server delegate. It follows the same pattern
+             as PollerDelegate, with the callbacks made from within TcpServer::run().
+
+             It is best that the methods of this interface do not throw exceptions.
+             However if they do they will be automatically caught and ignored.
+             */
+            class TcpServerDelegate {
+            public:
+
+                /*!
+                 Should return true when the server should stop. This has the same
+                 meaning as PollerDelegate::pollerShouldStop().
+                 */
+                virtual bool tcpServerShouldStop() const = 0;
+
+                /*!
+                 Returns the maximum time the server waits before checking
+                 tcpServerShouldStop(). This has the same meaning as
+                 PollerDelegate::pollerMaximumWaitInterval().
+                 */
+                virtual std::chrono::milliseconds tcpServerMaximumWaitInterval() const {
+                    using namespace std::chrono_literals;
+                    return 100ms;
+                }
+
+                /*!
+                 Called when a new connection has been accepted.
+                 */
+                virtual void tcpServerConnectionHasOpened(TcpServer& s, TcpConnection& c) {}
+
+                /*!
+                 Called when new data has been added to the read buffer of a connection.
+                 Data that is not consumed remains in the buffer, and is included the
+                 next time this is called.
+                 */
+                virtual void tcpServerDataHasArrived(TcpServer& s, TcpConnection& c) {}
+
+                /*!
+                 Called when the write buffer of a connection, after write() had returned
+                 false, has drained to the server's write limit or less.
+                 */
+                virtual void tcpServerConnectionCanWrite(TcpServer& s, TcpConnection& c) {}
+
+                /*!
+                 Called just before the socket of a connection is closed, either because
+                 the delegate closed it, the peer closed it, or an error occurred. The
+                 connection must not be used once this returns.
+                 */
+                virtual void tcpServerConnectionWillClose(TcpServer& s, TcpConnection& c) {}
+            };
+
+
+            /*!
+             A TCP server that accepts connections on a port and handles them using a
+             Poller. The listening socket is created with bindToPort(), new connections
+             are accepted in batches, using accept4() on Linux, and each connection is
+             monitored by the poller in edge triggered mode.
+
+             All the delegate callbacks are made from the thread calling run(). Other
+             threads that need to use a connection should do so with post().
+             */
+            class TcpServer final {
+            public:
+
+                /*!
+                 The default limits of the read and write buffers of each connection.
+                 */
+                static constexpr size_t defaultReadLimit = 64 * 1024;
+                static constexpr size_t defaultWriteLimit = 256 * 1024;
+
+                /*!
+                 Construct a server listening on the given port. The port, addr and
+                 addrLen parameters have the same meaning as for bindToPort(). The
+                 listening socket has SO_REUSEADDR set.
+
+                 @throws std::invalid_argument if the port is invalid.
+                 @throws std::system_error if the socket could not be created or bound.
+                 */
+                explicit TcpServer(int port = nextAvailablePort,
+                                   struct sockaddr* addr = nullptr,
+                                   size_t addrLen = 0,
+                                   Poller::Engine engine = Poller::Engine::automatic);
+                ~TcpServer() noexcept;
+
+                TcpServer(const TcpServer&) = delete;
+                TcpServer& operator=(const TcpServer&) = delete;
+
+                /*!
+                 Set the delegate. This needs to be done before run() is called, and the
+                 delegate must remain valid throughout the life of the server.
+                 */
+                void setDelegate(TcpServerDelegate* delegate) noexcept;
+
+                /*!
+                 Set the limits of the read and write buffers of each connection. This
+                 affects existing connections as well as new ones, and may be called
+                 from within the delegate callbacks.
+
+                 @throws std::invalid_argument if either limit is zero.
+                 */
+                void setBufferLimits(size_t readLimit, size_t writeLimit);
+
+                /*!
+                 Returns the port the server is listening on.
+                 */
+                int port() const noexcept;
+
+                /*!
+                 Returns the number of open connections. This may be called from any
+                 thread, although the value may be out of date by the time it is used.
+                 */
+                size_t size() const noexcept;
+
+                /*!
+                 Run a task on the thread running run(). This has the same meaning as
+                 Poller::post().
+                 */
+                void post(std::function<void()> task);
+
+                /*!
+                 Interrupt the internal poll so that the delegate's tcpServerShouldStop()
+                 is examined right away. This may be called from any thread.
+                 */
+                void wakeup() noexcept;
+
+                /*!
+                 Accept and handle connections until tcpServerShouldStop() returns true.
+                 The connections remain open when this returns, so it may be called
+                 again to resume. They are closed, without calling the delegate, when
+                 the server is destroyed.
+
+                 @throws runtime_error if no delegate has been assigned.
+                 @throws system_error if there is a problem with the internal system calls.
+                 */
+                void run();
+
+            private:
+                struct Impl;
+                std::unique_ptr<Impl> _impl;
+            };
+        }
+    }
+}
+
+#endif
@@ -8,10 +8,22 @@
 //
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
 #include <iostream>
+#include <iterator>
+#include <list>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
 
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <kss/io/binary_file.hpp>
 #include <kss/io/fileutil.hpp>
@@ -29,6 +41,41 @@ namespace {
         int i;
         long l;
     };
+
+    // Returns the size of a file.
+    size_t sizeOf(const string& filename) {
+        struct stat st;
+        if (stat(filename.c_str(), &st) == -1) {
+            throw system_error(errno, system_category(), "stat");
+        }
+        return size_t(st.st_size);
+    }
+
+    // Remove a file from the page cache, so that reading it must go to the disk.
+    void evict(const string& filename) {
+        const int fd = open(filename.c_str(), O_RDONLY);
+        FiledesGuard g(fd);
+#if defined(__linux)
+        // Dirty pages are not dropped, so they must be written out first.
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    }
+
+    // Returns the number of pages of a file that are in the page cache.
+    size_t residentPages(const string& filename) {
+        MappedFile mf(filename);
+        const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+#if defined(__APPLE__)
+        vector<char> vec((mf.size() + pageSize - 1) / pageSize);
+#else
+        vector<unsigned char> vec((mf.size() + pageSize - 1) / pageSize);
+#endif
+        if (mincore((caddr_t)mf.data(), mf.size(), vec.data()) == -1) {
+            throw system_error(errno, system_category(), "mincore");
+        }
+        return size_t(count_if(vec.begin(), vec.end(), [](char c) { return (c & 1) != 0; }));
+    }
 }
 
 
@@ -316,5 +363,695 @@ static TestSuite ts("file::binary_file", {
             }
             KSS_ASSERT(i == 17);
         }
+    }),
+    make_pair("MappedFile", [] {
+        const string filename = temporaryFilename("/tmp/mf");
+        {
+            FileOf<srec> fo(filename, BinaryFile::writing);
+            for (int i = 0; i < 1000; ++i) {
+                fo.write(srec { i, (long)i });
+            }
+        }
+
+        // read only mode
+        {
+            MappedFile mf(filename);
+            KSS_ASSERT(mf.isOpenFor(BinaryFile::reading));
+            KSS_ASSERT(!mf.isOpenFor(BinaryFile::writing));
+            KSS_ASSERT(mf.size() == 1000 * sizeof(srec));
+            mf.advise(MappedFile::Advice::sequential);
+            mf.advise(MappedFile::Advice::willNeed, 100, 1000);
+            KSS_ASSERT(throwsException<invalid_argument>([&] {
+                mf.advise(MappedFile::Advice::random, mf.size(), 1);
+            }));
+
+            const srec* recs = reinterpret_cast<const srec*>(mf.data());
+            for (int i = 0; i < 1000; ++i) {
+                KSS_ASSERT(recs[i].i == i && recs[i].l == (long)i);
+            }
+            KSS_ASSERT(size_t(mf.end() - mf.begin()) == mf.size());
+        }
+
+        KSS_ASSERT(throwsException<invalid_argument>([&] { MappedFile(filename, 200); }));
+        KSS_ASSERT(throwsException<invalid_argument>([] { MappedFile(""); }));
+        KSS_ASSERT(throwsException<system_error>([] { MappedFile("/tmp/no/such/file"); }));
+
+        // update mode
+        {
+            MappedFile mf(filename, BinaryFile::reading | BinaryFile::updating);
+            KSS_ASSERT(mf.isOpenFor(BinaryFile::writing));
+            srec* recs = reinterpret_cast<srec*>(mf.writableData());
+            recs[10].l = -10L;
+            const srec r { 1000, 1000L };
+            mf.append(&r, sizeof(r));
+            KSS_ASSERT(mf.size() == 1001 * sizeof(srec));
+            KSS_ASSERT(mf.capacity() >= mf.size());
+        }
+        {
+            FileOf<srec> fo(filename);
+            KSS_ASSERT(fo.read(10).l == -10L);
+            KSS_ASSERT(fo.read(1000).i == 1000);
+            KSS_ASSERT(throwsException<kss::io::Eof>([&] { fo.read(); }));
+        }
+
+        // write mode, growing the file one record at a time
+        {
+            MappedFile mf(filename, BinaryFile::writing);
+            KSS_ASSERT(mf.empty() && mf.data() == nullptr);
+            for (int i = 0; i < 5000; ++i) {
+                const srec r { i, (long)i };
+                mf.append(&r, sizeof(r));
+            }
+            KSS_ASSERT(mf.size() == 5000 * sizeof(srec));
+
+            // Writing past the end fills the gap with zeros, even if the space had
+            // previously been used.
+            mf.resize(10 * sizeof(srec));
+            const srec r { 20, 20L };
+            mf.write(&r, sizeof(r), 20 * sizeof(srec));
+            KSS_ASSERT(mf.size() == 21 * sizeof(srec));
+            const srec* recs = reinterpret_cast<const srec*>(mf.data());
+            KSS_ASSERT(recs[9].i == 9 && recs[10].i == 0 && recs[19].l == 0L && recs[20].i == 20);
+
+            mf.flush();
+            KSS_ASSERT(mf.capacity() == mf.size());
+            struct stat st;
+            KSS_ASSERT(stat(filename.c_str(), &st) == 0 && size_t(st.st_size) == mf.size());
+
+            mf.reserve(1000 * sizeof(srec));
+            KSS_ASSERT(mf.size() == 21 * sizeof(srec));
+        }
+        {
+            struct stat st;
+            KSS_ASSERT(stat(filename.c_str(), &st) == 0 && size_t(st.st_size) == 21 * sizeof(srec));
+        }
+
+        // append mode keeps the existing contents
+        {
+            MappedFile mf(filename, BinaryFile::appending);
+            KSS_ASSERT(mf.size() == 21 * sizeof(srec));
+            MappedFile mf2;
+            mf2 = move(mf);
+            KSS_ASSERT(!mf.isOpenFor(BinaryFile::reading));
+            KSS_ASSERT(mf2.isOpenFor(BinaryFile::appending));
+            KSS_ASSERT(reinterpret_cast<const srec*>(mf2.data())[20].l == 20L);
+        }
+    }),
+    make_pair("MappedFileOf", [] {
+        static constexpr size_t numRecords = 100000;
+        const string filename = temporaryFilename("/tmp/mfo");
+        {
+            FileOf<srec> fo(filename, BinaryFile::writing);
+            for (size_t i = 0; i < numRecords; ++i) {
+                fo << srec { (int)i, (long)i };
+            }
+        }
+
+        MappedFileOf<srec> mfo(filename);
+        KSS_ASSERT(mfo.size() == numRecords && !mfo.empty());
+        KSS_ASSERT(mfo[0].i == 0 && mfo[12345].l == 12345L);
+        KSS_ASSERT(mfo.at(numRecords-1).i == (int)numRecords-1);
+        KSS_ASSERT(throwsException<out_of_range>([&] { mfo.at(numRecords); }));
+        KSS_ASSERT(throwsException<invalid_argument>([&] {
+            mfo.advise(MappedFileOf<srec>::Advice::random, numRecords, 1);
+        }));
+        mfo.advise(MappedFileOf<srec>::Advice::random);
+
+        // The iterators are random access.
+        static_assert(is_same<iterator_traits<MappedFileOf<srec>::const_iterator>::iterator_category,
+                      random_access_iterator_tag>::value, "not random access");
+        KSS_ASSERT(size_t(mfo.end() - mfo.begin()) == numRecords);
+        KSS_ASSERT((mfo.begin() + 10)->i == 10);
+        const auto it = lower_bound(mfo.begin(), mfo.end(), 777, [](const srec& r, int i) {
+            return r.i < i;
+        });
+        KSS_ASSERT(it != mfo.end() && it->l == 777L);
+        int i = 0;
+        for (const srec& r : mfo) {
+            KSS_ASSERT(r.i == i && r.l == (long)i);
+            ++i;
+        }
+        KSS_ASSERT(i == (int)numRecords);
+
+        MappedFileOf<srec> mfo2;
+        mfo2 = move(mfo);
+        KSS_ASSERT(mfo2.size() == numRecords && mfo.empty());
+
+        // A file whose size is not a multiple of the record size is rejected.
+        {
+            BinaryFile bf(filename, BinaryFile::appending);
+            bf.writeFully("x", 1);
+        }
+        KSS_ASSERT(throwsException<invalid_argument>([&] { MappedFileOf<srec> m(filename); }));
+
+        // Random lookups agree with FileOf.
+        static constexpr size_t numLookups = 1000;
+        mt19937 gen(1);
+        uniform_int_distribution<size_t> dist(0, numRecords-1);
+        FileOf<srec> fo(filename);
+        for (size_t j = 0; j < numLookups; ++j) {
+            const auto recNo = dist(gen);
+            KSS_ASSERT(mfo2[recNo].l == fo.read(recNo).l);
+        }
+    }),
+    make_pair("readAt/writeAt", [] {
+        static constexpr size_t numRecords = 10000;
+        const string filename = temporaryFilename("/tmp/rat");
+        FileOf<srec> fo(filename, BinaryFile::writing | BinaryFile::updating);
+        for (size_t i = 0; i < numRecords; ++i) {
+            fo << srec { (int)i, (long)i };
+        }
+        fo.flush();
+
+        // Positional access neither uses nor changes the file position.
+        fo.setPosition(5);
+        fo.writeAt(srec { 7, -7L }, 7);
+        KSS_ASSERT(fo.readAt(7).l == -7L);
+        KSS_ASSERT(fo.readAt(numRecords-1).i == (int)numRecords-1);
+        KSS_ASSERT(throwsException<kss::io::Eof>([&] { fo.readAt(numRecords); }));
+        KSS_ASSERT(fo.position() == 5);
+        fo.writeAt(srec { 7, 7L }, 7);
+
+        // Several threads may read the same file at once.
+        vector<future<bool>> readers;
+        for (size_t t = 0; t < 4; ++t) {
+            readers.push_back(async(launch::async, [&fo, t] {
+                for (size_t i = t; i < numRecords; i += 4) {
+                    const auto r = fo.readAt(i);
+                    if (r.i != (int)i || r.l != (long)i) {
+                        return false;
+                    }
+                }
+                return true;
+            }));
+        }
+        for (auto& r : readers) {
+            KSS_ASSERT(r.get());
+        }
+        KSS_ASSERT(fo.position() == 5);
+
+        BinaryFile bf(filename, BinaryFile::reading | BinaryFile::updating);
+        uint8_t buf[10];
+        KSS_ASSERT(bf.readAt(off_t(numRecords * sizeof(srec)) - 4, buf, sizeof(buf)) == 4);
+        KSS_ASSERT(bf.readAt(off_t(numRecords * sizeof(srec)), buf, sizeof(buf)) == 0);
+        KSS_ASSERT(throwsException<invalid_argument>([&] { bf.readAt(-1, buf, 1); }));
+        KSS_ASSERT(throwsException<invalid_argument>([&] { bf.readAt(0, nullptr, 1); }));
+        KSS_ASSERT(throwsException<invalid_argument>([&] { bf.writeAt(0, buf, 0); }));
+        bf.writeAt(1, "abc", 3);
+        KSS_ASSERT(bf.readAt(1, buf, 3) == 3 && !memcmp(buf, "abc", 3));
+        KSS_ASSERT(bf.tell() == 0);
+    }),
+    make_pair("FileOf readN/writeN", [] {
+        static constexpr size_t numRecords = 100000;
+        vector<srec> recs;
+        for (size_t i = 0; i < numRecords; ++i) {
+            recs.push_back(srec { (int)i, (long)i });
+        }
+
+        const string filename = temporaryFilename("/tmp/bulk");
+        {
+            FileOf<srec> fo(filename, BinaryFile::writing | BinaryFile::updating);
+            fo.writeN(recs.data(), 10);
+            fo.write(recs.begin() + 10, recs.begin() + 20);
+            fo.write(recs.data() + 20, recs.data() + 20);
+            fo.writeN(nullptr, 0);
+            list<srec> l(recs.begin() + 20, recs.end());
+            fo.write(l.begin(), l.end());
+            KSS_ASSERT(fo.position() == numRecords);
+            KSS_ASSERT(throwsException<invalid_argument>([&] { fo.writeN(nullptr, 1); }));
+
+            vector<srec> in(numRecords + 10);
+            fo.setPosition(3);
+            KSS_ASSERT(fo.readN(in.data(), 5) == 5);
+            KSS_ASSERT(in[0].i == 3 && in[4].l == 7L);
+            KSS_ASSERT(fo.position() == 8);
+            fo.rewind();
+            KSS_ASSERT(fo.readN(in.data(), in.size()) == numRecords);
+            KSS_ASSERT(equal(recs.begin(), recs.end(), in.begin(), [](const srec& a, const srec& b) {
+                return a.i == b.i && a.l == b.l;
+            }));
+            KSS_ASSERT(fo.readN(in.data(), 1) == 0);
+            KSS_ASSERT(throwsException<invalid_argument>([&] { fo.readN(nullptr, 1); }));
+        }
+
+        // A trailing partial record is left unread.
+        {
+            BinaryFile bf(filename, BinaryFile::appending);
+            bf.writeFully("x", 1);
+        }
+        {
+            FileOf<srec> fo(filename);
+            vector<srec> in(2);
+            fo.setPosition(numRecords - 1);
+            KSS_ASSERT(fo.readN(in.data(), 2) == 1);
+            KSS_ASSERT(in[0].i == (int)numRecords - 1);
+            KSS_ASSERT(fo.position() == numRecords);
+        }
+    }),
+    make_pair("buffer sizes", [] {
+        const string filename = temporaryFilename("/tmp/bufsz");
+        KSS_ASSERT(throwsException<invalid_argument>([&] {
+            BinaryFile(filename, BinaryFile::writing, 0);
+        }));
+
+        // Caller supplied buffer.
+        {
+            vector<char> buffer(1000);
+            FileOf<srec> fo(filename, BinaryFile::writing, buffer.size(), buffer.data());
+            for (int i = 0; i < 100; ++i) {
+                fo << srec { i, (long)i };
+            }
+        }
+        {
+            FileOf<srec> fo(filename, BinaryFile::reading, 100);
+            int i = 0;
+            for (const srec& r : fo) {
+                KSS_ASSERT(r.i == i && r.l == (long)i);
+                ++i;
+            }
+            KSS_ASSERT(i == 100);
+        }
+    }),
+    make_pair("direct mode", [] {
+        const string filename = temporaryFilename("/tmp/direct");
+        try {
+            BinaryFile bf(filename, BinaryFile::writing | BinaryFile::direct);
+        }
+        catch (const system_error& e) {
+            if (e.code().value() == EINVAL) {
+                // Direct I/O is not supported by the file system holding /tmp.
+                return;
+            }
+            throw;
+        }
+
+        // Sequential writes, with a final partial block, then reads.
+        static constexpr size_t numRecords = 100001;
+        vector<srec> recs;
+        for (size_t i = 0; i < numRecords; ++i) {
+            recs.push_back(srec { (int)i, (long)i });
+        }
+        {
+            FileOf<srec> fo(filename, BinaryFile::writing | BinaryFile::direct);
+            KSS_ASSERT(fo.position() == 0);
+            fo.writeN(recs.data(), 1000);
+            for (size_t i = 1000; i < 2000; ++i) {
+                fo << recs[i];
+            }
+            fo.write(recs.begin() + 2000, recs.end());
+            KSS_ASSERT(fo.position() == numRecords);
+        }
+        KSS_ASSERT(sizeOf(filename) == numRecords * sizeof(srec));
+        {
+            FileOf<srec> fo(filename, BinaryFile::reading | BinaryFile::direct);
+            int i = 0;
+            for (const srec& r : fo) {
+                KSS_ASSERT(r.i == i && r.l == (long)i);
+                ++i;
+            }
+            KSS_ASSERT(i == (int)numRecords);
+            KSS_ASSERT(fo.readAt(12345).l == 12345L);
+            KSS_ASSERT(throwsException<kss::io::Eof>([&] { fo.readAt(numRecords); }));
+        }
+
+        // Updates within partial blocks keep the surrounding data.
+        {
+            FileOf<srec> fo(filename, BinaryFile::reading | BinaryFile::updating | BinaryFile::direct, 10000);
+            fo.write(srec { -1, -1L }, 7);
+            fo.writeAt(srec { -2, -2L }, 50000);
+            fo.flush();
+            KSS_ASSERT(fo.read(7).l == -1L && fo.read().l == 8L);
+            KSS_ASSERT(fo.read(49999).l == 49999L && fo.read().l == -2L && fo.read().l == 50001L);
+            KSS_ASSERT(sizeOf(filename) == numRecords * sizeof(srec));
+        }
+
+        // Appending.
+        {
+            FileOf<srec> fo(filename, BinaryFile::appending | BinaryFile::direct);
+            KSS_ASSERT(fo.position() == numRecords);
+            fo << srec { (int)numRecords, (long)numRecords };
+        }
+        KSS_ASSERT(sizeOf(filename) == (numRecords + 1) * sizeof(srec));
+        {
+            FileOf<srec> fo(filename, BinaryFile::reading | BinaryFile::direct);
+            KSS_ASSERT(fo.read(numRecords-1).l == (long)numRecords-1);
+            KSS_ASSERT(fo.read().l == (long)numRecords);
+            KSS_ASSERT(fo.read(7).l == -1L);
+        }
+
+        // The data should not have gone through the page cache.
+        KSS_ASSERT(residentPages(filename) == 0);
+    }),
+    make_pair("prefetching iterator", [] {
+        static constexpr size_t numRecords = 2000000;
+        const string filename = temporaryFilename("/tmp/prefetch");
+        {
+            vector<srec> recs;
+            for (size_t i = 0; i < numRecords; ++i) {
+                recs.push_back(srec { (int)i, (long)i });
+            }
+            FileOf<srec> fo(filename, BinaryFile::writing);
+            fo.writeN(recs.data(), recs.size());
+        }
+
+        FileOf<srec> fo(filename);
+        KSS_ASSERT(throwsException<invalid_argument>([&] { fo.pbegin(0); }));
+        KSS_ASSERT(fo.pbegin() != fo.pend());
+        KSS_ASSERT(fo.pend() == FileOf<srec>::prefetching_iterator());
+        auto it = fo.pbegin(1);
+        KSS_ASSERT(it->i == 0 && (*it++).i == 0 && it->i == 1);
+
+#if defined(__linux)
+        // Starting a scan with the file outside the page cache should bring the pages
+        // ahead of the position into the cache, while reading the first record with
+        // an input_iterator brings in only a few. The prefetch is asynchronous, so we
+        // allow it some time to complete. If the file system holding /tmp cannot drop
+        // the file from the page cache (tmpfs, for example) there is nothing to check.
+        const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+        const size_t prefetchPages = FileOf<srec>::defaultPrefetchBytes / pageSize;
+        evict(filename);
+        if (residentPages(filename) == 0) {
+            {
+                auto iit = fo.begin();
+                KSS_ASSERT(iit->i == 0);
+                KSS_ASSERT(residentPages(filename) < prefetchPages);
+            }
+            evict(filename);
+            {
+                auto pit = fo.pbegin();
+                KSS_ASSERT(pit->i == 0);
+                for (int i = 0; i < 200 && residentPages(filename) < prefetchPages; ++i) {
+                    this_thread::sleep_for(chrono::milliseconds(10));
+                }
+                KSS_ASSERT(residentPages(filename) >= prefetchPages);
+            }
+        }
+#endif
+
+        // A complete scan sees every record in order.
+        size_t count = 0;
+        for (auto pit = fo.pbegin(); pit != fo.pend(); ++pit) {
+            if (pit->i != (int)count) {
+                break;
+            }
+            ++count;
+        }
+        KSS_ASSERT(count == numRecords);
+
+        // A file that is empty or that holds only a partial record has no records.
+        const string empty = temporaryFilename("/tmp/prefetch0");
+        {
+            BinaryFile bf(empty, BinaryFile::writing);
+            bf.writeFully("x", 1);
+        }
+        FileOf<srec> fo0(empty);
+        KSS_ASSERT(fo0.pbegin() == fo0.pend());
+    }),
+    make_pair("readv/writev", [] {
+        const string filename = temporaryFilename("/tmp/iov");
+        const string header = "HEADER";
+        const string trailer = "TRAILER";
+        const vector<char> smallPayload(100, 's');
+        const vector<char> largePayload(200000, 'L');
+
+        const auto iov = [](const void* p, size_t len) {
+            return iovec { const_cast<void*>(p), len };
+        };
+
+        {
+            BinaryFile bf(filename, BinaryFile::writing | BinaryFile::updating);
+            bf.writeFully("x", 1);
+
+            // Small, copied through the FILE* buffer.
+            iovec out1[] = {
+                iov(header.data(), header.size()),
+                iov(smallPayload.data(), smallPayload.size()),
+                iov(nullptr, 0),
+                iov(trailer.data(), trailer.size())
+            };
+            bf.writev(out1, 4);
+            KSS_ASSERT(size_t(bf.tell()) == 1 + header.size() + smallPayload.size() + trailer.size());
+
+            // Large, written directly after what is still in the buffer.
+            iovec out2[] = {
+                iov(header.data(), header.size()),
+                iov(largePayload.data(), largePayload.size()),
+                iov(trailer.data(), trailer.size())
+            };
+            bf.writev(out2, 3);
+            bf.writeFully("y", 1);
+            const size_t expectedSize = 2 + 2*header.size() + smallPayload.size()
+                + largePayload.size() + 2*trailer.size();
+            KSS_ASSERT(size_t(bf.tell()) == expectedSize);
+
+            KSS_ASSERT(throwsException<invalid_argument>([&] { bf.writev(nullptr, 1); }));
+            KSS_ASSERT(throwsException<invalid_argument>([&] { bf.writev(out2, 0); }));
+
+            // Read it all back in two ways.
+            for (const size_t skip : { size_t(0), 1 + header.size() + smallPayload.size() + trailer.size() }) {
+                bf.seek(off_t(skip));
+                char x, y;
+                string h(header.size(), ' '), t(trailer.size(), ' ');
+                vector<char> payload(skip == 0 ? smallPayload.size() : largePayload.size());
+                if (skip == 0) {
+                    iovec in[] = { iov(&x, 1), iov(&h[0], h.size()), iov(payload.data(), payload.size()), iov(&t[0], t.size()) };
+                    bf.readv(in, 4);
+                    KSS_ASSERT(x == 'x' && h == header && payload == smallPayload && t == trailer);
+                }
+                else {
+                    iovec in[] = { iov(&h[0], h.size()), iov(payload.data(), payload.size()), iov(&t[0], t.size()), iov(&y, 1) };
+                    bf.readv(in, 4);
+                    KSS_ASSERT(y == 'y' && h == header && payload == largePayload && t == trailer);
+                }
+            }
+            KSS_ASSERT(size_t(bf.tell()) == expectedSize);
+
+            // Reading past the end of the file.
+            vector<char> big(100000);
+            iovec in = iov(big.data(), big.size());
+            bf.seek(off_t(expectedSize) - 50000);
+            KSS_ASSERT(throwsException<kss::io::Eof>([&] { bf.readv(&in, 1); }));
+            KSS_ASSERT(size_t(bf.tell()) == expectedSize);
+            bf.seek(off_t(expectedSize) - 10);
+            iovec small = iov(big.data(), 20);
+            KSS_ASSERT(throwsException<kss::io::Eof>([&] { bf.readv(&small, 1); }));
+        }
+
+        // Appending.
+        {
+            BinaryFile bf(filename, BinaryFile::appending);
+            const auto pos = size_t(bf.tell());
+            iovec out[] = { iov(largePayload.data(), largePayload.size()), iov("z", 1) };
+            bf.writev(out, 2);
+            KSS_ASSERT(size_t(bf.tell()) == pos + largePayload.size() + 1);
+            bf.flush();
+            KSS_ASSERT(sizeOf(filename) == pos + largePayload.size() + 1);
+        }
+    }),
+    make_pair("parallel processing", [] {
+        static constexpr size_t numRecords = 1000003;
+        const string filename = temporaryFilename("/tmp/parallel");
+        {
+            vector<srec> recs;
+            for (size_t i = 0; i < numRecords; ++i) {
+                recs.push_back(srec { (int)i, (long)i });
+            }
+            FileOf<srec> fo(filename, BinaryFile::writing);
+            fo.writeN(recs.data(), recs.size());
+        }
+        const long expectedSum = long(numRecords) * long(numRecords - 1) / 2;
+
+        FileOf<srec> fo(filename);
+        MappedFileOf<srec> mfo(filename);
+        KSS_ASSERT(fo.size() == numRecords);
+        vector<srec> batch(10);
+        KSS_ASSERT(fo.readNAt(numRecords - 5, batch.data(), batch.size()) == 5);
+        KSS_ASSERT(batch[4].i == (int)numRecords - 1);
+        fo.setPosition(3);
+
+        for (const size_t nThreads : { size_t(1), size_t(4), size_t(0) }) {
+            atomic<size_t> count { 0 };
+            atomic<long> sum { 0 };
+            parallelForEach(fo, nThreads, [&](const srec& r) {
+                ++count;
+                sum += r.l;
+            });
+            KSS_ASSERT(count == numRecords && sum == expectedSum);
+
+            count = 0;
+            parallelForEach(mfo, nThreads, [&](const srec& r) { ++count; });
+            KSS_ASSERT(count == numRecords);
+
+            const auto plus = [](long a, long b) { return a + b; };
+            const auto addRecord = [](long a, const srec& r) { return a + r.l; };
+            KSS_ASSERT(parallelReduce(fo, nThreads, 0L, addRecord, plus) == expectedSum);
+            KSS_ASSERT(parallelReduce(mfo, nThreads, 0L, addRecord, plus) == expectedSum);
+        }
+        KSS_ASSERT(fo.position() == 3);
+
+        // Exceptions are passed back once all the threads have stopped.
+        KSS_ASSERT(throwsException<runtime_error>([&] {
+            parallelForEach(fo, 4, [](const srec& r) {
+                if (r.i == 500000) {
+                    throw runtime_error("failed");
+                }
+            });
+        }));
+
+        // A failure on any thread stops the others from starting further chunks. Here
+        // the calling thread waits for one of the others to fail before it reads its
+        // records, so it should read no more than a couple of chunks.
+        const auto caller = this_thread::get_id();
+        atomic<bool> failed { false };
+        atomic<size_t> count { 0 };
+        KSS_ASSERT(throwsException<runtime_error>([&] {
+            parallelForEach(fo, 4, [&](const srec&) {
+                if (this_thread::get_id() != caller) {
+                    failed = true;
+                    throw runtime_error("failed");
+                }
+                while (!failed) {
+                    this_thread::yield();
+                }
+                ++count;
+            });
+        }));
+        KSS_ASSERT(count < numRecords / 2);
+
+        // An empty file.
+        const string empty = temporaryFilename("/tmp/parallel0");
+        FileOf<srec> fo0(empty, BinaryFile::writing | BinaryFile::updating);
+        KSS_ASSERT(fo0.size() == 0);
+        parallelForEach(fo0, 4, [](const srec&) { throw runtime_error("should not be called"); });
+        KSS_ASSERT(parallelReduce(fo0, 4, 0L, [](long a, const srec& r) { return a + r.l; },
+                                  [](long a, long b) { return a + b; }) == 0L);
+    }),
+    make_pair("VarRecordFile", [] {
+        const string filename = temporaryFilename("/tmp/varrec");
+        const string indexName = VarRecordFile::indexFilename(filename);
+        const auto recordFor = [](size_t i) {
+            return (i % 10 == 0 ? string() : "record " + to_string(i) + string(i % 100, '.'));
+        };
+
+        // Batched and single appends.
+        static constexpr size_t numRecords = 100000;
+        {
+            VarRecordFile vf(filename, BinaryFile::writing);
+            KSS_ASSERT(vf.empty() && vf.isOpenFor(BinaryFile::writing));
+            vf.append(recordFor(0));
+            vector<string> recs;
+            for (size_t i = 1; i < numRecords - 1; ++i) {
+                recs.push_back(recordFor(i));
+            }
+            vf.append(recs.begin(), recs.end());
+            const auto last = recordFor(numRecords - 1);
+            vf.append(last.data(), last.size());
+            KSS_ASSERT(vf.size() == numRecords);
+            KSS_ASSERT(vf.read(0).empty() && vf.read(1) == recordFor(1));
+            KSS_ASSERT(vf.read(numRecords - 1) == recordFor(numRecords - 1));
+            KSS_ASSERT(throwsException<invalid_argument>([&] { vf.read(numRecords); }));
+            KSS_ASSERT(throwsException<invalid_argument>([&] { vf.append(nullptr, 1); }));
+            vf.append(nullptr, 0);
+            KSS_ASSERT(vf.size() == numRecords + 1);
+        }
+
+        // Random reads from a read only file.
+        {
+            VarRecordFile vf(filename);
+            KSS_ASSERT(!vf.isOpenFor(BinaryFile::writing));
+            KSS_ASSERT(vf.size() == numRecords + 1);
+            mt19937 gen(1);
+            uniform_int_distribution<size_t> dist(0, numRecords-1);
+            for (size_t i = 0; i < 1000; ++i) {
+                const auto recNo = dist(gen);
+                KSS_ASSERT(vf.read(recNo) == recordFor(recNo));
+                KSS_ASSERT(vf.recordSize(recNo) == recordFor(recNo).size());
+            }
+            KSS_ASSERT(vf.read(numRecords).empty());
+        }
+
+        // Appending to an existing file.
+        {
+            VarRecordFile vf(filename, BinaryFile::appending);
+            KSS_ASSERT(vf.size() == numRecords + 1);
+            vf.append(string("appended"));
+            vf.flush();
+            KSS_ASSERT(sizeOf(indexName) == (numRecords + 2) * sizeof(uint64_t));
+        }
+
+        // A missing or out of date index is rebuilt, and a partial record removed.
+        const auto dataSize = sizeOf(filename);
+        {
+            BinaryFile bf(filename, BinaryFile::appending);
+            const uint32_t len = 100;
+            bf.writeFully(&len, sizeof(len));
+            bf.writeFully("partial", 7);
+        }
+        KSS_ASSERT(sizeOf(filename) == dataSize + 11);
+        {
+            VarRecordFile vf(filename);
+            KSS_ASSERT(vf.size() == numRecords + 2);
+        }
+        KSS_ASSERT(truncate(indexName.c_str(), off_t(10 * sizeof(uint64_t) + 3)) == 0);
+        {
+            VarRecordFile vf(filename);
+            KSS_ASSERT(vf.size() == 10);
+            KSS_ASSERT(vf.read(9) == recordFor(9));
+        }
+        {
+            VarRecordFile vf(filename, BinaryFile::reading | BinaryFile::updating);
+            KSS_ASSERT(vf.size() == numRecords + 2);
+            KSS_ASSERT(vf.read(numRecords + 1) == "appended");
+            KSS_ASSERT(vf.read(54321) == recordFor(54321));
+        }
+        KSS_ASSERT(sizeOf(filename) == dataSize);
+        KSS_ASSERT(sizeOf(indexName) == (numRecords + 2) * sizeof(uint64_t));
+
+        unlink(indexName.c_str());
+        KSS_ASSERT(throwsException<system_error>([&] { VarRecordFile vf(filename); }));
+        {
+            VarRecordFile vf(filename, BinaryFile::appending);
+            KSS_ASSERT(vf.size() == numRecords + 2);
+            KSS_ASSERT(vf.read(777) == recordFor(777));
+        }
+
+        KSS_ASSERT(throwsException<invalid_argument>([&] { VarRecordFile vf(filename, 0); }));
+        KSS_ASSERT(throwsException<invalid_argument>([] { VarRecordFile vf(""); }));
+
+        // A new file in append mode.
+        const string newFilename = temporaryFilename("/tmp/varrec_new");
+        {
+            VarRecordFile vf(newFilename, BinaryFile::appending);
+            KSS_ASSERT(vf.empty());
+            vf.append(string("one"));
+        }
+        VarRecordFile vf(newFilename);
+        KSS_ASSERT(vf.size() == 1 && vf.read(0) == "one");
+
+        // A process that exits without closing the file leaves the space reserved for
+        // the index, which must not be mistaken for records.
+        const string crashFilename = temporaryFilename("/tmp/varrec_crash");
+        const string crashIndexName = VarRecordFile::indexFilename(crashFilename);
+        const pid_t pid = fork();
+        if (pid == 0) {
+            VarRecordFile cvf(crashFilename, BinaryFile::appending);
+            cvf.append(string("one"));
+            cvf.append(string("two"));
+            cvf.append(string("three"));
+            _exit(0);
+        }
+        int status = 0;
+        KSS_ASSERT(pid > 0 && waitpid(pid, &status, 0) == pid);
+        KSS_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        KSS_ASSERT(sizeOf(crashIndexName) > 3 * sizeof(uint64_t));
+        for (const auto mode : { BinaryFile::reading, BinaryFile::appending }) {
+            VarRecordFile cvf(crashFilename, mode);
+            KSS_ASSERT(cvf.size() == 3);
+            KSS_ASSERT(cvf.read(0) == "one" && cvf.read(1) == "two" && cvf.read(2) == "three");
+            KSS_ASSERT(cvf.recordSize(2) == 5);
+        }
+        KSS_ASSERT(sizeOf(crashIndexName) == 3 * sizeof(uint64_t));
+        unlink(crashIndexName.c_str());
+        unlink(crashFilename.c_str());
     })
 });
@@ -0,0 +1,289 @@
+//
+//  completion_poller.cpp
+//  unittest
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <kss/io/completion_poller.hpp>
+#include <kss/io/fileutil.hpp>
+#include <kss/test/all.h>
+
+using namespace std;
+using namespace kss::io;
+using namespace kss::test;
+
+namespace {
+
+    // Delegate that records the completions, stopping once it has seen enough of them.
+    class RecordingDelegate : public CompletionPollerDelegate {
+    public:
+        atomic<bool>    shouldStop { false };
+        size_t          expected { 0 };
+        size_t          numReads { 0 };
+        size_t          numWrites { 0 };
+        size_t          numAccepts { 0 };
+        ssize_t         bytesRead { 0 };
+        ssize_t         bytesWritten { 0 };
+        int             accepted { -1 };
+
+        bool completionPollerShouldStop() const override {
+            return shouldStop || (expected > 0 && numReads + numWrites + numAccepts >= expected);
+        }
+
+        void completionPollerReadHasCompleted(CompletionPoller&,
+                                              const CompletionOperation& op,
+                                              ssize_t result) override
+        {
+            ++numReads;
+            if (result > 0) { bytesRead += result; }
+        }
+
+        void completionPollerWriteHasCompleted(CompletionPoller&,
+                                               const CompletionOperation& op,
+                                               ssize_t result) override
+        {
+            ++numWrites;
+            if (result > 0) { bytesWritten += result; }
+        }
+
+        void completionPollerAcceptHasCompleted(CompletionPoller&,
+                                                const CompletionOperation& op,
+                                                ssize_t result) override
+        {
+            ++numAccepts;
+            accepted = static_cast<int>(result);
+        }
+    };
+
+    // Create a connected pair of non-blocking sockets.
+    pair<int, int> makeSocketPair(int type = SOCK_STREAM) {
+        int sv[2];
+        if (socketpair(AF_UNIX, type, 0, sv) == -1) {
+            throw system_error(errno, system_category(), "socketpair");
+        }
+        for (const auto fd : sv) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+        return make_pair(sv[0], sv[1]);
+    }
+
+    // The engines that should work on this platform.
+    vector<CompletionPoller::Engine> availableEngines() {
+        vector<CompletionPoller::Engine> engines { CompletionPoller::Engine::emulated };
+        if (CompletionPoller().engine() == CompletionPoller::Engine::ioUring) {
+            engines.push_back(CompletionPoller::Engine::ioUring);
+        }
+        return engines;
+    }
+}
+
+
+static TestSuite ts("completion_poller", {
+    make_pair("engines", [] {
+        CompletionPoller p;
+        KSS_ASSERT(p.engine() != CompletionPoller::Engine::automatic);
+        KSS_ASSERT(CompletionPoller(CompletionPoller::Engine::emulated).engine()
+                   == CompletionPoller::Engine::emulated);
+#if !defined(__linux)
+        KSS_ASSERT(throwsException<invalid_argument>([] {
+            CompletionPoller p(CompletionPoller::Engine::ioUring);
+        }));
+#endif
+        KSS_ASSERT(throwsException<runtime_error>([&] { p.run(); }));
+
+        CompletionOperation op;
+        op.type = CompletionOperation::Type::read;
+        op.filedes = -1;
+        KSS_ASSERT(throwsException<invalid_argument>([&] { p.submit(op); }));
+        op.filedes = 0;
+        KSS_ASSERT(throwsException<invalid_argument>([&] { p.submit(op); }));
+        KSS_ASSERT(p.size() == 0);
+    }),
+    make_pair("read and write", [] {
+        static constexpr size_t numMessages = 100;
+        static const string message = "this is a test";
+
+        for (const auto engine : availableEngines()) {
+            // Datagrams are used so that each read receives exactly one write.
+            const auto sv = makeSocketPair(SOCK_DGRAM);
+            file::FiledesGuard g0(sv.first);
+            file::FiledesGuard g1(sv.second);
+
+            CompletionPoller p(engine);
+            RecordingDelegate d;
+            d.expected = numMessages * 2;
+            p.setDelegate(&d);
+
+            // Submit all the writes and reads in one batch.
+            vector<char> inbuf(message.size() * numMessages);
+            CompletionOperation op;
+            for (size_t i = 0; i < numMessages; ++i) {
+                op.type = CompletionOperation::Type::write;
+                op.filedes = sv.first;
+                op.buffer = const_cast<char*>(message.data());
+                op.length = message.size();
+                KSS_ASSERT(p.submit(op) != CompletionPoller::invalidHandle);
+
+                op.type = CompletionOperation::Type::read;
+                op.filedes = sv.second;
+                op.buffer = inbuf.data() + i * message.size();
+                p.submit(op);
+            }
+            KSS_ASSERT(p.size() == numMessages * 2);
+
+            p.run();
+            KSS_ASSERT(d.numWrites == numMessages);
+            KSS_ASSERT(d.numReads == numMessages);
+            KSS_ASSERT(d.bytesWritten == ssize_t(message.size() * numMessages));
+            KSS_ASSERT(d.bytesRead == d.bytesWritten);
+            KSS_ASSERT(string(inbuf.data(), message.size()) == message);
+            KSS_ASSERT(p.size() == 0);
+        }
+    }),
+    make_pair("accept", [] {
+        for (const auto engine : availableEngines()) {
+            const int listener = socket(AF_INET, SOCK_STREAM, 0);
+            KSS_ASSERT(listener != -1);
+            file::FiledesGuard lg(listener);
+
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = 0;
+            socklen_t len = sizeof(addr);
+            KSS_ASSERT(::bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+            KSS_ASSERT(listen(listener, 8) == 0);
+            KSS_ASSERT(getsockname(listener, (struct sockaddr*)&addr, &len) == 0);
+            fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+
+            CompletionPoller p(engine);
+            RecordingDelegate d;
+            d.expected = 1;
+            p.setDelegate(&d);
+
+            CompletionOperation op;
+            op.type = CompletionOperation::Type::accept;
+            op.filedes = listener;
+            p.submit(op);
+
+            const int client = socket(AF_INET, SOCK_STREAM, 0);
+            file::FiledesGuard cg(client);
+            KSS_ASSERT(connect(client, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+
+            p.run();
+            KSS_ASSERT(d.numAccepts == 1);
+            KSS_ASSERT(d.accepted >= 0);
+            if (d.accepted >= 0) {
+                file::FiledesGuard ag(d.accepted);
+                KSS_ASSERT((fcntl(d.accepted, F_GETFL) & O_NONBLOCK) != 0);
+                KSS_ASSERT((fcntl(d.accepted, F_GETFD) & FD_CLOEXEC) != 0);
+            }
+        }
+    }),
+    make_pair("wakeup", [] {
+        using namespace std::chrono_literals;
+        for (const auto engine : availableEngines()) {
+            const auto sv = makeSocketPair();
+            file::FiledesGuard g0(sv.first);
+            file::FiledesGuard g1(sv.second);
+
+            // Nothing will ever be read, and the delegate waits forever, so run() will
+            // only notice the new write, and the stop, because of the wakeups.
+            struct WaitingDelegate : public RecordingDelegate {
+                chrono::milliseconds completionPollerMaximumWaitInterval() const override {
+                    return chrono::milliseconds::max();
+                }
+            } d;
+
+            CompletionPoller p(engine);
+            p.setDelegate(&d);
+
+            char buffer[10];
+            CompletionOperation op;
+            op.type = CompletionOperation::Type::read;
+            op.filedes = sv.first;
+            op.buffer = buffer;
+            op.length = sizeof(buffer);
+            p.submit(op);
+
+            auto fut = async(launch::async, [&] { p.run(); });
+            this_thread::sleep_for(50ms);
+
+            static const string message = "x";
+            op.type = CompletionOperation::Type::write;
+            op.filedes = sv.first;
+            op.buffer = const_cast<char*>(message.data());
+            op.length = message.size();
+            p.submit(op);
+            this_thread::sleep_for(50ms);
+
+            d.shouldStop = true;
+            p.wakeup();
+            const auto status = fut.wait_for(1s);
+            KSS_ASSERT(status == future_status::ready);
+            if (status != future_status::ready) {
+                // Unblock the poller so that the test can finish.
+                ::write(sv.second, "x", 1);
+            }
+            fut.get();
+            KSS_ASSERT(d.numWrites == 1);
+        }
+    }),
+    make_pair("destruction", [] {
+        using namespace std::chrono_literals;
+        for (const auto engine : availableEngines()) {
+            const auto sv = makeSocketPair();
+            file::FiledesGuard g0(sv.first);
+            file::FiledesGuard g1(sv.second);
+
+            // Leave a read outstanding when the poller is destroyed. Once the destructor
+            // returns it must no longer consume data or write to the buffer.
+            vector<char> buffer(10, '-');
+            {
+                RecordingDelegate d;
+                CompletionPoller p(engine);
+                p.setDelegate(&d);
+
+                CompletionOperation op;
+                op.type = CompletionOperation::Type::read;
+                op.filedes = sv.first;
+                op.buffer = buffer.data();
+                op.length = buffer.size();
+                p.submit(op);
+
+                auto fut = async(launch::async, [&] { p.run(); });
+                this_thread::sleep_for(50ms);
+                d.shouldStop = true;
+                p.wakeup();
+                fut.get();
+                KSS_ASSERT(d.numReads == 0);
+                KSS_ASSERT(p.size() == 1);
+            }
+
+            KSS_ASSERT(::write(sv.second, "x", 1) == 1);
+            this_thread::sleep_for(10ms);
+            char ch = 0;
+            KSS_ASSERT(::read(sv.first, &ch, 1) == 1 && ch == 'x');
+            KSS_ASSERT(buffer == vector<char>(10, '-'));
+        }
+    })
+});
@@ -7,15 +7,26 @@
 //  Licensing follows the MIT License.
 //
 
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <unistd.h>
 
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 
@@ -27,6 +38,50 @@ using namespace std;
 using namespace kss::io;
 using namespace kss::test;
 
+// Allocation counting hook, used to check that the poller does not allocate while
+// dispatching events. The replacement operator new behaves as the standard one, and
+// only counts while countAllocations is switched on around the window being measured.
+namespace {
+    atomic<bool>    countAllocations { false };
+    atomic<size_t>  numAllocations { 0 };
+}
+
+void* operator new(size_t size) {
+    if (countAllocations) {
+        ++numAllocations;
+    }
+    while (true) {
+        if (void* ptr = malloc(size ? size : 1)) {
+            return ptr;
+        }
+        if (const auto handler = get_new_handler()) {
+            handler();
+        }
+        else {
+            throw bad_alloc();
+        }
+    }
+}
+
+// GCC warns about free() being given the result of operator new once it has inlined
+// our replacements, not realizing that they allocate with malloc().
+#if defined(__GNUC__) && !defined(__clang__)
+#   pragma GCC diagnostic push
+#   pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#   pragma GCC diagnostic pop
+#endif
+
 namespace {
 	void log(const string& msg) {
 		//cerr << msg << endl;
@@ -103,6 +158,172 @@ namespace {
 		size_t  numBytesRead { 0 };
 		size_t  numBytesWritten { 0 };
 	};
+
+    // Delegate that just counts the callbacks.
+    class CountingDelegate : public PollerDelegate {
+    public:
+        atomic<bool>    shouldStop { false };
+        atomic<size_t>  numReads { 0 };
+        atomic<size_t>  numWrites { 0 };
+        bool            waitForever { false };
+
+        bool pollerShouldStop() const override { return shouldStop; }
+
+        chrono::milliseconds pollerMaximumWaitInterval() const override {
+            return (waitForever ? chrono::milliseconds::max()
+                    : PollerDelegate::pollerMaximumWaitInterval());
+        }
+
+        void pollerResourceReadIsReady(Poller&, const PolledResource&) override {
+            ++numReads;
+        }
+
+        void pollerResourceWriteIsReady(Poller&, const PolledResource&) override {
+            ++numWrites;
+        }
+    };
+
+    // Delegate that records the handles passed to the write callbacks.
+    class RecordingDelegate : public PollerDelegate {
+    public:
+        atomic<bool>    shouldStop { false };
+
+        bool pollerShouldStop() const override { return shouldStop; }
+
+        void pollerResourceWriteIsReady(Poller&, const PolledResource& r) override {
+            lock_guard<mutex> lock(m);
+            ++numWrites[r.handle];
+        }
+
+        size_t writesFor(Poller::handle_t handle) {
+            lock_guard<mutex> lock(m);
+            return numWrites[handle];
+        }
+
+        void reset() {
+            lock_guard<mutex> lock(m);
+            numWrites.clear();
+        }
+
+    private:
+        mutex                           m;
+        map<Poller::handle_t, size_t>   numWrites;
+    };
+
+    // Delegate that replaces its one shot resource with a new one each time it is
+    // reported, simulating a connection arriving and another leaving on each pass
+    // through the poller.
+    class ChurningDelegate : public PollerDelegate {
+    public:
+        PolledResource  resource;
+        size_t          numChurns { 0 };
+        size_t          maxChurns { 0 };
+
+        bool pollerShouldStop() const override { return numChurns >= maxChurns; }
+
+        void pollerResourceWriteIsReady(Poller& p, const PolledResource& r) override {
+            p.remove(r.handle);
+            p.add(resource);
+            ++numChurns;
+        }
+    };
+
+    // Delegate that records when each timer expires.
+    class TimerDelegate : public PollerDelegate {
+    public:
+        using clock = chrono::steady_clock;
+
+        struct Expiration {
+            string                  name;
+            Poller::handle_t        handle;
+            chrono::milliseconds    elapsed;
+        };
+
+        const clock::time_point start { clock::now() };
+        vector<Expiration>      expirations;
+        size_t                  numPeriodic { 0 };
+
+        bool pollerShouldStop() const override { return false; }
+
+        chrono::milliseconds pollerMaximumWaitInterval() const override {
+            return chrono::milliseconds::max();
+        }
+
+        void pollerTimerHasExpired(Poller& p, const PollerTimer& timer) override {
+            const auto elapsed = chrono::duration_cast<chrono::milliseconds>(clock::now() - start);
+            expirations.push_back(Expiration { timer.name, timer.handle, elapsed });
+            if (timer.name == "periodic" && ++numPeriodic == 5) {
+                p.cancel(timer.handle);
+            }
+        }
+    };
+
+    // Delegate that counts events until it has seen a given number, counting the
+    // allocations made once it has warmed up.
+    class DispatchDelegate : public PollerDelegate {
+    public:
+        static constexpr size_t warmup = 1000;
+
+        size_t  numEvents { 0 };
+        size_t  maxEvents { 0 };
+        size_t  allocations { 0 };
+
+        bool pollerShouldStop() const override { return numEvents >= maxEvents; }
+
+        void pollerResourceWriteIsReady(Poller&, const PolledResource&) override {
+            if (++numEvents == warmup) {
+                numAllocations = 0;
+                countAllocations = true;
+            }
+            else if (numEvents == maxEvents) {
+                countAllocations = false;
+                allocations = numAllocations;
+            }
+        }
+    };
+
+    // Delegate that handles the events in batches.
+    class BatchDelegate : public PollerDelegate {
+    public:
+        size_t          numBatches { 0 };
+        size_t          largestBatch { 0 };
+        size_t          numIndividual { 0 };
+        set<string>     names;
+
+        bool pollerShouldStop() const override { return numBatches >= 5; }
+
+        void pollerResourcesAreReady(Poller&, const vector<PolledEvent>& events) override {
+            ++numBatches;
+            largestBatch = max(largestBatch, events.size());
+            for (const auto& ev : events) {
+                if (ev.writeIsReady && !ev.readIsReady) {
+                    names.insert(ev.resource->name);
+                }
+            }
+        }
+
+        void pollerResourceWriteIsReady(Poller&, const PolledResource&) override {
+            ++numIndividual;
+        }
+    };
+
+    // Create a connected pair of sockets.
+    pair<int, int> makeSocketPair() {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+            throw system_error(errno, system_category(), "socketpair");
+        }
+        return make_pair(sv[0], sv[1]);
+    }
+
+    // The engines that should work on this platform.
+    vector<Poller::Engine> availableEngines() {
+#if defined(__linux)
+        return { Poller::Engine::poll, Poller::Engine::epoll };
+#else
+        return { Poller::Engine::poll };
+#endif
+    }
 }
 
 
@@ -117,37 +338,505 @@ static TestSuite ts("poller", {
         p.run();
         KSS_ASSERT(true);    // Nothing to check other than it exited.
     }),
+    make_pair("engines", [] {
+        KSS_ASSERT(Poller().engine() != Poller::Engine::automatic);
+        KSS_ASSERT(Poller(Poller::Engine::poll).engine() == Poller::Engine::poll);
+#if defined(__linux)
+        KSS_ASSERT(Poller().engine() == Poller::Engine::epoll);
+        KSS_ASSERT(Poller(Poller::Engine::epoll).engine() == Poller::Engine::epoll);
+#else
+        KSS_ASSERT(Poller().engine() == Poller::Engine::poll);
+        KSS_ASSERT(throwsException<invalid_argument>([] { Poller p(Poller::Engine::epoll); }));
+#endif
+    }),
     make_pair("file read test", [] {
         static const string mydata = "this is my write test data";
         static constexpr size_t numWrites = 5;
 
-        KSS_ASSERT(isEqualTo<size_t>(mydata.length() * numWrites, [] {
-            // Setup the file.
-            file::FileGuard fg(tmpfile());
-            log("before write");
-            for (size_t i = 0; i < numWrites; ++i) {
-                fwrite(mydata.data(), mydata.size(), 1, fg.file());
+        for (const auto engine : availableEngines()) {
+            KSS_ASSERT(isEqualTo<size_t>(mydata.length() * numWrites, [engine] {
+                // Setup the file.
+                file::FileGuard fg(tmpfile());
+                log("before write");
+                for (size_t i = 0; i < numWrites; ++i) {
+                    fwrite(mydata.data(), mydata.size(), 1, fg.file());
+                }
+                fflush(fg.file());
+                rewind(fg.file());
+                log("after write");
+
+                Poller p(engine);
+                MyDelegate d;
+                p.setDelegate(&d);
+
+                PolledResource r;
+                r.name = "readTest";
+                r.filedes = fileno(fg.file());
+                r.event = PolledResource::Event::read;
+                r.payload = reinterpret_cast<void*>(0x0A);
+                p.add(r);
+
+                auto fut = async([&] {
+                    p.run();
+                    return d.numRead();
+                });
+                return fut.get();
+            }));
+        }
+    }),
+    make_pair("socket read test", [] {
+        static const string mydata = "this is my socket test data";
+        static constexpr size_t numWrites = 50;
+
+        for (const auto engine : availableEngines()) {
+            KSS_ASSERT(isEqualTo<size_t>(mydata.length() * numWrites, [engine] {
+                int sv[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+                    throw system_error(errno, system_category(), "socketpair");
+                }
+                file::FiledesGuard g0(sv[0]);
+
+                Poller p(engine);
+                MyDelegate d;
+                p.setDelegate(&d);
+
+                PolledResource r;
+                r.name = "socketTest";
+                r.filedes = sv[0];
+                r.event = PolledResource::Event::read;
+                p.add(r);
+
+                thread writer([&] {
+                    for (size_t i = 0; i < numWrites; ++i) {
+                        ::write(sv[1], mydata.data(), mydata.size());
+                    }
+                    close(sv[1]);
+                });
+
+                p.run();
+                writer.join();
+                return d.numRead();
+            }));
+        }
+    }),
+    make_pair("one shot and edge triggered", [] {
+        using namespace std::chrono_literals;
+        const vector<PolledResource::Mode> modes {
+            PolledResource::Mode::oneShot, PolledResource::Mode::edgeTriggered
+        };
+
+        for (const auto engine : availableEngines()) {
+            for (const auto mode : modes) {
+                const auto sv = makeSocketPair();
+                file::FiledesGuard g0(sv.first);
+                file::FiledesGuard g1(sv.second);
+
+                Poller p(engine);
+                CountingDelegate d;
+                p.setDelegate(&d);
+
+                // The socket is always writable, so only the first state change,
+                // and the rearm, should be reported.
+                PolledResource r;
+                r.name = "writeTest";
+                r.filedes = sv.first;
+                r.event = PolledResource::Event::write;
+                r.mode = mode;
+                p.add(r);
+
+                thread th([&] { p.run(); });
+                this_thread::sleep_for(250ms);
+                KSS_ASSERT(d.numWrites == 1);
+                p.rearm("writeTest");
+                this_thread::sleep_for(250ms);
+                KSS_ASSERT(d.numWrites == 2);
+                d.shouldStop = true;
+                th.join();
             }
-            fflush(fg.file());
-            rewind(fg.file());
-            log("after write");
+        }
+    }),
+    make_pair("wakeup", [] {
+        using namespace std::chrono_literals;
+        for (const auto engine : availableEngines()) {
+            const auto sv = makeSocketPair();
+            file::FiledesGuard g0(sv.first);
+            file::FiledesGuard g1(sv.second);
 
-            Poller p;
-            MyDelegate d;
+            Poller p(engine);
+            CountingDelegate d;
+            d.waitForever = true;
             p.setDelegate(&d);
 
+            // Nothing will ever be read, so without the wakeups run() would never
+            // notice the changes.
             PolledResource r;
-            r.name = "readTest";
-            r.filedes = fileno(fg.file());
+            r.name = "idle";
+            r.filedes = sv.first;
             r.event = PolledResource::Event::read;
-            r.payload = reinterpret_cast<void*>(0x0A);
             p.add(r);
 
-            auto fut = async([&] {
-                p.run();
-                return d.numRead();
-            });
-            return fut.get();
-        }));
+            auto fut = async(launch::async, [&] { p.run(); });
+            this_thread::sleep_for(50ms);
+
+            r.name = "writer";
+            r.filedes = sv.second;
+            r.event = PolledResource::Event::write;
+            r.mode = PolledResource::Mode::oneShot;
+            p.add(r);
+            this_thread::sleep_for(50ms);
+            KSS_ASSERT(d.numWrites == 1);
+
+            d.shouldStop = true;
+            p.wakeup();
+            const auto status = fut.wait_for(1s);
+            KSS_ASSERT(status == future_status::ready);
+            if (status != future_status::ready) {
+                // Unblock the poller so that the test can finish.
+                ::write(sv.second, "x", 1);
+            }
+            fut.get();
+        }
+    }),
+    make_pair("posted tasks", [] {
+        using namespace std::chrono_literals;
+        static constexpr size_t numThreads = 4;
+        static constexpr size_t tasksPerThread = 1000;
+
+        for (const auto engine : availableEngines()) {
+            const auto sv = makeSocketPair();
+            file::FiledesGuard g0(sv.first);
+            file::FiledesGuard g1(sv.second);
+
+            Poller p(engine);
+            CountingDelegate d;
+            d.waitForever = true;
+            p.setDelegate(&d);
+            KSS_ASSERT(throwsException<invalid_argument>([&] { p.post(function<void()>()); }));
+
+            // Nothing will ever be read, so the tasks are only run promptly because
+            // posting them interrupts the wait.
+            PolledResource r;
+            r.name = "idle";
+            r.filedes = sv.first;
+            r.event = PolledResource::Event::read;
+            p.add(r);
+
+            // The tasks only touch these from the poller thread.
+            set<thread::id> threads;
+            vector<vector<size_t>> sequences(numThreads);
+            size_t numReposts = 0;
+            bool ranBeforeStart = false;
+
+            p.post([&] { ranBeforeStart = true; });
+            p.post([] { throw runtime_error("this should be logged and ignored"); });
+            auto fut = async(launch::async, [&] { p.run(); });
+
+            vector<thread> posters;
+            for (size_t t = 0; t < numThreads; ++t) {
+                posters.emplace_back([&, t] {
+                    for (size_t i = 0; i < tasksPerThread; ++i) {
+                        p.post([&, t, i] {
+                            threads.insert(this_thread::get_id());
+                            sequences[t].push_back(i);
+                        });
+                    }
+                });
+            }
+            for (auto& th : posters) {
+                th.join();
+            }
+
+            promise<void> ran;
+            p.post([&] { ran.set_value(); });
+            KSS_ASSERT(ran.get_future().wait_for(1s) == future_status::ready);
+
+            // A task that reposts itself runs once per pass rather than looping.
+            promise<void> reposted;
+            function<void()> repost = [&] {
+                if (++numReposts < 10) {
+                    p.post(repost);
+                }
+                else {
+                    reposted.set_value();
+                }
+            };
+            p.post(repost);
+            KSS_ASSERT(reposted.get_future().wait_for(1s) == future_status::ready);
+
+            p.post([&] { d.shouldStop = true; });
+            const auto status = fut.wait_for(1s);
+            KSS_ASSERT(status == future_status::ready);
+            if (status != future_status::ready) {
+                d.shouldStop = true;
+                p.wakeup();
+            }
+            fut.get();
+
+            KSS_ASSERT(ranBeforeStart);
+            KSS_ASSERT(threads.size() == 1);
+            KSS_ASSERT(numReposts == 10);
+            KSS_ASSERT(d.numReads == 0);
+            for (const auto& seq : sequences) {
+                KSS_ASSERT(seq.size() == tasksPerThread);
+                KSS_ASSERT(is_sorted(seq.begin(), seq.end()));
+            }
+        }
+    }),
+    make_pair("mixed modes", [] {
+        Poller p;
+        PolledResource r;
+        r.name = "levelTest";
+        r.filedes = 1;
+        r.event = PolledResource::Event::write;
+        p.add(r);
+
+        r.name = "oneShotTest";
+        r.mode = PolledResource::Mode::oneShot;
+        KSS_ASSERT(throwsException<invalid_argument>([&] { p.add(r); }));
+        r.filedes = 2;
+        p.add(r);
+        KSS_ASSERT(true);
+    }),
+    make_pair("handles", [] {
+        using namespace std::chrono_literals;
+        for (const auto engine : availableEngines()) {
+            const auto sv = makeSocketPair();
+            file::FiledesGuard g0(sv.first);
+            file::FiledesGuard g1(sv.second);
+
+            Poller p(engine);
+            RecordingDelegate d;
+            p.setDelegate(&d);
+
+            PolledResource r;
+            r.name = "g";
+            r.filedes = sv.first;
+            r.event = PolledResource::Event::write;
+            const auto h1 = p.add(r);
+            const auto h2 = p.add(r);
+            r.name = "o";
+            r.filedes = sv.second;
+            const auto h3 = p.add(r);
+            KSS_ASSERT(h1 != Poller::invalidHandle && h2 != Poller::invalidHandle);
+            KSS_ASSERT(h1 != h2 && h1 != h3 && h2 != h3);
+
+            thread th([&] { p.run(); });
+            this_thread::sleep_for(50ms);
+            KSS_ASSERT(d.writesFor(h1) > 0 && d.writesFor(h2) > 0 && d.writesFor(h3) > 0);
+
+            // Removing by handle removes only that resource.
+            p.remove(h1);
+            this_thread::sleep_for(50ms);
+            d.reset();
+            this_thread::sleep_for(50ms);
+            KSS_ASSERT(d.writesFor(h1) == 0);
+            KSS_ASSERT(d.writesFor(h2) > 0 && d.writesFor(h3) > 0);
+
+            // Removing a stale handle does nothing, even once its slot is reused.
+            r.name = "g";
+            r.filedes = sv.first;
+            const auto h4 = p.add(r);
+            KSS_ASSERT(h4 != h1);
+            p.remove(h1);
+            this_thread::sleep_for(50ms);
+            d.reset();
+            this_thread::sleep_for(50ms);
+            KSS_ASSERT(d.writesFor(h4) > 0);
+
+            // Removing by name removes the group.
+            p.remove("g");
+            this_thread::sleep_for(50ms);
+            d.reset();
+            this_thread::sleep_for(50ms);
+            KSS_ASSERT(d.writesFor(h2) == 0 && d.writesFor(h4) == 0);
+            KSS_ASSERT(d.writesFor(h3) > 0);
+
+            p.remove(h3);
+            th.join();      // run() exits once there are no resources.
+        }
+    }),
+    make_pair("churn", [] {
+        // Replace a resource repeatedly while idle resources are also being
+        // monitored, checking that each replacement is picked up.
+        static constexpr size_t numChurns = 100;
+        static constexpr size_t numIdle = 10;
+
+        for (const auto engine : availableEngines()) {
+            vector<unique_ptr<file::FiledesGuard>> guards;
+            Poller p(engine);
+            PolledResource r;
+            r.event = PolledResource::Event::read;
+            for (size_t i = 0; i < numIdle; ++i) {
+                const auto sv = makeSocketPair();
+                guards.emplace_back(new file::FiledesGuard(sv.first));
+                guards.emplace_back(new file::FiledesGuard(sv.second));
+                r.name = "idle" + to_string(i);
+                r.filedes = sv.first;
+                p.add(r);
+            }
+
+            const auto sv = makeSocketPair();
+            guards.emplace_back(new file::FiledesGuard(sv.first));
+            guards.emplace_back(new file::FiledesGuard(sv.second));
+            ChurningDelegate d;
+            d.maxChurns = numChurns;
+            d.resource.name = "churn";
+            d.resource.filedes = sv.first;
+            d.resource.event = PolledResource::Event::write;
+            d.resource.mode = PolledResource::Mode::oneShot;
+            p.add(d.resource);
+            p.setDelegate(&d);
+            p.run();
+            KSS_ASSERT(d.numChurns == numChurns);
+        }
+    }),
+    make_pair("dispatch allocations", [] {
+        // A level triggered write resource on a socket is always ready, so each pass
+        // through run() dispatches exactly one event.
+        static constexpr size_t numEvents = 10000;
+
+        for (const auto engine : availableEngines()) {
+            const auto sv = makeSocketPair();
+            file::FiledesGuard g0(sv.first);
+            file::FiledesGuard g1(sv.second);
+
+            Poller p(engine);
+            DispatchDelegate d;
+            d.maxEvents = numEvents;
+            p.setDelegate(&d);
+
+            PolledResource r;
+            r.name = "writer";
+            r.filedes = sv.first;
+            r.event = PolledResource::Event::write;
+            p.add(r);
+            p.run();
+
+            KSS_ASSERT(d.numEvents == numEvents);
+            KSS_ASSERT(d.allocations == 0);
+        }
+    }),
+    make_pair("batch delivery", [] {
+        static constexpr size_t numResources = 10;
+
+        for (const auto engine : availableEngines()) {
+            vector<unique_ptr<file::FiledesGuard>> guards;
+            Poller p(engine);
+            BatchDelegate d;
+            p.setDelegate(&d);
+
+            // All the sockets are writable at once, so they should arrive together.
+            PolledResource r;
+            r.event = PolledResource::Event::write;
+            for (size_t i = 0; i < numResources; ++i) {
+                const auto sv = makeSocketPair();
+                guards.emplace_back(new file::FiledesGuard(sv.first));
+                guards.emplace_back(new file::FiledesGuard(sv.second));
+                r.name = "writer" + to_string(i);
+                r.filedes = sv.first;
+                p.add(r);
+            }
+            p.run();
+
+            KSS_ASSERT(d.numBatches == 5);
+            KSS_ASSERT(d.largestBatch == numResources);
+            KSS_ASSERT(d.names.size() == numResources);
+            KSS_ASSERT(d.numIndividual == 0);
+        }
+    }),
+    make_pair("timers", [] {
+        using namespace std::chrono_literals;
+        for (const auto engine : availableEngines()) {
+            Poller p(engine);
+            TimerDelegate d;
+            p.setDelegate(&d);
+
+            PollerTimer t;
+            t.delay = -1ms;
+            KSS_ASSERT(throwsException<invalid_argument>([&] { p.schedule(t); }));
+            t.delay = 0ms;
+            t.period = -1ms;
+            KSS_ASSERT(throwsException<invalid_argument>([&] { p.schedule(t); }));
+
+            // Include delays on either side of the level boundaries of the wheel.
+            t.period = 0ms;
+            const vector<chrono::milliseconds> delays { 0ms, 1ms, 255ms, 256ms, 300ms, 700ms };
+            for (const auto delay : delays) {
+                t.name = to_string(delay.count());
+                t.delay = delay;
+                p.schedule(t);
+            }
+
+            t.name = "cancelled";
+            t.delay = 10ms;
+            const auto cancelled = p.schedule(t);
+            KSS_ASSERT(cancelled != Poller::invalidHandle);
+            p.cancel(cancelled);
+            p.cancel(cancelled);
+
+            t.name = "periodic";
+            t.delay = 20ms;
+            t.period = 20ms;
+            const auto periodic = p.schedule(t);
+
+            // With no resources, run() exits once all the timers are done.
+            p.run();
+
+            vector<string> names;
+            for (const auto& e : d.expirations) {
+                if (e.name != "periodic") {
+                    names.push_back(e.name);
+                    KSS_ASSERT(e.elapsed.count() >= stol(e.name));
+                }
+                else {
+                    KSS_ASSERT(e.handle == periodic);
+                }
+            }
+            KSS_ASSERT(names == vector<string>({ "0", "1", "255", "256", "300", "700" }));
+            KSS_ASSERT(d.numPeriodic == 5);
+            KSS_ASSERT(d.expirations.back().elapsed < 1s);
+        }
+    }),
+    make_pair("timers with resources", [] {
+        using namespace std::chrono_literals;
+        const auto sv = makeSocketPair();
+        file::FiledesGuard g0(sv.first);
+        file::FiledesGuard g1(sv.second);
+
+        // Nothing will ever be read and the delegate waits forever, so only the timer
+        // can end the wait.
+        struct StoppingDelegate : public CountingDelegate {
+            void pollerTimerHasExpired(Poller&, const PollerTimer&) override {
+                shouldStop = true;
+            }
+        };
+
+        for (const auto engine : availableEngines()) {
+            Poller p(engine);
+            StoppingDelegate d;
+            d.waitForever = true;
+            p.setDelegate(&d);
+
+            PolledResource r;
+            r.name = "idle";
+            r.filedes = sv.first;
+            r.event = PolledResource::Event::read;
+            p.add(r);
+
+            PollerTimer t;
+            t.name = "stop";
+            t.delay = 50ms;
+            p.schedule(t);
+
+            auto fut = async(launch::async, [&] { p.run(); });
+            const auto status = fut.wait_for(1s);
+            KSS_ASSERT(status == future_status::ready);
+            if (status != future_status::ready) {
+                // Unblock the poller so that the test can finish.
+                d.shouldStop = true;
+                p.wakeup();
+            }
+            fut.get();
+        }
     })
 });
@@ -0,0 +1,245 @@
+//
+//  poller_pool.cpp
+//  unittest
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <kss/io/fileutil.hpp>
+#include <kss/io/poller_pool.hpp>
+#include <kss/test/all.h>
+
+using namespace std;
+using namespace kss::io;
+using namespace kss::test;
+
+namespace {
+
+    // Thread safe delegate that counts the callbacks and the threads that made them.
+    class PoolDelegate : public PollerDelegate {
+    public:
+        atomic<size_t>  numWrites { 0 };
+        atomic<size_t>  numTimers { 0 };
+
+        bool pollerShouldStop() const override { return false; }
+
+        void pollerResourceWriteIsReady(Poller&, const PolledResource&) override {
+            ++numWrites;
+            noteThread();
+        }
+
+        void pollerTimerHasExpired(Poller&, const PollerTimer&) override {
+            ++numTimers;
+            noteThread();
+        }
+
+        size_t numThreads() {
+            lock_guard<mutex> lock(m);
+            return threads.size();
+        }
+
+    private:
+        mutex               m;
+        set<thread::id>     threads;
+
+        void noteThread() {
+            lock_guard<mutex> lock(m);
+            threads.insert(this_thread::get_id());
+        }
+    };
+
+    // Delegate that makes the next poller to wait throw an exception from run().
+    class FailingDelegate : public PoolDelegate {
+    public:
+        mutable atomic<bool> failNext { false };
+
+        chrono::milliseconds pollerMaximumWaitInterval() const override {
+            if (failNext.exchange(false)) {
+                throw runtime_error("injected failure");
+            }
+            return PoolDelegate::pollerMaximumWaitInterval();
+        }
+    };
+
+    // Create a connected pair of sockets.
+    pair<int, int> makeSocketPair() {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+            throw system_error(errno, system_category(), "socketpair");
+        }
+        return make_pair(sv[0], sv[1]);
+    }
+
+    // Wait for a condition to become true, giving up after a second.
+    template <class Pred>
+    bool waitFor(Pred pred) {
+        using namespace std::chrono_literals;
+        for (int i = 0; i < 100 && !pred(); ++i) {
+            this_thread::sleep_for(10ms);
+        }
+        return pred();
+    }
+}
+
+
+static TestSuite ts("poller_pool", {
+    make_pair("construction", [] {
+        PollerPool pool;
+        KSS_ASSERT(pool.size() > 0);
+        KSS_ASSERT(PollerPool(3).size() == 3);
+        KSS_ASSERT(throwsException<runtime_error>([&] { pool.start(); }));
+        KSS_ASSERT(throwsException<invalid_argument>([&] { pool.pinToCpus({ 0, -1 }); }));
+        KSS_ASSERT(throwsException<out_of_range>([&] {
+            pool.remove(PollerPool::Handle { pool.size(), 1 });
+        }));
+        pool.stop();
+    }),
+    make_pair("distribution", [] {
+        PolledResource r;
+        r.name = "test";
+        r.filedes = 1;
+        r.event = PolledResource::Event::write;
+
+        PollerPool rr(3, PollerPool::Distribution::roundRobin);
+        for (size_t i = 0; i < 6; ++i) {
+            KSS_ASSERT(rr.add(r).poller == i % 3);
+        }
+
+        PollerPool ll(3, PollerPool::Distribution::leastLoaded);
+        const auto h0 = ll.add(r);
+        const auto h1 = ll.add(r);
+        const auto h2 = ll.add(r);
+        KSS_ASSERT(h0.poller == 0 && h1.poller == 1 && h2.poller == 2);
+        ll.remove(h1);
+        KSS_ASSERT(ll.add(r).poller == 1);
+        ll.remove("test");
+        KSS_ASSERT(ll.add(r).poller == 0);
+    }),
+    make_pair("dispatch", [] {
+        static constexpr size_t numPollers = 4;
+        vector<unique_ptr<file::FiledesGuard>> guards;
+
+        PoolDelegate d;
+        PollerPool pool(numPollers);
+        pool.setDelegate(&d);
+        pool.pinToCpus({ 0 });
+
+        // Resources added before and after the start should both be handled, even
+        // though the threads will have initially run out of resources.
+        PolledResource r;
+        r.event = PolledResource::Event::write;
+        r.mode = PolledResource::Mode::oneShot;
+        for (size_t i = 0; i < numPollers * 2; ++i) {
+            if (i == numPollers) {
+                pool.start();
+                KSS_ASSERT(throwsException<runtime_error>([&] { pool.start(); }));
+                this_thread::sleep_for(chrono::milliseconds(20));
+            }
+            const auto sv = makeSocketPair();
+            guards.emplace_back(new file::FiledesGuard(sv.first));
+            guards.emplace_back(new file::FiledesGuard(sv.second));
+            r.name = "writer" + to_string(i);
+            r.filedes = sv.first;
+            pool.add(r);
+        }
+        KSS_ASSERT(waitFor([&] { return d.numWrites == numPollers * 2; }));
+        KSS_ASSERT(d.numThreads() == numPollers);
+
+        PollerTimer t;
+        t.name = "timer";
+        t.delay = chrono::milliseconds(10);
+        for (size_t i = 0; i < numPollers; ++i) {
+            pool.schedule(t);
+        }
+        const auto cancelled = pool.schedule(t);
+        pool.cancel(cancelled);
+        KSS_ASSERT(waitFor([&] { return d.numTimers == numPollers; }));
+
+        pool.stop();
+        KSS_ASSERT(d.numWrites == numPollers * 2);
+        KSS_ASSERT(d.numTimers == numPollers);
+
+        // Once stopped, the pool may be restarted.
+        pool.rearm("writer0");
+        pool.start();
+        KSS_ASSERT(waitFor([&] { return d.numWrites == numPollers * 2 + 1; }));
+        pool.stop();
+    }),
+    make_pair("failing poller", [] {
+        static constexpr size_t numPollers = 3;
+        vector<unique_ptr<file::FiledesGuard>> guards;
+        auto addWriter = [&](PollerPool& pool, const string& name) {
+            const auto sv = makeSocketPair();
+            guards.emplace_back(new file::FiledesGuard(sv.first));
+            guards.emplace_back(new file::FiledesGuard(sv.second));
+            PolledResource r;
+            r.name = name;
+            r.filedes = sv.first;
+            r.event = PolledResource::Event::write;
+            r.mode = PolledResource::Mode::oneShot;
+            return pool.add(r);
+        };
+
+        FailingDelegate d;
+        PollerPool pool(numPollers);
+        pool.setDelegate(&d);
+        pool.start();
+
+        // The first poller fails as soon as it is given something to do, leaving its
+        // resource unserviced.
+        d.failNext = true;
+        KSS_ASSERT(addWriter(pool, "victim").poller == 0);
+        KSS_ASSERT(waitFor([&] { return pool.hasFailed(0); }));
+        KSS_ASSERT(!pool.hasFailed(1) && !pool.hasFailed(2));
+        KSS_ASSERT(throwsException<out_of_range>([&] { pool.hasFailed(numPollers); }));
+
+        // New resources and timers should skip the failed poller, so all of them are
+        // handled.
+        for (size_t i = 0; i < numPollers * 2; ++i) {
+            KSS_ASSERT(addWriter(pool, "writer" + to_string(i)).poller != 0);
+        }
+        KSS_ASSERT(waitFor([&] { return d.numWrites == numPollers * 2; }));
+
+        PollerTimer t;
+        t.name = "timer";
+        t.delay = chrono::milliseconds(10);
+        for (size_t i = 0; i < numPollers; ++i) {
+            KSS_ASSERT(pool.schedule(t).poller != 0);
+        }
+        KSS_ASSERT(waitFor([&] { return d.numTimers == numPollers; }));
+        pool.stop();
+
+        // Restarting the pool clears the failure, and the victim is finally serviced.
+        pool.start();
+        KSS_ASSERT(!pool.hasFailed(0));
+        KSS_ASSERT(waitFor([&] { return d.numWrites == numPollers * 2 + 1; }));
+        pool.stop();
+
+        // Once every poller has failed, nothing more may be added.
+        PollerPool single(1, PollerPool::Distribution::leastLoaded);
+        single.setDelegate(&d);
+        single.start();
+        d.failNext = true;
+        addWriter(single, "victim");
+        KSS_ASSERT(waitFor([&] { return single.hasFailed(0); }));
+        KSS_ASSERT(throwsException<runtime_error>([&] { addWriter(single, "writer"); }));
+        KSS_ASSERT(throwsException<runtime_error>([&] { single.schedule(t); }));
+        single.stop();
+    })
+});
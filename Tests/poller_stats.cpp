@@ -0,0 +1,194 @@
+//
+//  poller_stats.cpp
+//  unittest
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <future>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <kss/io/fileutil.hpp>
+#include <kss/io/poller.hpp>
+#include <kss/io/poller_stats.hpp>
+#include <kss/test/all.h>
+
+using namespace std;
+using namespace kss::io;
+using namespace kss::test;
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+
+namespace {
+
+    // Delegate that handles a fixed number of writes and timers, sleeping in the
+    // "slow" resource callbacks.
+    class StatsDelegate : public PollerDelegate {
+    public:
+        size_t  numWrites { 0 };
+        size_t  numTimers { 0 };
+
+        bool pollerShouldStop() const override {
+            return numWrites >= 20 && numTimers >= 2;
+        }
+
+        void pollerResourceWriteIsReady(Poller&, const PolledResource& r) override {
+            ++numWrites;
+            if (r.name == "slow") {
+                this_thread::sleep_for(milliseconds(2));
+            }
+        }
+
+        void pollerTimerHasExpired(Poller&, const PollerTimer&) override {
+            ++numTimers;
+        }
+    };
+
+    // Create a connected pair of sockets.
+    pair<int, int> makeSocketPair() {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+            throw system_error(errno, system_category(), "socketpair");
+        }
+        return make_pair(sv[0], sv[1]);
+    }
+}
+
+
+static TestSuite ts("poller_stats", {
+    make_pair("histogram", [] {
+        PollerStats s;
+        KSS_ASSERT(s.callbacks() == 0);
+        KSS_ASSERT(s.wakeups() == 0);
+        KSS_ASSERT(s.eventsPerWakeup() == 0.);
+        KSS_ASSERT(s.callbackLatencyAtPercentile(50) == nanoseconds::zero());
+        KSS_ASSERT(s.callbackLatencyHistogram().empty());
+        KSS_ASSERT(throwsException<invalid_argument>([&] { s.callbackLatencyAtPercentile(101); }));
+
+        // 90 fast callbacks and 10 slow ones.
+        for (int i = 0; i < 90; ++i) {
+            s.recordCallback("fast", microseconds(10));
+        }
+        for (int i = 0; i < 10; ++i) {
+            s.recordCallback("slow", milliseconds(5) + microseconds(i));
+        }
+        s.recordCallback("small", nanoseconds(3));
+        KSS_ASSERT(s.callbacks() == 101);
+
+        // Values are accurate to within the width of a histogram bucket.
+        const auto p50 = s.callbackLatencyAtPercentile(50);
+        KSS_ASSERT(p50 >= microseconds(10) && p50 <= microseconds(11));
+        const auto p99 = s.callbackLatencyAtPercentile(99);
+        KSS_ASSERT(p99 >= milliseconds(5) && p99 <= microseconds(5400));
+        KSS_ASSERT(s.callbackLatencyAtPercentile(0) == nanoseconds(3));
+
+        const auto h = s.callbackLatencyHistogram();
+        KSS_ASSERT(h.size() >= 3);
+        KSS_ASSERT(h.front().first == nanoseconds(3) && h.front().second == 1);
+        uint64_t total = 0;
+        for (size_t i = 0; i < h.size(); ++i) {
+            total += h[i].second;
+            if (i > 0) {
+                KSS_ASSERT(h[i].first > h[i-1].first);
+            }
+        }
+        KSS_ASSERT(total == 101);
+
+        const auto slowest = s.slowestCallbacks();
+        KSS_ASSERT(slowest.size() == 3);
+        KSS_ASSERT(slowest[0].first == "slow" && slowest[0].second == milliseconds(5) + microseconds(9));
+        KSS_ASSERT(slowest[1].first == "fast" && slowest[1].second == microseconds(10));
+        KSS_ASSERT(slowest[2].first == "small");
+
+        s.recordWakeup(milliseconds(1), milliseconds(2), 4);
+        s.recordWakeup(milliseconds(1), milliseconds(2), 0);
+        KSS_ASSERT(s.wakeups() == 2);
+        KSS_ASSERT(s.events() == 4);
+        KSS_ASSERT(s.eventsPerWakeup() == 2.);
+        KSS_ASSERT(s.timeInPoll() == milliseconds(2));
+        KSS_ASSERT(s.timeInCallbacks() == milliseconds(4));
+        KSS_ASSERT(s.wakeupsPerSecond() > 0.);
+
+        s.reset();
+        KSS_ASSERT(s.callbacks() == 0 && s.wakeups() == 0 && s.events() == 0);
+        KSS_ASSERT(s.callbackLatencyHistogram().empty());
+        KSS_ASSERT(s.slowestCallbacks().size() == 3);
+        KSS_ASSERT(s.slowestCallbacks()[0].second == nanoseconds::zero());
+    }),
+    make_pair("poller", [] {
+        const auto sv0 = makeSocketPair();
+        const auto sv1 = makeSocketPair();
+        file::FiledesGuard g0(sv0.first), g1(sv0.second), g2(sv1.first), g3(sv1.second);
+
+        Poller p;
+        StatsDelegate d;
+        PollerStats s;
+        p.setDelegate(&d);
+        KSS_ASSERT(p.stats() == nullptr);
+        p.setStats(&s);
+        KSS_ASSERT(p.stats() == &s);
+
+        PolledResource r;
+        r.event = PolledResource::Event::write;
+        r.name = "fast";
+        r.filedes = sv0.first;
+        p.add(r);
+        r.name = "slow";
+        r.filedes = sv1.first;
+        r.mode = PolledResource::Mode::oneShot;
+        p.add(r);
+
+        PollerTimer t;
+        t.name = "timer";
+        t.delay = milliseconds(1);
+        t.period = milliseconds(1);
+        p.schedule(t);
+
+        // The statistics may be read while the poller is running.
+        atomic<bool> done { false };
+        auto reader = async(launch::async, [&] {
+            uint64_t maxWakeups = 0;
+            while (!done) {
+                maxWakeups = max(maxWakeups, s.wakeups());
+                s.slowestCallbacks();
+                s.callbackLatencyAtPercentile(99);
+                this_thread::yield();
+            }
+            return maxWakeups;
+        });
+        p.run();
+        done = true;
+        KSS_ASSERT(reader.get() <= s.wakeups());
+
+        KSS_ASSERT(s.wakeups() > 0);
+        KSS_ASSERT(s.events() >= d.numWrites + d.numTimers);
+        KSS_ASSERT(s.callbacks() == d.numWrites + d.numTimers);
+        KSS_ASSERT(s.eventsPerWakeup() >= 1.);
+        KSS_ASSERT(s.timeInCallbacks() >= milliseconds(2));
+
+        const auto slowest = s.slowestCallbacks();
+        KSS_ASSERT(slowest.size() == 3);
+        KSS_ASSERT(slowest[0].first == "slow");
+        KSS_ASSERT(slowest[0].second >= milliseconds(2));
+        KSS_ASSERT(s.callbackLatencyAtPercentile(100) >= milliseconds(2));
+
+        // Once removed, nothing more is recorded.
+        p.setStats(nullptr);
+        const auto wakeups = s.wakeups();
+        d.numWrites = 0;
+        p.run();
+        KSS_ASSERT(s.wakeups() == wakeups);
+    })
+});
@@ -8,11 +8,17 @@
 //
 
 #include <cerrno>
+#include <cstdio>
 #include <cstring>
 #include <system_error>
+#include <utility>
 #include <vector>
 
+#include <fcntl.h>
 #include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <sys/socket.h>
 #include <kss/io/socket.hpp>
 #include <kss/test/all.h>
@@ -29,6 +35,22 @@ namespace {
         }
     }
 
+    // Returns the range of ports the kernel chooses from when binding to port 0, or
+    // (0, 0) if it is not known.
+    pair<int, int> ephemeralPortRange() {
+        int first = 0;
+        int last = 0;
+#if defined(__linux)
+        if (FILE* f = fopen("/proc/sys/net/ipv4/ip_local_port_range", "r")) {
+            if (fscanf(f, "%d %d", &first, &last) != 2) {
+                first = last = 0;
+            }
+            fclose(f);
+        }
+#endif
+        return make_pair(first, last);
+    }
+
     // Block a port and return the socket.
     int block(int port) {
         const int sock = ::socket(AF_INET, SOCK_STREAM, 0);
@@ -50,6 +72,16 @@ namespace {
 
         return sock;
     }
+
+    // Returns the port a socket is bound to.
+    int portOf(int sock) {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        if (getsockname(sock, reinterpret_cast<struct sockaddr*>(&addr), &len) == -1) {
+            throw system_error(errno, system_category(), "getsockname");
+        }
+        return ntohs(addr.sin_port);
+    }
 }
 
 static TestSuite ts("net::socket", {
@@ -101,6 +133,111 @@ static TestSuite ts("net::socket", {
             unblock(sock);
         }
     }),
+    make_pair("bindToPort with SO_REUSEPORT", [] {
+        static constexpr size_t numListeners = 4;
+        static constexpr int numClients = 200;
+
+        vector<int> listeners;
+        for (size_t i = 0; i < numListeners; ++i) {
+            const int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+            KSS_ASSERT(sock != -1);
+            listeners.push_back(sock);
+        }
+        const int port = bindToPort(listeners, nextAvailablePort, nullptr, 0, 7000, 7100);
+        KSS_ASSERT(port >= 7000 && port <= 7100);
+        for (const auto sock : listeners) {
+            KSS_ASSERT(portOf(sock) == port);
+            KSS_ASSERT(listen(sock, numClients) == 0);
+        }
+
+        // A socket without SO_REUSEPORT cannot join them.
+        const int other = ::socket(AF_INET, SOCK_STREAM, 0);
+        KSS_ASSERT(throwsException<system_error>([&] { bindToPort(other, port); }));
+        close(other);
+
+        KSS_ASSERT(throwsException<invalid_argument>([&] {
+            bindToPort(vector<int>(), nextAvailablePort);
+        }));
+        KSS_ASSERT(throwsException<invalid_argument>([&] {
+            bindToPort(vector<int>({ -1 }), nextAvailablePort);
+        }));
+
+        // The connections are spread across the listeners.
+        vector<int> clients;
+        for (int i = 0; i < numClients; ++i) {
+            const int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            KSS_ASSERT(connect(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+            clients.push_back(sock);
+        }
+
+        int total = 0;
+        for (const auto sock : listeners) {
+            fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+            int accepted = 0;
+            int fd;
+            while ((fd = accept(sock, nullptr, nullptr)) != -1) {
+                ++accepted;
+                close(fd);
+            }
+#if defined(__linux)
+            KSS_ASSERT(accepted > 0);
+#endif
+            total += accepted;
+        }
+        KSS_ASSERT(total == numClients);
+
+        for (const auto sock : clients) {
+            close(sock);
+        }
+        for (const auto sock : listeners) {
+            close(sock);
+        }
+    }),
+    make_pair("findNextAvailablePort with many ports in use", [] {
+        static constexpr int startingPort = 8000;
+        static constexpr int numBlocked = 500;
+
+        vector<int> blockedSockets;
+        for (int port = startingPort; port < startingPort + numBlocked; ++port) {
+            const int sock = block(port);
+            if (sock != -1) {
+                listen(sock, 1);
+            }
+            blockedSockets.push_back(sock);
+        }
+
+        KSS_ASSERT(findNextAvailablePort(startingPort) >= startingPort + numBlocked);
+
+        // If the kernel's ephemeral range lies within the search range, the kernel
+        // chooses the port, so it must come from that range.
+        const int port = findAvailablePort(startingPort);
+        KSS_ASSERT(port >= startingPort + numBlocked && port <= maxPossiblePortAsInt);
+        const auto range = ephemeralPortRange();
+        if (range.first >= startingPort && range.first <= range.second
+            && range.second <= maxPossiblePortAsInt)
+        {
+            KSS_ASSERT(port >= range.first && port <= range.second);
+        }
+
+        // A narrow range is searched in order.
+        KSS_ASSERT(findAvailablePort(startingPort, startingPort + numBlocked + 10)
+                   >= startingPort + numBlocked);
+        KSS_ASSERT(throwsException<system_error>([&] {
+            findAvailablePort(startingPort, startingPort + 2);
+        }));
+        KSS_ASSERT(throwsException<invalid_argument>([] {
+            findAvailablePort(6010, 6000);
+        }));
+
+        for (const auto sock : blockedSockets) {
+            unblock(sock);
+        }
+    }),
     make_pair("findNextAvailablePort", [] {
         vector<int> blockedSockets;
         blockedSockets.push_back(block(6000));
@@ -0,0 +1,247 @@
+//
+//  tcp_server.cpp
+//  unittest
+//
+//  Created by Steven W. Klassen on 2026-10-16.
+//  Copyright © 2026 Klassen Software Solutions. All rights reserved.
+//  Licensing follows the MIT License.
+//
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <kss/io/fileutil.hpp>
+#include <kss/io/tcp_server.hpp>
+#include <kss/test/all.h>
+
+using namespace std;
+using namespace kss::io;
+using namespace kss::io::net;
+using namespace kss::test;
+
+namespace {
+
+    // Delegate that echos everything it receives, stopping once enough connections
+    // have come and gone.
+    class EchoDelegate : public TcpServerDelegate {
+    public:
+        atomic<bool>    shouldStop { false };
+        size_t          expected { 0 };
+        size_t          numOpened { 0 };
+        size_t          numClosed { 0 };
+        size_t          maxAvailable { 0 };
+        TcpConnection*  lastOpened { nullptr };
+
+        bool tcpServerShouldStop() const override {
+            return shouldStop || (expected > 0 && numClosed >= expected);
+        }
+
+        void tcpServerConnectionHasOpened(TcpServer&, TcpConnection& c) override {
+            ++numOpened;
+            lastOpened = &c;
+        }
+
+        void tcpServerDataHasArrived(TcpServer&, TcpConnection& c) override {
+            maxAvailable = max(maxAvailable, c.available());
+            c.write(c.data(), c.available());
+            c.consume(c.available());
+        }
+
+        void tcpServerConnectionWillClose(TcpServer&, TcpConnection&) override {
+            ++numClosed;
+        }
+    };
+
+    // Delegate that sends a fixed amount of data to each connection, as fast as the
+    // write buffer allows, then closes it.
+    class SendingDelegate : public EchoDelegate {
+    public:
+        size_t          bytesToSend { 0 };
+        size_t          bytesSent { 0 };
+        size_t          numBlocked { 0 };
+        size_t          maxPending { 0 };
+
+        void tcpServerConnectionHasOpened(TcpServer& s, TcpConnection& c) override {
+            EchoDelegate::tcpServerConnectionHasOpened(s, c);
+            send(c);
+        }
+
+        void tcpServerConnectionCanWrite(TcpServer&, TcpConnection& c) override {
+            send(c);
+        }
+
+    private:
+        void send(TcpConnection& c) {
+            const vector<char> chunk(1024, 'x');
+            while (bytesSent < bytesToSend) {
+                const auto len = min(chunk.size(), bytesToSend - bytesSent);
+                bytesSent += len;
+                const bool ok = c.write(chunk.data(), len);
+                maxPending = max(maxPending, c.pending());
+                if (!ok) {
+                    ++numBlocked;
+                    return;
+                }
+            }
+            c.close();
+        }
+    };
+
+    // Connect a client to the server on the loopback interface.
+    int connectTo(int port) {
+        const int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (sock == -1) {
+            throw system_error(errno, system_category(), "socket");
+        }
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+            const auto err = errno;
+            close(sock);
+            throw system_error(err, system_category(), "connect");
+        }
+        return sock;
+    }
+
+    // Read until the peer closes the connection, returning the number of bytes read.
+    size_t readAll(int sock, string* contents = nullptr) {
+        char buffer[4096];
+        size_t total = 0;
+        ssize_t n;
+        while ((n = ::read(sock, buffer, sizeof(buffer))) > 0) {
+            total += static_cast<size_t>(n);
+            if (contents) {
+                contents->append(buffer, static_cast<size_t>(n));
+            }
+        }
+        return total;
+    }
+
+    // The engines that should work on this platform.
+    vector<Poller::Engine> availableEngines() {
+        vector<Poller::Engine> engines { Poller::Engine::poll };
+#if defined(__linux)
+        engines.push_back(Poller::Engine::epoll);
+#endif
+        return engines;
+    }
+}
+
+
+static TestSuite ts("net::tcp_server", {
+    make_pair("construction", [] {
+        TcpServer s;
+        KSS_ASSERT(s.port() >= defaultStartingPort);
+        KSS_ASSERT(s.size() == 0);
+        KSS_ASSERT(throwsException<runtime_error>([&] { s.run(); }));
+        KSS_ASSERT(throwsException<invalid_argument>([&] { s.setBufferLimits(0, 1); }));
+        KSS_ASSERT(throwsException<system_error>([&] { TcpServer s2(s.port()); }));
+    }),
+    make_pair("echo", [] {
+        static constexpr size_t numClients = 20;
+        for (const auto engine : availableEngines()) {
+            TcpServer s(nextAvailablePort, nullptr, 0, engine);
+            EchoDelegate d;
+            d.expected = numClients;
+            s.setDelegate(&d);
+            s.setBufferLimits(1024, TcpServer::defaultWriteLimit);
+
+            // Each client sends more than the read limit, then shuts down its end of
+            // the connection and reads back everything it sent.
+            auto fut = async(launch::async, [&] { s.run(); });
+            vector<future<bool>> clients;
+            for (size_t i = 0; i < numClients; ++i) {
+                clients.push_back(async(launch::async, [&, i] {
+                    const int sock = connectTo(s.port());
+                    file::FiledesGuard g(sock);
+                    const string message = "client " + to_string(i) + ": " + string(5000, char('a' + i));
+                    if (::write(sock, message.data(), message.size()) != ssize_t(message.size())) {
+                        return false;
+                    }
+                    shutdown(sock, SHUT_WR);
+                    string reply;
+                    readAll(sock, &reply);
+                    return reply == message;
+                }));
+            }
+            for (auto& c : clients) {
+                KSS_ASSERT(c.get());
+            }
+
+            KSS_ASSERT(fut.wait_for(chrono::seconds(5)) == future_status::ready);
+            d.shouldStop = true;
+            fut.get();
+            KSS_ASSERT(d.numOpened == numClients);
+            KSS_ASSERT(d.numClosed == numClients);
+            KSS_ASSERT(d.maxAvailable <= 1024);
+            KSS_ASSERT(s.size() == 0);
+        }
+    }),
+    make_pair("backpressure", [] {
+        static constexpr size_t bytesToSend = 4 * 1024 * 1024;
+        static constexpr size_t writeLimit = 16 * 1024;
+        for (const auto engine : availableEngines()) {
+            TcpServer s(nextAvailablePort, nullptr, 0, engine);
+            SendingDelegate d;
+            d.expected = 1;
+            d.bytesToSend = bytesToSend;
+            s.setDelegate(&d);
+            s.setBufferLimits(TcpServer::defaultReadLimit, writeLimit);
+
+            auto fut = async(launch::async, [&] { s.run(); });
+            const int sock = connectTo(s.port());
+            file::FiledesGuard g(sock);
+
+            // Reading slowly at first forces the server to buffer and then wait.
+            this_thread::sleep_for(chrono::milliseconds(50));
+            KSS_ASSERT(readAll(sock) == bytesToSend);
+
+            KSS_ASSERT(fut.wait_for(chrono::seconds(5)) == future_status::ready);
+            d.shouldStop = true;
+            fut.get();
+            KSS_ASSERT(d.bytesSent == bytesToSend);
+            KSS_ASSERT(d.numBlocked > 0);
+            KSS_ASSERT(d.maxPending <= writeLimit + 1024);
+        }
+    }),
+    make_pair("post", [] {
+        TcpServer s;
+        EchoDelegate d;
+        d.expected = 1;
+        s.setDelegate(&d);
+
+        // Write to a connection from another thread by posting to the server.
+        auto fut = async(launch::async, [&] { s.run(); });
+        const int sock = connectTo(s.port());
+        file::FiledesGuard g(sock);
+        for (int i = 0; i < 100 && s.size() == 0; ++i) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        KSS_ASSERT(s.size() == 1);
+
+        s.post([&] {
+            d.lastOpened->write("hello", 5);
+            d.lastOpened->close();
+        });
+        string reply;
+        readAll(sock, &reply);
+        KSS_ASSERT(reply == "hello");
+        KSS_ASSERT(fut.wait_for(chrono::seconds(1)) == future_status::ready);
+        fut.get();
+        KSS_ASSERT(s.size() == 0);
+    })
+});